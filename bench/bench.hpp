@@ -0,0 +1,167 @@
+/*
+ * bench.hpp
+ *
+ *  Small helpers shared by the benchmarks : timing, percentiles and a
+ *  minimal JSON writer so results can be tracked over time.
+ */
+
+#ifndef BENCH_HPP_
+#define BENCH_HPP_
+
+#include <concurrent/cache/session_trace.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+typedef std::chrono::steady_clock clock;
+
+inline double elapsedNs(clock::time_point start, clock::time_point end = clock::now()) {
+	return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+/**
+ * Parses the common command line : --quick reduces the iteration counts
+ */
+struct options {
+	bool quick;
+
+	options(int argc, char **argv) :
+			quick(false) {
+		for (int i = 1; i < argc; ++i)
+			if (strcmp(argv[i], "--quick") == 0)
+				quick = true;
+	}
+
+	inline size_t scale(size_t iterations) const {
+		return quick ? std::max<size_t>(iterations / 20, 1) : iterations;
+	}
+};
+
+struct samples {
+	std::vector<double> values;
+
+	inline void add(double value) {
+		values.push_back(value);
+	}
+
+	double percentile(double p) {
+		if (values.empty())
+			return 0;
+		std::sort(values.begin(), values.end());
+		return values[std::min(values.size() - 1, size_t(p * values.size()))];
+	}
+
+	double mean() const {
+		double sum = 0;
+		for (double value : values)
+			sum += value;
+		return values.empty() ? 0 : sum / values.size();
+	}
+};
+
+/**
+ * Streaming JSON writer, no validation beyond comma handling
+ */
+struct json {
+	json() :
+			m_First(true) {
+	}
+
+	json& beginObject(const char *key = nullptr) {
+		prefix(key);
+		m_Out << '{';
+		m_First = true;
+		return *this;
+	}
+
+	json& endObject() {
+		m_Out << '}';
+		m_First = false;
+		return *this;
+	}
+
+	json& beginArray(const char *key = nullptr) {
+		prefix(key);
+		m_Out << '[';
+		m_First = true;
+		return *this;
+	}
+
+	json& endArray() {
+		m_Out << ']';
+		m_First = false;
+		return *this;
+	}
+
+	json& value(const char *key, double v) {
+		prefix(key);
+		m_Out << v;
+		return *this;
+	}
+
+	json& value(const char *key, const std::string &v) {
+		prefix(key);
+		m_Out << '"' << v << '"';
+		return *this;
+	}
+
+	/**
+	 * Writes p50, p90, p99, min, max and mean of the samples
+	 */
+	json& distribution(const char *key, samples &s) {
+		beginObject(key);
+		value("p50", s.percentile(.5));
+		value("p90", s.percentile(.9));
+		value("p99", s.percentile(.99));
+		value("min", s.percentile(0));
+		value("max", s.percentile(1));
+		value("mean", s.mean());
+		return endObject();
+	}
+
+	std::string str() const {
+		return m_Out.str();
+	}
+
+private:
+	void prefix(const char *key) {
+		if (!m_First)
+			m_Out << ',';
+		m_First = false;
+		if (key)
+			m_Out << '"' << key << "\":";
+	}
+
+	std::ostringstream m_Out;
+	bool m_First;
+};
+
+inline concurrent::cache::session_trace loadTrace(const char *filename) {
+	std::ifstream file(filename);
+	if (!file.is_open())
+		throw std::runtime_error(std::string("unable to load ") + filename);
+	return concurrent::cache::read_session_trace(file);
+}
+
+/**
+ * Frame timings ordered by id
+ */
+inline std::vector<concurrent::cache::frame_timing> loadTimings(const char *filename) {
+	std::vector<concurrent::cache::frame_timing> timings;
+	for (const auto &pair : loadTrace(filename).timings)
+		timings.push_back(pair.second);
+	return timings;
+}
+
+} // namespace bench
+
+#endif /* BENCH_HPP_ */
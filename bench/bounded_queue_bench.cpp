@@ -0,0 +1,194 @@
+/*
+ * bounded_queue_bench.cpp
+ *
+ *  Memory and throughput of the ring based concurrent::bounded_queue against
+ *  the previous implementation, a deque shifted on every push.
+ *
+ *  Allocations are counted by replacing the global operator new, resident
+ *  memory is sampled along a long run of push/pop pairs.
+ */
+
+#include "bench.hpp"
+
+#include <concurrent/bounded_queue.h>
+
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <new>
+#include <thread>
+
+#include <unistd.h>
+
+static std::atomic<uint64_t> g_Allocations(0);
+
+void* operator new(size_t size) {
+	g_Allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = malloc(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+/**
+ * Previous bounded_queue : push_front/pop_back on a deque of 'capacity' elements
+ */
+template<typename T>
+struct deque_bounded_queue : public concurrent::details::queue_base<deque_bounded_queue<T>, std::deque<T>, concurrent::default_queue_policy> {
+	typedef std::deque<T> container_type;
+	typedef typename container_type::size_type size_type;
+
+	explicit deque_bounded_queue(size_type capacity) :
+			m_unread(0), m_container(capacity) {
+	}
+private:
+	template<typename _T, typename _Container, typename _Policy>
+	friend struct concurrent::details::queue_base;
+
+	inline void _clear() {
+		m_unread = 0;
+	}
+	inline void _push(const T &value) {
+		m_container.push_front(value);
+		m_container.pop_back();
+		++m_unread;
+	}
+	inline size_type _size() const {
+		return m_unread;
+	}
+	inline T _pop() {
+		return m_container[--m_unread];
+	}
+	inline void wait_not_empty(std::unique_lock<concurrent::details::mutex_type> &lock) {
+		m_not_empty.wait(lock, [this]() { return is_not_empty() || this->is_terminated(); });
+	}
+	inline void wait_not_empty_until(std::unique_lock<concurrent::details::mutex_type> &lock, const concurrent::details::clock_type::time_point &deadline) {
+		m_not_empty.wait_until(lock, deadline, [this]() { return is_not_empty() || this->is_terminated(); });
+	}
+	inline void wait_not_full(std::unique_lock<concurrent::details::mutex_type> &lock) {
+		m_not_full.wait(lock, [this]() { return is_not_full() || this->is_terminated(); });
+	}
+	inline bool is_not_empty() const {
+		return m_unread > 0;
+	}
+	inline bool is_not_full() const {
+		return m_unread < m_container.size();
+	}
+	inline void notify_not_full() {
+		m_not_full.notify_one();
+	}
+	inline void notify_not_empty() {
+		m_not_empty.notify_one();
+	}
+	inline void notify_all() {
+		m_not_empty.notify_all();
+		m_not_full.notify_all();
+	}
+
+	size_type m_unread;
+	container_type m_container;
+	concurrent::details::condition_type m_not_empty;
+	concurrent::details::condition_type m_not_full;
+};
+
+static double residentKb() {
+	long pages = 0, resident = 0;
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (!statm)
+		return 0;
+	if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(statm);
+	return resident * (sysconf(_SC_PAGESIZE) / 1024.);
+}
+
+/**
+ * Single thread push/pop pairs on a half full queue, samples resident memory
+ * and counts the allocations after construction.
+ */
+template<typename Queue>
+static void memory(bench::json &out, const char *name, const size_t operations) {
+	const size_t capacity = 1024;
+	const size_t samples = 10;
+	Queue queue(capacity);
+	int value = 0;
+	for (size_t i = 0; i < capacity / 2; ++i)
+		queue.push(int(i));
+	const uint64_t allocations = g_Allocations.load();
+	out.beginObject(name);
+	out.value("operations", double(operations));
+	const bench::clock::time_point start = bench::clock::now();
+	out.beginArray("resident_kb");
+	for (size_t sample = 0; sample < samples; ++sample) {
+		for (size_t i = 0; i < operations / samples / 2; ++i) {
+			queue.push(value);
+			queue.pop(value);
+		}
+		out.value(nullptr, residentKb());
+	}
+	out.endArray();
+	out.value("ns_per_operation", bench::elapsedNs(start) / operations);
+	out.value("allocations", double(g_Allocations.load() - allocations));
+	out.endObject();
+}
+
+template<typename Queue>
+static double throughput(const size_t pairs, const size_t itemsPerProducer) {
+	Queue queue(1024);
+	std::vector<std::thread> group;
+	const bench::clock::time_point start = bench::clock::now();
+	for (size_t i = 0; i < pairs; ++i) {
+		group.emplace_back([&]() {
+			for (size_t item = 0; item < itemsPerProducer; ++item)
+				queue.push(int(item));
+		});
+		group.emplace_back([&]() {
+			int value;
+			for (size_t item = 0; item < itemsPerProducer; ++item)
+				queue.pop(value);
+		});
+	}
+	for (std::thread &thread : group)
+		thread.join();
+	return pairs * itemsPerProducer / (bench::elapsedNs(start) / 1e9);
+}
+
+template<typename Queue>
+static void scaling(bench::json &out, const char *name, const bench::options &options) {
+	const size_t items = options.scale(1000000);
+	out.beginArray(name);
+	for (size_t pairs = 1; pairs <= 4; pairs *= 2) {
+		bench::samples opsPerSecond;
+		for (size_t i = 0; i < (options.quick ? 3 : 5); ++i)
+			opsPerSecond.add(throughput<Queue>(pairs, items / pairs));
+		out.beginObject().value("threads", double(2 * pairs)).distribution("ops_per_second", opsPerSecond).endObject();
+	}
+	out.endArray();
+}
+
+int main(int argc, char **argv) {
+	const bench::options options(argc, argv);
+	const size_t operations = options.scale(100000000);
+	bench::json out;
+	out.beginObject();
+	out.value("benchmark", std::string("bounded_queue"));
+	out.beginObject("memory");
+	memory<concurrent::bounded_queue<int> >(out, "ring", operations);
+	memory<deque_bounded_queue<int> >(out, "deque", operations);
+	out.endObject();
+	out.beginObject("throughput");
+	scaling<concurrent::bounded_queue<int> >(out, "ring", options);
+	scaling<deque_bounded_queue<int> >(out, "deque", options);
+	out.endObject();
+	out.endObject();
+	printf("%s\n", out.str().c_str());
+	return EXIT_SUCCESS;
+}
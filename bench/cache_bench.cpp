@@ -0,0 +1,361 @@
+/*
+ * cache_bench.cpp
+ *
+ *  Cost of the cache bookkeeping : update/put/get on priority_cache_details
+ *  and pop/push throughput of lookahead_cache with workers doing no work.
+ *
+ *  Scrubbing replaces the job at display rate : every 60 Hz frame the
+ *  pending ids are discarded and a new look ahead window is requested
+ *  around a moving playhead, a few frames get decoded in between.
+ *
+ *  Restart stops and restarts the workers on every job with terminate, the
+ *  time until all of them returned from pop is measured with the throwing
+ *  pop and with pop(id, std::nothrow).
+ *
+ *  Timeline reads the cached ids in a loop while the workers push, with
+ *  dumpKeys and from a range_index, as a timeline bar redrawing would.
+ *
+ *  Combining compares plain locking and flat combining of push and update
+ *  with many workers : popping and pushing, and pushing only.
+ */
+
+#include "bench.hpp"
+
+#include <concurrent/barrier.hpp>
+#include <concurrent/cache/lookahead_cache.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+using namespace concurrent::cache;
+
+typedef size_t id_type;
+typedef size_t metric_type;
+typedef size_t data_type;
+
+struct Job {
+	id_type from;
+	size_t count;
+
+	Job() :
+			from(0), count(0) {
+	}
+	Job(id_type from, size_t count) :
+			from(from), count(count) {
+	}
+	id_type next() {
+		--count;
+		return from++;
+	}
+	bool empty() const {
+		return count == 0;
+	}
+	void clear() {
+		count = 0;
+	}
+};
+
+static void bookkeeping(bench::json &out, const bench::options &options) {
+	const size_t frames = 2000;
+	const size_t batch = 100;
+	const size_t batches = options.scale(2000);
+	priority_cache_details<id_type, metric_type, data_type> cache(frames / 2);
+	std::mt19937 generator(1);
+	std::uniform_int_distribution<size_t> seek(0, frames - 1);
+	bench::samples update, put, get;
+	data_type data;
+	for (size_t i = 0; i < batches; ++i) {
+		cache.discardPending();
+		const id_type start = seek(generator);
+		std::vector<id_type> needed;
+		bench::clock::time_point begin = bench::clock::now();
+		for (size_t j = 0; j < batch; ++j) {
+			const id_type id = (start + j) % frames;
+			if (cache.update(id) == NEEDED)
+				needed.push_back(id);
+		}
+		update.add(bench::elapsedNs(begin) / batch);
+		if (!needed.empty()) {
+			begin = bench::clock::now();
+			for (const id_type id : needed)
+				cache.put(id, 1, id);
+			put.add(bench::elapsedNs(begin) / needed.size());
+		}
+		begin = bench::clock::now();
+		for (size_t j = 0; j < batch; ++j)
+			cache.get(seek(generator), data);
+		get.add(bench::elapsedNs(begin) / batch);
+	}
+	out.beginObject("priority_cache_details");
+	out.distribution("update_ns", update);
+	out.distribution("put_ns", put);
+	out.distribution("get_ns", get);
+	out.endObject();
+}
+
+static void scrubbing(bench::json &out, const bench::options &options) {
+	const size_t frames = 100000;
+	const size_t window = 4000;
+	const size_t decodedPerFrame = 8;
+	const size_t jobs = options.scale(600); // 10s at 60 Hz
+	priority_cache_details<id_type, metric_type, data_type> cache(window / 2);
+	std::mt19937 generator(1);
+	std::uniform_int_distribution<int> scrub(-48, 48);
+	bench::samples discard, request, job;
+	id_type playhead = frames / 2;
+	for (size_t i = 0; i < jobs; ++i) {
+		playhead = (playhead + frames + scrub(generator)) % frames;
+		const bench::clock::time_point begin = bench::clock::now();
+		cache.discardPending();
+		discard.add(bench::elapsedNs(begin));
+		const bench::clock::time_point updates = bench::clock::now();
+		std::vector<id_type> needed;
+		for (size_t j = 0; j < window; ++j) {
+			const id_type id = (playhead + j) % frames;
+			const UpdateStatus status = cache.update(id);
+			if (status == FULL)
+				break;
+			if (status == NEEDED && needed.size() < decodedPerFrame)
+				needed.push_back(id);
+		}
+		request.add(bench::elapsedNs(updates) / window);
+		for (const id_type id : needed)
+			cache.put(id, 1, id);
+		job.add(bench::elapsedNs(begin));
+	}
+	out.beginObject("scrubbing_60hz");
+	out.value("window", double(window));
+	out.distribution("discard_ns", discard);
+	out.distribution("update_ns", request);
+	out.distribution("job_ns", job);
+	out.endObject();
+}
+
+static double lookahead(const size_t threads, const size_t items) {
+	lookahead_cache<id_type, metric_type, data_type, Job> cache(-1);
+	std::atomic<size_t> pushed(0);
+	std::vector<std::thread> group;
+	for (size_t i = 0; i < threads; ++i)
+		group.emplace_back([&]() {
+			try {
+				id_type id;
+				for (;;) {
+					cache.pop(id);
+					cache.push(id, 1, id);
+					if (++pushed == items)
+						cache.terminate();
+				}
+			} catch (concurrent::terminated &) {
+			}
+		});
+	const bench::clock::time_point start = bench::clock::now();
+	cache.process(Job(0, items));
+	for (std::thread &thread : group)
+		thread.join();
+	return items / (bench::elapsedNs(start) / 1e9);
+}
+
+typedef lookahead_cache<id_type, metric_type, data_type, Job> Lookahead;
+
+static void work(Lookahead &cache, std::atomic<size_t> &pushed, std::true_type) {
+	id_type id;
+	while (cache.pop(id, std::nothrow) == concurrent::pop_status::OK) {
+		cache.push(id, 1, id);
+		++pushed;
+	}
+}
+
+static void work(Lookahead &cache, std::atomic<size_t> &pushed, std::false_type) {
+	try {
+		id_type id;
+		for (;;) {
+			cache.pop(id);
+			cache.push(id, 1, id);
+			++pushed;
+		}
+	} catch (concurrent::terminated &) {
+	}
+}
+
+template<bool STATUS>
+static void restart(bench::samples &stop, const size_t threads, const size_t jobs) {
+	const size_t jobSize = 100;
+	Lookahead cache(-1);
+	concurrent::barrier stopped(uint32_t(threads + 1));
+	std::atomic<bool> done(false);
+	std::atomic<size_t> pushed(0);
+	std::vector<std::thread> group;
+	for (size_t i = 0; i < threads; ++i)
+		group.emplace_back([&]() {
+			while (!done) {
+				work(cache, pushed, std::integral_constant<bool, STATUS>());
+				stopped.arriveAndWait(); // all workers stopped
+				stopped.arriveAndWait(); // restarted
+			}
+		});
+	for (size_t job = 0; job < jobs; ++job) {
+		cache.process(Job(job * jobSize, jobSize));
+		while (pushed < (job + 1) * jobSize)
+			std::this_thread::yield();
+		const bench::clock::time_point begin = bench::clock::now();
+		cache.terminate();
+		stopped.arriveAndWait();
+		stop.add(bench::elapsedNs(begin));
+		cache.terminate(false);
+		done = job + 1 == jobs;
+		stopped.arriveAndWait();
+	}
+	for (std::thread &thread : group)
+		thread.join();
+}
+
+struct IndexPolicy: public default_cache_policy {
+	typedef range_index<id_type, 0> index_type;
+};
+
+typedef lookahead_cache<id_type, metric_type, data_type, Job, IndexPolicy> IndexedLookahead;
+
+static void readTimeline(IndexedLookahead &cache, std::vector<id_type> &keys, std::false_type) {
+	cache.dumpKeys(keys);
+}
+
+static void readTimeline(IndexedLookahead &cache, std::vector<id_type> &, std::true_type) {
+	cache.index().ranges();
+}
+
+/**
+ * Returns the pushes per second, read gets the duration of the reads
+ */
+template<bool RANGES>
+static double timeline(bench::samples &read, const size_t threads, const size_t items) {
+	IndexedLookahead cache(-1);
+	std::atomic<size_t> pushed(0);
+	std::vector<std::thread> group;
+	for (size_t i = 0; i < threads; ++i)
+		group.emplace_back([&]() {
+			id_type id;
+			while (cache.pop(id, std::nothrow) == concurrent::pop_status::OK) {
+				cache.push(id, 1, id);
+				if (++pushed == items)
+					cache.terminate();
+			}
+		});
+	const bench::clock::time_point start = bench::clock::now();
+	cache.process(Job(0, items));
+	std::vector<id_type> keys;
+	while (pushed < items) {
+		const bench::clock::time_point begin = bench::clock::now();
+		readTimeline(cache, keys, std::integral_constant<bool, RANGES>());
+		read.add(bench::elapsedNs(begin));
+		std::this_thread::yield();
+	}
+	for (std::thread &thread : group)
+		thread.join();
+	return items / (bench::elapsedNs(start) / 1e9);
+}
+
+struct CombiningPolicy: public default_cache_policy {
+	typedef concurrent::flat_combining<64> combining_type;
+};
+
+template<typename POLICY>
+static double popPush(const size_t threads, const size_t items) {
+	lookahead_cache<id_type, metric_type, data_type, Job, POLICY> cache(-1);
+	std::atomic<size_t> pushed(0);
+	std::vector<std::thread> group;
+	for (size_t i = 0; i < threads; ++i)
+		group.emplace_back([&]() {
+			id_type id;
+			while (cache.pop(id, std::nothrow) == concurrent::pop_status::OK) {
+				cache.push(id, 1, id);
+				if (++pushed == items)
+					cache.terminate();
+			}
+		});
+	const bench::clock::time_point start = bench::clock::now();
+	cache.process(Job(0, items));
+	for (std::thread &thread : group)
+		thread.join();
+	return items / (bench::elapsedNs(start) / 1e9);
+}
+
+/**
+ * Every thread pushes its own ids, released together
+ */
+template<typename POLICY>
+static double pushOnly(const size_t threads, const size_t items) {
+	lookahead_cache<id_type, metric_type, data_type, Job, POLICY> cache(-1);
+	concurrent::barrier start(uint32_t(threads + 1));
+	std::vector<std::thread> group;
+	const size_t perThread = items / threads;
+	for (size_t i = 0; i < threads; ++i)
+		group.emplace_back([&, i]() {
+			start.arriveAndWait();
+			for (id_type id = i * perThread; id < (i + 1) * perThread; ++id)
+				cache.push(id, 1, id);
+		});
+	start.arriveAndWait();
+	const bench::clock::time_point begin = bench::clock::now();
+	for (std::thread &thread : group)
+		thread.join();
+	return perThread * threads / (bench::elapsedNs(begin) / 1e9);
+}
+
+int main(int argc, char **argv) {
+	const bench::options options(argc, argv);
+	bench::json out;
+	out.beginObject();
+	out.value("benchmark", std::string("cache"));
+	bookkeeping(out, options);
+	scrubbing(out, options);
+	out.beginArray("lookahead_cache");
+	const size_t items = options.scale(5000);
+	for (size_t threads = 1; threads <= 8; threads *= 2) {
+		bench::samples itemsPerSecond;
+		for (size_t i = 0; i < (options.quick ? 3 : 5); ++i)
+			itemsPerSecond.add(lookahead(threads, items));
+		out.beginObject().value("threads", double(threads)).distribution("items_per_second", itemsPerSecond).endObject();
+	}
+	out.endArray();
+	out.beginArray("restart");
+	for (size_t threads = 1; threads <= 8; threads *= 2) {
+		bench::samples exceptions, status;
+		restart<false>(exceptions, threads, options.scale(200));
+		restart<true>(status, threads, options.scale(200));
+		out.beginObject().value("threads", double(threads)).distribution("exception_stop_ns", exceptions).distribution("status_stop_ns", status).endObject();
+	}
+	out.endArray();
+	out.beginArray("combining");
+	for (size_t threads = 8; threads <= 64; threads *= 2) {
+		bench::samples locked, combined, lockedPush, combinedPush;
+		for (size_t i = 0; i < (options.quick ? 3 : 5); ++i) {
+			locked.add(popPush<default_cache_policy>(threads, items));
+			combined.add(popPush<CombiningPolicy>(threads, items));
+			lockedPush.add(pushOnly<default_cache_policy>(threads, options.scale(64000)));
+			combinedPush.add(pushOnly<CombiningPolicy>(threads, options.scale(64000)));
+		}
+		out.beginObject().value("threads", double(threads));
+		out.distribution("locked_items_per_second", locked).distribution("combining_items_per_second", combined);
+		out.distribution("locked_pushes_per_second", lockedPush).distribution("combining_pushes_per_second", combinedPush);
+		out.endObject();
+	}
+	out.endArray();
+	out.beginArray("timeline");
+	for (size_t threads = 1; threads <= 4; threads *= 2) {
+		bench::samples dumpRead, rangesRead, dumpThroughput, rangesThroughput;
+		for (size_t i = 0; i < (options.quick ? 3 : 5); ++i) {
+			dumpThroughput.add(timeline<false>(dumpRead, threads, options.scale(20000)));
+			rangesThroughput.add(timeline<true>(rangesRead, threads, options.scale(20000)));
+		}
+		out.beginObject().value("threads", double(threads));
+		out.distribution("dump_keys_items_per_second", dumpThroughput).distribution("dump_keys_read_ns", dumpRead);
+		out.distribution("range_index_items_per_second", rangesThroughput).distribution("range_index_read_ns", rangesRead);
+		out.endObject();
+	}
+	out.endArray();
+	out.endObject();
+	printf("%s\n", out.str().c_str());
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,82 @@
+/*
+ * cost_replay.cpp
+ *
+ *  Replays a review session over the timing files with a cache holding a
+ *  quarter of the frames : the user loops over a shot and regularly seeks
+ *  somewhere else in the sequence. Reports the time spent recomputing frames
+ *  with each eviction mode.
+ *
+ *  usage : cost_replay [--quick] [trace files...]
+ */
+
+#include "bench.hpp"
+
+#include <concurrent/cache/priority_cache_details.hpp>
+
+#include <cstdio>
+#include <random>
+
+using namespace concurrent::cache;
+
+typedef priority_cache_details<size_t, size_t, size_t> CACHE;
+
+static size_t replay(const std::vector<frame_timing> &timings, const EvictionMode mode, const size_t jobs) {
+	const size_t frames = timings.size();
+	const size_t playbackLength = frames / 8;
+	CACHE cache(frames / 4);
+	cache.setEvictionMode(mode);
+	std::mt19937 generator(42);
+	std::uniform_int_distribution<size_t> seek(0, frames - 1);
+	std::bernoulli_distribution loop(.7);
+	const size_t loopStart = frames / 3;
+	size_t recomputation = 0;
+	for (size_t job = 0; job < jobs; ++job) {
+		cache.discardPending();
+		const size_t start = loop(generator) ? loopStart : seek(generator);
+		for (size_t i = 0; i < playbackLength; ++i) {
+			const size_t frame = (start + i) % frames;
+			const UpdateStatus status = cache.update(frame);
+			if (status == FULL)
+				break;
+			if (status == NEEDED) {
+				const size_t cost = timings[frame].load + timings[frame].decode;
+				recomputation += cost;
+				cache.put(frame, 1, frame, cost);
+			}
+		}
+	}
+	return recomputation;
+}
+
+int main(int argc, char **argv) {
+	const bench::options options(argc, argv);
+	std::vector<std::string> filenames;
+	for (int i = 1; i < argc; ++i)
+		if (argv[i][0] != '-')
+			filenames.push_back(argv[i]);
+	if (filenames.empty()) {
+		filenames.push_back("tests/benchmark/data/gch.txt");
+		filenames.push_back("tests/benchmark/data/nro.txt");
+	}
+
+	const size_t jobs = options.scale(200);
+	bench::json out;
+	out.beginObject();
+	out.value("benchmark", std::string("cost_replay"));
+	out.beginArray("traces");
+	for (const std::string &filename : filenames) {
+		const std::vector<frame_timing> timings = bench::loadTimings(filename.c_str());
+		const double priority = double(replay(timings, PRIORITY, jobs));
+		const double greedyDual = double(replay(timings, GREEDY_DUAL_SIZE, jobs));
+		out.beginObject();
+		out.value("trace", filename);
+		out.value("priority_recompute_ms", priority);
+		out.value("greedy_dual_size_recompute_ms", greedyDual);
+		out.value("saved_ms", priority - greedyDual);
+		out.endObject();
+	}
+	out.endArray();
+	out.endObject();
+	printf("%s\n", out.str().c_str());
+	return EXIT_SUCCESS;
+}
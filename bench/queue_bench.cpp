@@ -0,0 +1,77 @@
+/*
+ * queue_bench.cpp
+ *
+ *  Push/pop throughput of concurrent::queue and concurrent::bounded_queue
+ *  with an increasing number of producer/consumer pairs, blocking and
+ *  spinning.
+ */
+
+#include "bench.hpp"
+
+#include <concurrent/queue.hpp>
+#include <concurrent/bounded_queue.h>
+
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+struct spinning_policy: public concurrent::default_queue_policy {
+	typedef concurrent::adaptive_spin_wait wait_type;
+};
+
+template<typename Queue>
+static double throughput(Queue &queue, const size_t pairs, const size_t itemsPerProducer) {
+	std::vector<std::thread> group;
+	const bench::clock::time_point start = bench::clock::now();
+	for (size_t i = 0; i < pairs; ++i) {
+		group.emplace_back([&]() {
+			for (size_t item = 0; item < itemsPerProducer; ++item)
+				queue.push(int(item));
+		});
+		group.emplace_back([&]() {
+			int value;
+			for (size_t item = 0; item < itemsPerProducer; ++item)
+				queue.pop(value);
+		});
+	}
+	for (std::thread &thread : group)
+		thread.join();
+	// one operation is a push and its matching pop
+	return pairs * itemsPerProducer / (bench::elapsedNs(start) / 1e9);
+}
+
+template<typename Factory>
+static void scaling(bench::json &out, const char *name, const bench::options &options, Factory factory) {
+	const size_t items = options.scale(200000);
+	const size_t repetitions = options.quick ? 3 : 7;
+	out.beginArray(name);
+	for (size_t pairs = 1; pairs <= 8; pairs *= 2) {
+		bench::samples opsPerSecond;
+		for (size_t i = 0; i < repetitions; ++i) {
+			auto pQueue = factory();
+			opsPerSecond.add(throughput(*pQueue, pairs, items / pairs));
+		}
+		out.beginObject().value("threads", double(2 * pairs)).distribution("ops_per_second", opsPerSecond).endObject();
+	}
+	out.endArray();
+}
+
+int main(int argc, char **argv) {
+	const bench::options options(argc, argv);
+	bench::json out;
+	out.beginObject();
+	out.value("benchmark", std::string("queue"));
+	scaling(out, "queue", options, []() {
+		return std::unique_ptr<concurrent::queue<int> >(new concurrent::queue<int>());
+	});
+	scaling(out, "bounded_queue", options, []() {
+		return std::unique_ptr<concurrent::bounded_queue<int> >(new concurrent::bounded_queue<int>(1024));
+	});
+	typedef concurrent::bounded_queue<int, std::vector<int>, spinning_policy> spinning_queue;
+	scaling(out, "bounded_queue_adaptive_spin", options, []() {
+		return std::unique_ptr<spinning_queue>(new spinning_queue(1024));
+	});
+	out.endObject();
+	printf("%s\n", out.str().c_str());
+	return EXIT_SUCCESS;
+}
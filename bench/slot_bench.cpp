@@ -0,0 +1,110 @@
+/*
+ * slot_bench.cpp
+ *
+ *  Handoff latency of concurrent::slot : two threads ping-pong a value
+ *  through a pair of slots, one way latency is half the round trip.
+ *  Measured for each wait strategy, busy spinning is skipped on a single
+ *  core where it only progresses through preemption.
+ *
+ *  Then the latest value use case, a writer publishing 4KB frames as fast
+ *  as it can while a reader waits for them : time spent in set by the
+ *  writer and age of the values when the reader gets them, for slot and
+ *  latest_slot.
+ */
+
+#include "bench.hpp"
+
+#include <concurrent/slot.hpp>
+#include <concurrent/latest_slot.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+template<typename Slot>
+static void handoff(bench::json &out, const char *name, const size_t roundTrips) {
+	Slot ping;
+	Slot pong;
+	std::thread echo([&]() {
+		size_t value;
+		for (size_t i = 0; i < roundTrips; ++i) {
+			ping.waitGet(value);
+			pong.set(value);
+		}
+	});
+
+	bench::samples latencies;
+	size_t value;
+	for (size_t i = 0; i < roundTrips; ++i) {
+		const bench::clock::time_point start = bench::clock::now();
+		ping.set(i);
+		pong.waitGet(value);
+		latencies.add(bench::elapsedNs(start) / 2);
+	}
+	echo.join();
+	out.distribution(name, latencies);
+}
+
+struct frame {
+	bench::clock::time_point published;
+	std::array<char, 4096> pixels;
+};
+
+template<typename Slot>
+static void latest(bench::json &out, const char *name, const size_t frames) {
+	Slot slot;
+	std::atomic<bool> done(false);
+	bench::samples ages;
+	std::thread reader([&]() {
+		frame value;
+		try {
+			for (;;) {
+				slot.waitGet(value);
+				ages.add(bench::elapsedNs(value.published));
+			}
+		} catch (const concurrent::terminated&) {
+		}
+	});
+	bench::samples sets;
+	frame value;
+	value.pixels.fill(0);
+	for (size_t i = 0; i < frames; ++i) {
+		const bench::clock::time_point start = bench::clock::now();
+		value.published = start;
+		slot.set(value);
+		sets.add(bench::elapsedNs(start));
+		// leaves the reader a chance to run on a single core
+		std::this_thread::yield();
+	}
+	slot.terminate();
+	reader.join();
+	out.beginObject(name);
+	out.distribution("set_ns", sets);
+	out.distribution("age_ns", ages);
+	out.value("frames_read", double(ages.values.size()));
+	out.endObject();
+}
+
+int main(int argc, char **argv) {
+	const bench::options options(argc, argv);
+	const size_t roundTrips = options.scale(100000);
+
+	bench::json out;
+	out.beginObject();
+	out.value("benchmark", std::string("slot"));
+	out.value("round_trips", double(roundTrips));
+	out.value("cores", double(std::thread::hardware_concurrency()));
+	handoff<concurrent::slot<size_t> >(out, "handoff_ns", roundTrips);
+	handoff<concurrent::slot<size_t, concurrent::adaptive_spin_wait> >(out, "adaptive_spin_handoff_ns", roundTrips);
+	if (std::thread::hardware_concurrency() > 1)
+		handoff<concurrent::slot<size_t, concurrent::busy_spin_wait> >(out, "busy_spin_handoff_ns", roundTrips);
+	handoff<concurrent::latest_slot<size_t> >(out, "latest_slot_handoff_ns", roundTrips);
+	out.beginObject("latest");
+	latest<concurrent::slot<frame> >(out, "slot", roundTrips);
+	latest<concurrent::latest_slot<frame> >(out, "latest_slot", roundTrips);
+	out.endObject();
+	out.endObject();
+	printf("%s\n", out.str().c_str());
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,247 @@
+/*
+ * trace_replay.cpp
+ *
+ *  Replays session traces in virtual time : workers behave like the
+ *  original cache benchmark (decode first, then load new frames) but instead
+ *  of sleeping they advance a simulated clock. Results are deterministic and
+ *  only the library bookkeeping costs real time.
+ *
+ *  Timing only traces are played linearly. Session traces (recorded with
+ *  session_recorder or written by tools/TraceGenerator) post their jobs and
+ *  read their frames at the recorded times, the hit rate of the reads is
+ *  reported.
+ *
+ *  usage : trace_replay [--quick] [--cache <frames>] [trace files...]
+ */
+
+#include "bench.hpp"
+
+#include <concurrent/cache/priority_cache.hpp>
+
+#include <concurrent/cache/session_trace.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+
+using namespace concurrent::cache;
+
+typedef uint64_t id_type;
+
+struct Job {
+	std::shared_ptr<const std::vector<id_type> > ids;
+	size_t index;
+
+	Job() :
+			index(0) {
+	}
+	Job(const std::vector<id_type> &ids) :
+			ids(std::make_shared<const std::vector<id_type> >(ids)), index(0) {
+	}
+	id_type next() {
+		return (*ids)[index++];
+	}
+	bool empty() const {
+		return !ids || index == ids->size();
+	}
+	void clear() {
+		ids.reset();
+	}
+};
+
+typedef priority_cache<id_type, size_t, id_type, Job> CACHE;
+
+struct replay_result {
+	double virtualMs; // time to process the whole trace
+	double wallNs; // real time spent simulating, i.e. library overhead
+	size_t gets;
+	size_t hits;
+};
+
+/**
+ * Jobs and reads of the session in time order, a timing only trace is a
+ * single job reading nothing.
+ */
+struct session {
+	struct action {
+		uint64_t time; // us
+		bool process; // posts jobs[job] or reads id
+		size_t job;
+		id_type id;
+	};
+
+	session(const session_trace &trace) :
+			timings(trace.timings) {
+		const std::vector<std::vector<uint64_t> > requests = trace.jobs();
+		jobs.assign(requests.begin(), requests.end());
+		if (jobs.empty()) {
+			std::vector<id_type> all;
+			for (const auto &pair : timings)
+				all.push_back(pair.first);
+			jobs.push_back(Job(all));
+			const action post = { 0, true, 0, 0 };
+			actions.push_back(post);
+			return;
+		}
+		size_t job = 0;
+		for (const session_event &e : trace.events) {
+			if (e.type == SESSION_PROCESS) {
+				const action post = { e.time, true, job++, 0 };
+				actions.push_back(post);
+			} else if (e.type == SESSION_GET) {
+				const action read = { e.time, false, 0, e.id };
+				actions.push_back(read);
+			}
+		}
+		std::stable_sort(actions.begin(), actions.end(), [](const action &a, const action &b) {
+			return a.time < b.time;
+		});
+	}
+
+	// frames missing from the trace cost 1ms
+	uint64_t loadUs(id_type id) const {
+		const auto found = timings.find(id);
+		return found == timings.end() ? 1000 : found->second.load * 1000;
+	}
+	uint64_t decodeUs(id_type id) const {
+		const auto found = timings.find(id);
+		return found == timings.end() ? 0 : found->second.decode * 1000;
+	}
+
+	std::map<uint64_t, frame_timing> timings;
+	std::vector<Job> jobs;
+	std::vector<action> actions;
+};
+
+/**
+ * Discrete event simulation of 'threads' workers with a cache of 'capacity'
+ * frames
+ */
+static replay_result replay(const session &s, const size_t threads, const size_t capacity) {
+	typedef std::pair<uint64_t, size_t> event; // time, worker
+	std::priority_queue<event, std::vector<event>, std::greater<event> > ready;
+	std::deque<id_type> decodeQueue;
+	std::vector<id_type> loading(threads, id_type(-1));
+	std::vector<bool> decoding(threads, false);
+	std::vector<size_t> parked; // workers with nothing to do
+	for (size_t worker = 0; worker < threads; ++worker)
+		parked.push_back(worker);
+
+	replay_result result = { 0, 0, 0, 0 };
+	const bench::clock::time_point start = bench::clock::now();
+	CACHE cache(capacity);
+	uint64_t now = 0;
+	auto wakeUp = [&](size_t count) {
+		for (; count > 0 && !parked.empty(); --count) {
+			ready.push(event(now, parked.back()));
+			parked.pop_back();
+		}
+	};
+	size_t nextAction = 0;
+	while (!ready.empty() || nextAction < s.actions.size()) {
+		// session actions happen before workers scheduled at the same time
+		if (nextAction < s.actions.size() && (ready.empty() || s.actions[nextAction].time <= ready.top().first)) {
+			const session::action &action = s.actions[nextAction++];
+			now = std::max(now, action.time);
+			if (action.process) {
+				cache.process(s.jobs[action.job]);
+				wakeUp(threads);
+			} else {
+				id_type data;
+				++result.gets;
+				if (cache.get(action.id, data))
+					++result.hits;
+			}
+			continue;
+		}
+		const event current = ready.top();
+		ready.pop();
+		now = current.first;
+		const size_t worker = current.second;
+		// completing the previous action
+		if (decoding[worker]) {
+			cache.push(loading[worker], 1, loading[worker]);
+			decoding[worker] = false;
+		} else if (loading[worker] != id_type(-1)) {
+			decodeQueue.push_back(loading[worker]);
+			wakeUp(1);
+		}
+		loading[worker] = id_type(-1);
+		// picking next action, decoding has priority
+		id_type id;
+		if (!decodeQueue.empty()) {
+			id = decodeQueue.front();
+			decodeQueue.pop_front();
+			decoding[worker] = true;
+			loading[worker] = id;
+			ready.push(event(now + s.decodeUs(id), worker));
+		} else if (cache.pop(id)) {
+			loading[worker] = id;
+			ready.push(event(now + s.loadUs(id), worker));
+		} else {
+			parked.push_back(worker);
+		}
+	}
+	result.virtualMs = now / 1000.;
+	result.wallNs = bench::elapsedNs(start);
+	return result;
+}
+
+int main(int argc, char **argv) {
+	const bench::options options(argc, argv);
+	std::vector<std::string> filenames;
+	size_t capacity = -1;
+	for (int i = 1; i < argc; ++i)
+		if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+			capacity = strtoull(argv[++i], nullptr, 10);
+		else if (argv[i][0] != '-')
+			filenames.push_back(argv[i]);
+	if (filenames.empty()) {
+		filenames.push_back("tests/benchmark/data/gch.txt");
+		filenames.push_back("tests/benchmark/data/nro.txt");
+	}
+
+	bench::json out;
+	out.beginObject();
+	out.value("benchmark", std::string("trace_replay"));
+	out.beginArray("traces");
+	for (const std::string &filename : filenames) {
+		session_trace trace = bench::loadTrace(filename.c_str());
+		trace.deriveTimings();
+		const session s(trace);
+		out.beginObject();
+		out.value("trace", filename);
+		out.value("frames", double(s.timings.size()));
+		out.value("jobs", double(s.jobs.size()));
+		out.beginArray("scaling");
+		double reference = 0;
+		for (size_t threads = 1; threads <= 16; ++threads) {
+			bench::samples wall;
+			replay_result result = { 0, 0, 0, 0 };
+			for (size_t i = 0; i < (options.quick ? 1 : 5); ++i) {
+				result = replay(s, threads, capacity);
+				wall.add(result.wallNs / s.timings.size());
+			}
+			if (threads == 1)
+				reference = result.virtualMs;
+			out.beginObject();
+			out.value("threads", double(threads));
+			out.value("virtual_ms", result.virtualMs);
+			out.value("speedup", reference / result.virtualMs);
+			if (result.gets)
+				out.value("hit_rate", double(result.hits) / result.gets);
+			out.distribution("overhead_ns_per_frame", wall);
+			out.endObject();
+		}
+		out.endArray();
+		out.endObject();
+	}
+	out.endArray();
+	out.endObject();
+	printf("%s\n", out.str().c_str());
+	return EXIT_SUCCESS;
+}
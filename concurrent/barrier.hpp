@@ -0,0 +1,86 @@
+/*
+ * barrier.hpp
+ *
+ *  Reusable barrier for threads working in lockstep, e.g. frame stages.
+ */
+
+#ifndef BARRIER_HPP_
+#define BARRIER_HPP_
+
+#include "common.hpp"
+#include "wait_strategy.hpp"
+#include "details/atomic_wait.hpp"
+
+#include <functional>
+
+namespace concurrent {
+
+/**
+ * 'count' threads call arriveAndWait, all of them are released when the last
+ * one arrives and the barrier is ready for the next phase. The optional
+ * completion runs on the last thread before the others are released.
+ *
+ * By setting terminate to true, waiters will throw a terminated exception.
+ * Setting it back to false resets the arrivals for the next phase, the
+ * threads which were waiting must have left arriveAndWait by then.
+ */
+template<typename WAIT = block_wait>
+struct basic_barrier : private noncopyable {
+    explicit basic_barrier(uint32_t count, const std::function<void()> &completion = std::function<void()>()) :
+                    m_Count(count), m_Arrived(0), m_Phase(0), m_Completion(completion) {
+    }
+
+    /**
+     * Returns the phase the thread took part in
+     */
+    uint32_t arriveAndWait() {
+        const uint32_t phase = m_Phase.load();
+        checkTermination(phase);
+        if (m_Arrived.fetch_add(1) + 1 == m_Count) {
+            if (m_Completion)
+                m_Completion();
+            // nobody can arrive for the next phase before it starts
+            m_Arrived.store(0);
+            m_Phase.fetch_add(PHASE);
+            m_Waiter.notify_all(m_Phase);
+            return phase / PHASE;
+        }
+        for (uint32_t state = phase; state / PHASE == phase / PHASE; state = m_Phase.load()) {
+            checkTermination(state);
+            m_Waiter.wait(m_Phase, state);
+        }
+        return phase / PHASE;
+    }
+
+    void terminate(bool value = true) {
+        if (value) {
+            m_Phase.fetch_or(TERMINATED);
+        } else {
+            // the threads which left on termination had arrived
+            m_Arrived.store(0);
+            m_Phase.fetch_and(~TERMINATED);
+        }
+        m_Waiter.notify_all(m_Phase);
+    }
+private:
+    enum {
+        TERMINATED = 1, PHASE = 2
+    };
+
+    static inline void checkTermination(const uint32_t state) {
+        if (state & TERMINATED)
+            CONCURRENT_THROW(terminated());
+    }
+
+    const uint32_t m_Count;
+    std::atomic<uint32_t> m_Arrived;
+    details::wait_word m_Phase; // phase counter and terminate flag
+    details::atomic_waiter<WAIT> m_Waiter;
+    std::function<void()> m_Completion;
+};
+
+typedef basic_barrier<> barrier;
+
+}  // namespace concurrent
+
+#endif /* BARRIER_HPP_ */
@@ -3,54 +3,130 @@
 
 #include "details/queue_base.hpp"
 
-#include <functional>
-#include <condition_variable>
-#include <deque>
+#include <vector>
 
 namespace concurrent {
+namespace details {
+
+/**
+ * Fixed capacity circular buffer over a random access container. All the
+ * storage is allocated at construction, push and pop only assign elements.
+ */
+template<typename Container>
+struct ring_container {
+    typedef typename Container::value_type value_type;
+    typedef typename Container::size_type size_type;
+    typedef typename Container::const_reference const_reference;
+
+    explicit ring_container(size_type capacity) : m_container(capacity), m_head(0), m_size(0) {
+    }
+
+    inline void push(const_reference value) {
+        size_type tail = m_head + m_size;
+        if (tail >= m_container.size())
+            tail -= m_container.size();
+        m_container[tail] = value;
+        ++m_size;
+    }
+    inline value_type pop() {
+        const size_type head = m_head;
+        if (++m_head == m_container.size())
+            m_head = 0;
+        --m_size;
+        return m_container[head];
+    }
+    inline size_type size() const {
+        return m_size;
+    }
+    inline size_type capacity() const {
+        return m_container.size();
+    }
+    inline bool empty() const {
+        return m_size == 0;
+    }
+    inline bool full() const {
+        return m_size == m_container.size();
+    }
+    inline void clear() {
+        m_head = 0;
+        m_size = 0;
+    }
+
+private:
+    Container m_container;
+    size_type m_head; // next element to pop
+    size_type m_size;
+};
+
+template<typename Container, typename C2>
+inline void drain_container(ring_container<Container>& from, C2& to) {
+    std::back_insert_iterator<C2> inserter(to);
+    while (!from.empty())
+        *inserter++ = from.pop();
+}
+
+/**
+ * Moves as many elements as the ring can hold, the others stay in 'from'
+ */
+template<typename C1, typename Container>
+inline void drain_container(C1& from, ring_container<Container>& to) {
+    typename C1::iterator itr = from.begin();
+    for (; itr != from.end() && !to.full(); ++itr)
+        to.push(*itr);
+    from.erase(from.begin(), itr);
+}
+
+} // namespace details
 
 /**
  * Bounded concurrent queue for safe access from several threads.
  *
+ * The elements are stored in a preallocated ring, Container must be a
+ * random access container constructible with a size. drainFrom only moves
+ * the elements that fit.
+ *
  * Please note that a single Mutex is used for synchronization of front() and back()
  * thus leading to contention if consumer and producer are accessing the container at the same time.
  */
-template<typename T, typename Container = std::deque<T> >
-struct bounded_queue : public details::queue_base< bounded_queue<T>, Container > {
-    typedef Container container_type;
+template<typename T, typename Container = std::vector<T>, typename Policy = default_queue_policy>
+struct bounded_queue : public details::queue_base< bounded_queue<T, Container, Policy>, details::ring_container<Container>, Policy > {
+    typedef details::ring_container<Container> container_type;
     typedef typename container_type::value_type value_type;
     typedef typename container_type::size_type size_type;
+    typedef typename container_type::const_reference const_reference;
 
-    explicit bounded_queue(size_type capacity) : m_unread(0), m_container(capacity) {
+    explicit bounded_queue(size_type capacity) : m_container(capacity) {
     }
 private:
-    typedef bounded_queue<T, Container> ME;
-
-    template<typename _T,typename _Container>
+    template<typename _T, typename _Container, typename _Policy>
     friend struct details::queue_base;
 
     inline void _clear() {
         m_container.clear();
-        m_unread = 0;
     }
-    inline void _push(value_type value) {
-        m_container.push_front(value);
-        ++m_unread;
+    inline void _push(const_reference value) {
+        m_container.push(value);
+    }
+    inline size_type _size() const {
+        return m_container.size();
     }
     inline value_type _pop() {
-        return m_container[--m_unread];
+        return m_container.pop();
+    }
+    inline void wait_not_empty(std::unique_lock<details::mutex_type> &lock) {
+        m_not_empty.wait(lock, [this]() { return is_not_empty() || this->is_terminated(); });
     }
-    inline void wait_not_empty(std::unique_lock<std::mutex> &lock) {
-        m_not_empty.wait(lock, std::bind(&ME::is_not_empty, this));
+    inline void wait_not_empty_until(std::unique_lock<details::mutex_type> &lock, const details::clock_type::time_point &deadline) {
+        m_not_empty.wait_until(lock, deadline, [this]() { return is_not_empty() || this->is_terminated(); });
     }
-    inline void wait_not_full(std::unique_lock<std::mutex> &lock) {
-        m_not_full.wait(lock, std::bind(&ME::is_not_full, this));
+    inline void wait_not_full(std::unique_lock<details::mutex_type> &lock) {
+        m_not_full.wait(lock, [this]() { return is_not_full() || this->is_terminated(); });
     }
     inline bool is_not_empty() const {
-        return m_unread > 0;
+        return !m_container.empty();
     }
     inline bool is_not_full() const {
-        return m_unread < m_container.size();
+        return !m_container.full();
     }
     inline void notify_not_full() {
         m_not_full.notify_one();
@@ -58,11 +134,14 @@ private:
     inline void notify_not_empty() {
         m_not_empty.notify_one();
     }
+    inline void notify_all() {
+        m_not_empty.notify_all();
+        m_not_full.notify_all();
+    }
 private:
-    size_type m_unread;
     container_type m_container;
-    std::condition_variable m_not_empty;
-    std::condition_variable m_not_full;
+    details::wait_condition<typename Policy::wait_type> m_not_empty;
+    details::wait_condition<typename Policy::wait_type> m_not_full;
 };
 
 } /* namespace concurrent */
@@ -0,0 +1,251 @@
+/*
+ * cache_governor.hpp
+ *
+ *  Shares a global weight budget between several caches, e.g. one
+ *  lookahead_cache per viewer pane and per track.
+ *
+ *  Each registered cache leases part of the budget : its maximum weight is
+ *  set by the governor. rebalance, called periodically, moves capacity from
+ *  the idle caches to the busy ones according to their statistics since the
+ *  previous call. Shrunk caches are reclaimed right away through their own
+ *  eviction order.
+ *
+ *  cache_governor<> governor(4ull << 30);
+ *  const auto lease = governor.lease(paneCache);
+ *  // every few hundred milliseconds
+ *  governor.rebalance();
+ */
+
+#ifndef CACHE_GOVERNOR_HPP_
+#define CACHE_GOVERNOR_HPP_
+
+#include "cache_stats.hpp"
+
+#include <concurrent/common.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace concurrent {
+namespace cache {
+
+struct governor_options {
+	double smoothing; // weight of the last period in the scores, in ]0, 1]
+	double slack; // growth room of the caches which are not short of capacity, relative to their weight
+
+	governor_options() :
+			smoothing(0.5), slack(0.25) {
+	}
+};
+
+/**
+ * The caches must provide setMaxWeight, reclaim, weight and stats like
+ * lookahead_cache. Without statistics enabled in their policy every cache
+ * looks idle and the budget is shared equally.
+ *
+ * A cache's score is the smoothed number of gets and needed updates over a
+ * period, doubled at most by its miss rate. The budget above the minimums is
+ * shared in proportion to the scores. Caches which neither got FULL updates,
+ * rejected puts nor evicted during the period are not short of capacity :
+ * they get at most their weight plus some slack, the rest goes to the others.
+ */
+template<typename METRIC_TYPE = size_t>
+struct cache_governor: private noncopyable {
+	typedef METRIC_TYPE metric_type;
+	typedef size_t lease_id;
+
+	explicit cache_governor(const metric_type budget, const governor_options &options = governor_options()) :
+			m_Budget(budget), m_Options(options), m_NextId(0) {
+	}
+
+	/**
+	 * Registers cache with an average score and rebalances. The cache must
+	 * be released before being destroyed.
+	 */
+	template<typename CACHE>
+	lease_id lease(CACHE &cache, const metric_type minimum = 0) {
+		const std::lock_guard<std::mutex> lock(m_Mutex);
+		Lease lease;
+		lease.stats = [&cache]() {
+			return cache.stats();
+		};
+		lease.weight = [&cache]() {
+			return metric_type(cache.weight());
+		};
+		lease.resize = [&cache](metric_type weight) {
+			cache.setMaxWeight(weight);
+			cache.reclaim(weight);
+		};
+		lease.minimum = minimum;
+		lease.leased = 0;
+		lease.last = lease.stats();
+		lease.score = averageScore();
+		const lease_id id = m_NextId++;
+		m_Leases.insert(std::make_pair(id, lease));
+		rebalanceLocked();
+		return id;
+	}
+
+	/**
+	 * Gives the capacity of the cache back to the others
+	 */
+	void release(const lease_id id) {
+		const std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_Leases.erase(id))
+			rebalanceLocked();
+	}
+
+	void rebalance() {
+		const std::lock_guard<std::mutex> lock(m_Mutex);
+		rebalanceLocked();
+	}
+
+	/**
+	 * Caches are shrunk right away if the budget decreases
+	 */
+	void setBudget(const metric_type budget) {
+		const std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Budget = budget;
+		rebalanceLocked();
+	}
+
+	metric_type budget() const {
+		const std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Budget;
+	}
+
+	/**
+	 * Maximum weight given to the cache by the last rebalance
+	 */
+	metric_type leased(const lease_id id) const {
+		const std::lock_guard<std::mutex> lock(m_Mutex);
+		const typename Leases::const_iterator itr = m_Leases.find(id);
+		return itr == m_Leases.end() ? 0 : itr->second.leased;
+	}
+
+private:
+	struct Lease {
+		std::function<cache_stats_snapshot()> stats;
+		std::function<metric_type()> weight;
+		std::function<void(metric_type)> resize;
+		metric_type minimum;
+		metric_type leased;
+		cache_stats_snapshot last; // statistics at the previous rebalance
+		double score;
+		// computed by rebalance
+		metric_type cap;
+		double target;
+	};
+	typedef std::map<lease_id, Lease> Leases;
+
+	double averageScore() const {
+		double total = 0;
+		for (const auto &pair : m_Leases)
+			total += pair.second.score;
+		return m_Leases.empty() ? 0 : total / m_Leases.size();
+	}
+
+	void rebalanceLocked() {
+		if (m_Leases.empty())
+			return;
+		double minimums = 0;
+		for (auto &pair : m_Leases) {
+			Lease &lease = pair.second;
+			const cache_stats_snapshot current = lease.stats();
+			const double hits = double(current.hits - lease.last.hits);
+			const double misses = double(current.misses - lease.last.misses);
+			const double needed = double(current.needed - lease.last.needed);
+			const bool constrained = current.full != lease.last.full || current.rejectedPuts != lease.last.rejectedPuts || current.evictions != lease.last.evictions;
+			const double missRate = hits + misses > 0 ? misses / (hits + misses) : 1;
+			const double period = (hits + misses + needed) * (1 + missRate);
+			lease.score = m_Options.smoothing * period + (1 - m_Options.smoothing) * lease.score;
+			lease.last = current;
+			const double weight = double(lease.weight());
+			lease.cap = constrained ? m_Budget : metric_type(std::min<double>(m_Budget, weight * (1 + m_Options.slack)));
+			lease.cap = std::max(lease.cap, lease.minimum);
+			lease.target = lease.minimum;
+			minimums += lease.minimum;
+		}
+		// minimums are scaled down if they do not fit
+		const double scale = minimums > m_Budget ? m_Budget / minimums : 1;
+		double remaining = m_Budget - std::min<double>(minimums, m_Budget);
+		std::vector<Lease*> open;
+		for (auto &pair : m_Leases) {
+			pair.second.target *= scale;
+			if (pair.second.cap > pair.second.target)
+				open.push_back(&pair.second);
+		}
+		// water filling : caches reaching their cap leave the rest to the others
+		while (remaining > 0 && !open.empty()) {
+			const double total = totalScore(open);
+			std::vector<Lease*> uncapped;
+			double given = 0;
+			for (Lease *lease : open) {
+				const double part = remaining * share(*lease, total, open.size());
+				const double room = lease->cap - lease->target;
+				if (part >= room) {
+					lease->target = lease->cap;
+					given += room;
+				} else {
+					uncapped.push_back(lease);
+				}
+			}
+			if (uncapped.size() == open.size()) {
+				for (Lease *lease : open)
+					lease->target += remaining * share(*lease, total, open.size());
+				remaining = 0;
+			} else {
+				remaining -= given;
+				open.swap(uncapped);
+			}
+		}
+		// nobody is short of capacity, the caches keep some more room
+		if (remaining > 0) {
+			std::vector<Lease*> all;
+			for (auto &pair : m_Leases)
+				all.push_back(&pair.second);
+			const double total = totalScore(all);
+			for (Lease *lease : all)
+				lease->target += remaining * share(*lease, total, all.size());
+		}
+		// shrinking first so that the caches never exceed the budget together
+		for (auto &pair : m_Leases)
+			if (metric_type(pair.second.target) < pair.second.leased)
+				apply(pair.second);
+		for (auto &pair : m_Leases)
+			if (metric_type(pair.second.target) != pair.second.leased)
+				apply(pair.second);
+	}
+
+	static double totalScore(const std::vector<Lease*> &leases) {
+		double total = 0;
+		for (const Lease *lease : leases)
+			total += lease->score;
+		return total;
+	}
+
+	static double share(const Lease &lease, const double total, const size_t count) {
+		return total > 0 ? lease.score / total : 1. / count;
+	}
+
+	static void apply(Lease &lease) {
+		lease.leased = metric_type(lease.target);
+		lease.resize(lease.leased);
+		// the evictions made by the governor do not count as demand
+		lease.last.evictions = lease.stats().evictions;
+	}
+
+	mutable std::mutex m_Mutex;
+	metric_type m_Budget;
+	const governor_options m_Options;
+	lease_id m_NextId;
+	Leases m_Leases;
+};
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* CACHE_GOVERNOR_HPP_ */
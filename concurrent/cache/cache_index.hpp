@@ -0,0 +1,249 @@
+/*
+ * cache_index.hpp
+ *
+ *  Which ids are cached, readable without locking the cache, e.g. to draw
+ *  the cached frames on a timeline at every refresh.
+ *
+ *  An index policy is notified when an id enters or leaves the cache. It
+ *  must provide the following member functions :
+ *  - template<typename ID> void onInsert(const ID&);
+ *  - template<typename ID> void onErase(const ID&);
+ *  Both are called with the cache lock held.
+ *
+ *  struct my_policy : public default_cache_policy {
+ *      typedef range_index<size_t> index_type;
+ *  };
+ *  // UI thread
+ *  const auto ranges = cache.index().ranges();
+ *  cache.index().drainChanges(changes);
+ */
+
+#ifndef CACHE_INDEX_HPP_
+#define CACHE_INDEX_HPP_
+
+#include <concurrent/common.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace concurrent {
+namespace cache {
+
+/**
+ * Default policy, does nothing
+ */
+struct no_cache_index {
+	template<typename ID> inline void onInsert(const ID&) {}
+	template<typename ID> inline void onErase(const ID&) {}
+};
+
+/**
+ * Ids in [first, last], inclusive so that the largest id fits
+ */
+template<typename ID>
+struct id_range {
+	ID first;
+	ID last;
+};
+
+/**
+ * Immutable snapshot of the cached ids : sorted, disjoint and non adjacent
+ * ranges.
+ */
+template<typename ID>
+struct cached_ranges {
+	typedef std::vector<id_range<ID> > container_type;
+
+	container_type ranges;
+	uint64_t version; // number of insertions and erasures so far
+
+	cached_ranges() :
+			version(0) {
+	}
+
+	bool contains(const ID &id) const {
+		const typename container_type::const_iterator itr = after(ranges.begin(), ranges.end(), id);
+		return itr != ranges.begin() && !(std::prev(itr)->last < id);
+	}
+
+	size_t count() const {
+		size_t total = 0;
+		for (const id_range<ID> &range : ranges)
+			total += size_t(range.last - range.first) + 1;
+		return total;
+	}
+
+	/**
+	 * First range starting after id
+	 */
+	template<typename ITR>
+	static ITR after(const ITR begin, const ITR end, const ID &id) {
+		return std::upper_bound(begin, end, id, [](const ID &value, const id_range<ID> &range) {
+			return value < range.first;
+		});
+	}
+};
+
+enum cache_change_type {
+	CHANGE_INSERT, CHANGE_ERASE
+};
+
+template<typename ID>
+struct cache_change {
+	ID id;
+	cache_change_type type;
+};
+
+/**
+ * Keeps the cached integral ids as ranges, e.g. frame numbers. Readers never
+ * take the cache lock : ranges() copies the ranges into a new snapshot when
+ * they changed since the previous one, so a timeline polling at its refresh
+ * rate pays one copy per refresh whatever the number of changes. Writers
+ * only update the ranges under a lock shared with that copy. Meant for ids
+ * cached mostly in contiguous runs.
+ *
+ * When FEED_CAPACITY is not 0 the changes are also queued, up to that many
+ * between two drains, so that a reader can update its view incrementally.
+ */
+template<typename ID, size_t FEED_CAPACITY = 4096>
+struct range_index: private noncopyable {
+	static_assert(std::is_integral<ID>::value, "range_index needs integral ids");
+
+	typedef cached_ranges<ID> snapshot_type;
+	typedef std::shared_ptr<const snapshot_type> snapshot_ptr;
+	typedef cache_change<ID> change_type;
+
+	range_index() :
+			m_Snapshot(std::make_shared<const snapshot_type>()), m_Version(0), m_Overflow(false) {
+	}
+
+	inline void onInsert(const ID &id) {
+		typedef typename snapshot_type::container_type::iterator Itr;
+		{
+			const std::lock_guard<std::mutex> lock(m_RangesMutex);
+			const Itr next = snapshot_type::after(m_Ranges.ranges.begin(), m_Ranges.ranges.end(), id);
+			if (next != m_Ranges.ranges.begin() && !(std::prev(next)->last < id))
+				return; // already there
+			// bounds are inclusive, neither side overflows : previous last < id < next first
+			const bool mergePrevious = next != m_Ranges.ranges.begin() && ID(std::prev(next)->last + 1) == id;
+			const bool mergeNext = next != m_Ranges.ranges.end() && next->first == ID(id + 1);
+			if (mergePrevious && mergeNext) {
+				std::prev(next)->last = next->last;
+				m_Ranges.ranges.erase(next);
+			} else if (mergePrevious) {
+				std::prev(next)->last = id;
+			} else if (mergeNext) {
+				next->first = id;
+			} else {
+				const id_range<ID> range = { id, id };
+				m_Ranges.ranges.insert(next, range);
+			}
+			changed();
+		}
+		feed(id, CHANGE_INSERT);
+	}
+
+	inline void onErase(const ID &id) {
+		typedef typename snapshot_type::container_type::iterator Itr;
+		{
+			const std::lock_guard<std::mutex> lock(m_RangesMutex);
+			const Itr next = snapshot_type::after(m_Ranges.ranges.begin(), m_Ranges.ranges.end(), id);
+			if (next == m_Ranges.ranges.begin() || std::prev(next)->last < id)
+				return;
+			// first <= id <= last, neither side overflows
+			const Itr range = std::prev(next);
+			if (range->first == id && range->last == id) {
+				m_Ranges.ranges.erase(range);
+			} else if (range->first == id) {
+				range->first = ID(id + 1);
+			} else if (range->last == id) {
+				range->last = ID(id - 1);
+			} else {
+				const id_range<ID> tail = { ID(id + 1), range->last };
+				range->last = ID(id - 1);
+				m_Ranges.ranges.insert(next, tail);
+			}
+			changed();
+		}
+		feed(id, CHANGE_ERASE);
+	}
+
+	/**
+	 * Does not lock the cache, the snapshot stays valid as long as it is
+	 * held. Lock free unless the ranges changed since the previous snapshot,
+	 * which is then copied.
+	 */
+	snapshot_ptr ranges() const {
+		snapshot_ptr snapshot = std::atomic_load(&m_Snapshot);
+		if (snapshot->version == version())
+			return snapshot;
+		const std::lock_guard<std::mutex> lock(m_RangesMutex);
+		snapshot = m_Snapshot; // possibly copied by another reader meanwhile
+		if (snapshot->version != m_Ranges.version) {
+			snapshot = std::make_shared<const snapshot_type>(m_Ranges);
+			std::atomic_store(&m_Snapshot, snapshot);
+		}
+		return snapshot;
+	}
+
+	/**
+	 * Cheap check whether ranges() changed since a snapshot
+	 */
+	uint64_t version() const {
+		return m_Version.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * Appends the changes since the previous drain to changes. Returns false
+	 * if some were dropped because the feed was full : the reader must then
+	 * start again from ranges().
+	 */
+	bool drainChanges(std::vector<change_type> &changes) {
+		std::vector<change_type> drained;
+		bool overflow;
+		{
+			const std::lock_guard<std::mutex> lock(m_FeedMutex);
+			drained.swap(m_Feed);
+			overflow = m_Overflow;
+			m_Overflow = false;
+		}
+		changes.insert(changes.end(), drained.begin(), drained.end());
+		return !overflow;
+	}
+
+private:
+	inline void changed() {
+		++m_Ranges.version;
+		m_Version.store(m_Ranges.version, std::memory_order_release);
+	}
+
+	void feed(const ID &id, const cache_change_type type) {
+		if (FEED_CAPACITY == 0)
+			return;
+		const std::lock_guard<std::mutex> lock(m_FeedMutex);
+		if (m_Feed.size() < FEED_CAPACITY) {
+			const change_type change = { id, type };
+			m_Feed.push_back(change);
+		} else {
+			m_Overflow = true;
+		}
+	}
+
+	snapshot_type m_Ranges; // master copy
+	mutable std::mutex m_RangesMutex; // writers and the copy of m_Ranges
+	mutable snapshot_ptr m_Snapshot; // last copy
+	std::atomic<uint64_t> m_Version;
+	std::mutex m_FeedMutex; // only held to append or swap, never across a copy
+	std::vector<change_type> m_Feed;
+	bool m_Overflow;
+};
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* CACHE_INDEX_HPP_ */
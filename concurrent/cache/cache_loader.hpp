@@ -0,0 +1,380 @@
+/*
+ * cache_loader.hpp
+ *
+ *  Reads the files of the ids popped from a lookahead_cache and hands the
+ *  buffers to decode workers through a bounded queue.
+ *
+ *  The reads go through io_uring when available : one thread submits and
+ *  one thread reaps, with up to 'depth' reads in flight. Otherwise a pool of
+ *  'threads' threads does blocking reads.
+ *
+ *  concurrent::bounded_queue<loaded_frame<id_type> > loaded(16);
+ *  cache_loader<CACHE> loader(cache, loaded, [](const id_type &id) { return path(id); });
+ *  loader.start();
+ *  // decode workers pop from 'loaded' and push to the cache
+ */
+
+#ifndef CACHE_LOADER_HPP_
+#define CACHE_LOADER_HPP_
+
+#include <concurrent/bounded_queue.h>
+#include <concurrent/details/io_uring.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace concurrent {
+namespace cache {
+
+template<typename ID_TYPE>
+struct loaded_frame {
+	typedef std::vector<char> buffer_type;
+
+	ID_TYPE id;
+	std::shared_ptr<buffer_type> data;
+	int error; // errno of the failed open or read, 0 on success
+
+	loaded_frame() :
+			id(), error(0) {
+	}
+};
+
+struct loader_options {
+	size_t depth; // reads in flight with io_uring
+	size_t threads; // blocking readers without io_uring
+	bool ioUring; // false forces the thread pool
+
+	loader_options() :
+			depth(32), threads(4), ioUring(true) {
+	}
+};
+
+/**
+ * Terminating the loader terminates the cache and the output queue, call
+ * terminate(false) on both before reusing them.
+ */
+template<typename CACHE>
+struct cache_loader: private noncopyable {
+	typedef typename CACHE::id_type id_type;
+	typedef loaded_frame<id_type> frame_type;
+	typedef bounded_queue<frame_type> queue_type;
+	typedef std::function<std::string(const id_type&)> path_function;
+
+	cache_loader(CACHE &cache, queue_type &output, const path_function &path, const loader_options &options = loader_options()) :
+			m_Cache(cache), m_Output(output), m_Path(path), m_Options(options), m_Started(false) {
+	}
+
+	~cache_loader() {
+		terminate();
+	}
+
+	/**
+	 * Returns false if io_uring is not available and the thread pool is used
+	 */
+	bool start() {
+		if (m_Started.exchange(true))
+			return usesIoUring();
+#ifdef CONCURRENT_IO_URING
+		if (m_Options.ioUring) {
+			try {
+				m_Uring.reset(new uring_reader(*this));
+				return true;
+			} catch (const std::system_error&) {
+				// not supported by this kernel, falling back
+			}
+		}
+#endif
+		for (size_t i = 0; i < m_Options.threads; ++i)
+			m_Threads.emplace_back(&cache_loader::readBlocking, this);
+		return false;
+	}
+
+	void terminate() {
+		if (!m_Started.exchange(false))
+			return;
+		m_Cache.terminate();
+		m_Output.terminate();
+#ifdef CONCURRENT_IO_URING
+		m_Uring.reset();
+#endif
+		for (std::thread &thread : m_Threads)
+			thread.join();
+		m_Threads.clear();
+	}
+
+	bool usesIoUring() const {
+#ifdef CONCURRENT_IO_URING
+		return m_Uring.get() != nullptr;
+#else
+		return false;
+#endif
+	}
+
+private:
+	/**
+	 * Opens the file of frame.id and allocates its buffer, returns the file
+	 * descriptor or -1 with frame.error set.
+	 */
+	int open(frame_type &frame) const {
+		const int fd = ::open(m_Path(frame.id).c_str(), O_RDONLY | O_CLOEXEC);
+		struct stat status;
+		if (fd < 0 || fstat(fd, &status) < 0) {
+			frame.error = errno;
+			if (fd >= 0)
+				::close(fd);
+			return -1;
+		}
+		frame.data = std::make_shared<typename frame_type::buffer_type>(size_t(status.st_size));
+		return fd;
+	}
+
+	void readBlocking() {
+		try {
+			for (;;) {
+				frame_type frame;
+				m_Cache.pop(frame.id);
+				const int fd = open(frame);
+				for (size_t offset = 0; fd >= 0 && offset < frame.data->size();) {
+					const ssize_t count = pread(fd, frame.data->data() + offset, frame.data->size() - offset, offset);
+					if (count < 0 && errno == EINTR)
+						continue;
+					if (count < 0)
+						frame.error = errno;
+					if (count <= 0) {
+						frame.data->resize(offset); // truncated meanwhile
+						break;
+					}
+					offset += count;
+				}
+				if (fd >= 0)
+					::close(fd);
+				m_Output.push(frame);
+			}
+		} catch (concurrent::terminated &) {
+		}
+	}
+
+#ifdef CONCURRENT_IO_URING
+	/**
+	 * The submitting thread pops a free request then an id, plus the free
+	 * requests and ids already available, and submits their reads at once.
+	 * The reaping thread pushes a frame once its read completes and frees
+	 * the request. Short reads are resubmitted.
+	 */
+	struct uring_reader: private noncopyable {
+		explicit uring_reader(cache_loader &loader) :
+				m_Loader(loader), m_Ring(unsigned(2 * loader.m_Options.depth + 1)), m_Requests(loader.m_Options.depth), m_Free(loader.m_Options.depth), m_InFlight(0), m_Stopping(false) {
+			for (size_t i = 0; i < m_Requests.size(); ++i)
+				m_Free.push(i);
+			m_Submitter = std::thread(&uring_reader::submit, this);
+			m_Reaper = std::thread(&uring_reader::reap, this);
+		}
+
+		~uring_reader() {
+			m_Free.terminate();
+			m_Submitter.join();
+			// the reaper only stops on this no-op, failures are transient
+			for (bool stopping = false; !stopping;) {
+				try {
+					const std::lock_guard<details::mutex_type> lock(m_SubmitMutex);
+					if (m_Ring.prepareNop(STOP)) {
+						m_Ring.submit();
+						stopping = true;
+					}
+				} catch (const std::system_error&) {
+				}
+				if (!stopping)
+					std::this_thread::yield();
+			}
+			m_Reaper.join();
+		}
+
+	private:
+		enum : uint64_t {
+			STOP = uint64_t(-1)
+		};
+
+		enum : size_t {
+			MAX_READ = size_t(1) << 30 // per request, the result of a read is an int
+		};
+
+		struct request {
+			frame_type frame;
+			int fd;
+			size_t offset;
+			iovec vector; // read by the kernel until the read completes
+		};
+
+		void submit() {
+			std::vector<size_t> batch;
+			batch.reserve(m_Requests.size());
+			size_t index = 0;
+			bool reserved = false; // index was popped for an id which was not available
+			try {
+				for (;;) {
+					if (!reserved)
+						m_Free.pop(index);
+					reserved = false;
+					id_type id;
+					m_Loader.m_Cache.pop(id);
+					batch.clear();
+					for (;;) {
+						open(index, id, batch);
+						// the termination is seen by the blocking pops
+						if (m_Free.tryPop(index, std::nothrow) != pop_status::OK)
+							break;
+						reserved = true;
+						if (m_Loader.m_Cache.tryPop(id, std::nothrow) != pop_status::OK)
+							break;
+						reserved = false;
+					}
+					read(batch.data(), batch.size());
+				}
+			} catch (concurrent::terminated &) {
+			}
+		}
+
+		/**
+		 * Opens the file of id in the request, adds the request to batch
+		 * unless there is nothing to read
+		 */
+		void open(const size_t index, const id_type &id, std::vector<size_t> &batch) {
+			request &current = m_Requests[index];
+			current.frame = frame_type();
+			current.frame.id = id;
+			current.fd = m_Loader.open(current.frame);
+			current.offset = 0;
+			if (current.fd < 0 || current.frame.data->empty())
+				complete(index);
+			else
+				batch.push_back(index);
+		}
+
+		/**
+		 * Submits the reads of the rest of the frames, at most MAX_READ bytes
+		 * each, with one io_uring_enter unless the kernel takes them in
+		 * several steps. The frames whose read cannot be submitted complete
+		 * with the error.
+		 */
+		void read(const size_t *indices, const size_t count) {
+			size_t submitted = 0;
+			int error = 0;
+			{
+				const std::lock_guard<details::mutex_type> lock(m_SubmitMutex);
+				while (submitted < count && !error) {
+					size_t prepared = submitted;
+					for (; prepared < count; ++prepared) {
+						request &current = m_Requests[indices[prepared]];
+						current.vector.iov_base = current.frame.data->data() + current.offset;
+						current.vector.iov_len = std::min<size_t>(current.frame.data->size() - current.offset, MAX_READ);
+						if (!m_Ring.prepareRead(current.fd, &current.vector, current.offset, indices[prepared]))
+							break;
+					}
+					if (prepared == submitted) {
+						error = EBUSY;
+						break;
+					}
+					// orders the requests before their completions, also for the tools not seeing through the kernel
+					m_InFlight += prepared - submitted;
+					try {
+						const size_t taken = m_Ring.submit();
+						m_InFlight -= prepared - submitted - taken; // dropped by the ring, prepared again
+						submitted += taken;
+					} catch (const std::system_error &e) {
+						m_InFlight -= prepared - submitted;
+						error = e.code().value();
+					}
+				}
+			}
+			for (size_t i = submitted; i < count; ++i) {
+				m_Requests[indices[i]].frame.error = error;
+				complete(indices[i]);
+			}
+		}
+
+		void reap() {
+			// in flight reads write into the requests, they must all complete
+			while (!m_Stopping || m_InFlight) {
+				try {
+					reapOnce();
+				} catch (const std::system_error&) {
+					// io_uring_enter failed to wait, trying again
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		void reapOnce() {
+			m_Ring.reap([this](uint64_t index, int result) {
+				if (index == STOP) {
+					m_Stopping = true;
+					return;
+				}
+				--m_InFlight;
+				request &current = m_Requests[index];
+				if (result < 0)
+					current.frame.error = -result;
+				else
+					current.offset += result;
+				if (result > 0 && current.offset < current.frame.data->size()) {
+					const size_t resubmitted = size_t(index);
+					read(&resubmitted, 1);
+				} else {
+					complete(index);
+				}
+			});
+		}
+
+		/**
+		 * Pushes the frame and frees the request
+		 */
+		void complete(const size_t index) {
+			request &current = m_Requests[index];
+			if (current.fd >= 0) {
+				::close(current.fd);
+				current.frame.data->resize(current.offset); // truncated meanwhile
+			}
+			try {
+				m_Loader.m_Output.push(current.frame);
+				m_Free.push(index);
+			} catch (concurrent::terminated &) {
+			}
+		}
+
+		cache_loader &m_Loader;
+		details::io_ring m_Ring;
+		details::mutex_type m_SubmitMutex; // the submitter and the reaper resubmitting short reads
+		std::vector<request> m_Requests;
+		bounded_queue<size_t> m_Free; // requests not in use
+		std::atomic<size_t> m_InFlight;
+		bool m_Stopping; // reaper's
+		std::thread m_Submitter;
+		std::thread m_Reaper;
+	};
+
+	std::unique_ptr<uring_reader> m_Uring;
+#endif
+
+	CACHE &m_Cache;
+	queue_type &m_Output;
+	const path_function m_Path;
+	const loader_options m_Options;
+	std::atomic<bool> m_Started;
+	std::vector<std::thread> m_Threads;
+};
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* CACHE_LOADER_HPP_ */
@@ -0,0 +1,62 @@
+/*
+ * cache_pipeline.hpp
+ *
+ *  Plugs a lookahead_cache into a concurrent::pipeline : the cache is the
+ *  source of the ids to work on and the sink of the results.
+ *
+ *  concurrent::pipeline p;
+ *  auto ids = pop_from(p, cache);
+ *  auto loaded = p.stage<Buffer>("load", ids, 2, load);
+ *  auto decoded = p.stage<cache_result<CACHE> >("decode", loaded, 4, decode);
+ *  push_to(p, decoded, cache);
+ *  p.start();
+ */
+
+#ifndef CACHE_PIPELINE_HPP_
+#define CACHE_PIPELINE_HPP_
+
+#include <concurrent/pipeline.hpp>
+
+namespace concurrent {
+namespace cache {
+
+/**
+ * What a pipeline pushes back into the cache
+ */
+template<typename CACHE>
+struct cache_result {
+	typename CACHE::id_type id;
+	typename CACHE::metric_type weight;
+	typename CACHE::data_type data;
+	typename CACHE::metric_type cost;
+
+	cache_result() :
+			id(), weight(), data(), cost() {
+	}
+};
+
+/**
+ * Pops the ids from the cache. Terminating the pipeline terminates the cache,
+ * call cache.terminate(false) before reusing it.
+ */
+template<typename CACHE>
+pipeline::port<typename CACHE::id_type> pop_from(pipeline &p, CACHE &cache, size_t threads = 1, const std::string &name = "cache_pop") {
+	p.onTerminate([&cache]() {
+		cache.terminate();
+	});
+	return p.source<typename CACHE::id_type>(name, threads, [&cache](typename CACHE::id_type &id) {
+		cache.pop(id);
+	});
+}
+
+template<typename CACHE>
+void push_to(pipeline &p, const pipeline::port<cache_result<CACHE> > &input, CACHE &cache, size_t threads = 1, const std::string &name = "cache_push") {
+	p.sink(name, input, threads, [&cache](const cache_result<CACHE> &result) {
+		cache.push(result.id, result.weight, result.data, result.cost);
+	});
+}
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* CACHE_PIPELINE_HPP_ */
@@ -0,0 +1,41 @@
+/*
+ * cache_policy.hpp
+ *
+ *  Compile time customization of the caches.
+ */
+
+#ifndef CACHE_POLICY_HPP_
+#define CACHE_POLICY_HPP_
+
+#include "compression.hpp"
+#include "cache_index.hpp"
+#include "cache_stats.hpp"
+#include "tracer.hpp"
+
+#include <concurrent/flat_combining.hpp>
+
+namespace concurrent {
+namespace cache {
+
+/**
+ * Default behavior of the caches.
+ *
+ * To customize a cache, inherit from this struct and shadow the typedefs you
+ * want to change, then pass it as the last template argument of the cache.
+ *
+ * struct my_policy : public default_cache_policy {
+ *     typedef cache_stats stats_type;
+ * };
+ */
+struct default_cache_policy {
+	typedef no_compression compression_type;
+	typedef no_cache_stats stats_type;
+	typedef no_tracer tracer_type;
+	typedef no_cache_index index_type;
+	typedef no_combining combining_type; // lookahead_cache push and update
+};
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* CACHE_POLICY_HPP_ */
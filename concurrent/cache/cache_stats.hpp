@@ -0,0 +1,110 @@
+/*
+ * cache_stats.hpp
+ *
+ *  Statistics policies for the caches.
+ */
+
+#ifndef CACHE_STATS_HPP_
+#define CACHE_STATS_HPP_
+
+#include <concurrent/stats.hpp>
+
+namespace concurrent {
+namespace cache {
+
+struct cache_stats_snapshot {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t full; // update returned FULL
+	uint64_t needed; // update returned NEEDED
+	uint64_t notNeeded; // update returned NOT_NEEDED
+	uint64_t puts; // accepted puts
+	uint64_t rejectedPuts;
+	uint64_t evictions;
+	histogram_snapshot lockWait; // ns to acquire the cache mutex
+
+	cache_stats_snapshot() :
+			hits(0), misses(0), full(0), needed(0), notNeeded(0), puts(0), rejectedPuts(0), evictions(0) {
+	}
+
+	inline double hitRate() const {
+		return hits + misses ? double(hits) / (hits + misses) : 0;
+	}
+};
+
+/**
+ * Default cache statistics, everything is optimized away
+ */
+struct no_cache_stats {
+	typedef null_stopwatch stopwatch_type;
+	static const bool enabled = false;
+
+	inline void onGet(bool) {}
+	inline void onUpdate(int) {}
+	inline void onPut(bool) {}
+	inline void onEvict() {}
+	inline void onLockWait(uint64_t) {}
+
+	cache_stats_snapshot snapshot() const {
+		return cache_stats_snapshot();
+	}
+};
+
+struct cache_stats {
+	typedef stopwatch stopwatch_type;
+	static const bool enabled = true;
+
+	cache_stats() :
+			m_Hits(0), m_Misses(0), m_Full(0), m_Needed(0), m_NotNeeded(0), m_Puts(0), m_RejectedPuts(0), m_Evictions(0) {
+	}
+
+	inline void onGet(bool hit) {
+		(hit ? m_Hits : m_Misses).fetch_add(1, std::memory_order_relaxed);
+	}
+	/**
+	 * status is an UpdateStatus
+	 */
+	inline void onUpdate(int status) {
+		std::atomic<uint64_t> * const counters[] = { &m_Full, &m_Needed, &m_NotNeeded };
+		counters[status]->fetch_add(1, std::memory_order_relaxed);
+	}
+	inline void onPut(bool accepted) {
+		(accepted ? m_Puts : m_RejectedPuts).fetch_add(1, std::memory_order_relaxed);
+	}
+	inline void onEvict() {
+		m_Evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+	inline void onLockWait(uint64_t ns) {
+		m_LockWait.record(ns);
+	}
+
+	cache_stats_snapshot snapshot() const {
+		cache_stats_snapshot result;
+		result.hits = m_Hits.load(std::memory_order_relaxed);
+		result.misses = m_Misses.load(std::memory_order_relaxed);
+		result.full = m_Full.load(std::memory_order_relaxed);
+		result.needed = m_Needed.load(std::memory_order_relaxed);
+		result.notNeeded = m_NotNeeded.load(std::memory_order_relaxed);
+		result.puts = m_Puts.load(std::memory_order_relaxed);
+		result.rejectedPuts = m_RejectedPuts.load(std::memory_order_relaxed);
+		result.evictions = m_Evictions.load(std::memory_order_relaxed);
+		result.lockWait = m_LockWait.snapshot();
+		return result;
+	}
+
+private:
+	std::atomic<uint64_t> m_Hits;
+	std::atomic<uint64_t> m_Misses;
+	std::atomic<uint64_t> m_Full;
+	std::atomic<uint64_t> m_Needed;
+	std::atomic<uint64_t> m_NotNeeded;
+	std::atomic<uint64_t> m_Puts;
+	std::atomic<uint64_t> m_RejectedPuts;
+	std::atomic<uint64_t> m_Evictions;
+	histogram m_LockWait;
+};
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* CACHE_STATS_HPP_ */
@@ -0,0 +1,210 @@
+/*
+ * compression.hpp
+ *
+ *  Compression policies for the caches.
+ *
+ *  A compression policy is used by priority_cache_details to shrink entries
+ *  that are far from the playhead. It must provide :
+ *  - static const bool enabled;
+ *  - template<typename DATA, typename METRIC>
+ *    static bool compress(const DATA &raw, DATA &compressed, METRIC &weight);
+ *    returns false if the data could not be compressed, updates weight otherwise
+ *  - template<typename DATA>
+ *    static void decompress(const DATA &compressed, DATA &raw);
+ */
+
+#ifndef COMPRESSION_HPP_
+#define COMPRESSION_HPP_
+
+#include <concurrent/common.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+namespace concurrent {
+namespace cache {
+
+/**
+ * Default policy, entries are kept as is.
+ */
+struct no_compression {
+	static const bool enabled = false;
+
+	template<typename DATA, typename METRIC>
+	static bool compress(const DATA &, DATA &, METRIC &) {
+		return false;
+	}
+
+	template<typename DATA>
+	static void decompress(const DATA &compressed, DATA &raw) {
+		raw = compressed;
+	}
+};
+
+namespace details {
+
+inline void write32(std::vector<uint8_t> &out, uint32_t value) {
+	for (int i = 0; i < 4; ++i)
+		out.push_back(uint8_t(value >> (8 * i)));
+}
+
+inline uint32_t read32(const uint8_t *in) {
+	return uint32_t(in[0]) | uint32_t(in[1]) << 8 | uint32_t(in[2]) << 16 | uint32_t(in[3]) << 24;
+}
+
+/**
+ * Run length encoding of a single chunk.
+ * control byte c < 128  : c+1 literal bytes follow
+ * control byte c >= 128 : next byte is repeated c-125 times (3 to 130)
+ */
+inline void rle_encode(const uint8_t *in, size_t size, std::vector<uint8_t> &out) {
+	size_t i = 0;
+	size_t literalStart = 0;
+	const auto flushLiterals = [&](size_t end) {
+		while (literalStart < end) {
+			const size_t count = std::min<size_t>(end - literalStart, 128);
+			out.push_back(uint8_t(count - 1));
+			out.insert(out.end(), in + literalStart, in + literalStart + count);
+			literalStart += count;
+		}
+	};
+	while (i < size) {
+		size_t run = 1;
+		while (i + run < size && run < 130 && in[i + run] == in[i])
+			++run;
+		if (run >= 3) {
+			flushLiterals(i);
+			out.push_back(uint8_t(run + 125));
+			out.push_back(in[i]);
+			i += run;
+			literalStart = i;
+		} else {
+			i += run;
+		}
+	}
+	flushLiterals(size);
+}
+
+/**
+ * Returns false if the stream is corrupted
+ */
+inline bool rle_decode(const uint8_t *in, size_t size, uint8_t *out, size_t outSize) {
+	const uint8_t * const end = in + size;
+	uint8_t * const outEnd = out + outSize;
+	while (in < end) {
+		const uint8_t control = *in++;
+		if (control < 128) {
+			const size_t count = control + 1;
+			if (in + count > end || out + count > outEnd)
+				return false;
+			out = std::copy(in, in + count, out);
+			in += count;
+		} else {
+			const size_t count = control - 125;
+			if (in == end || out + count > outEnd)
+				return false;
+			out = std::fill_n(out, count, *in++);
+		}
+	}
+	return out == outEnd;
+}
+
+} // namespace details
+
+/**
+ * Byte oriented run length compression, well suited for mattes and alpha
+ * channels. DATA must be a contiguous container of bytes (std::vector<uint8_t>,
+ * std::string...).
+ *
+ * The stream is split in chunks of CHUNK_SIZE bytes which are encoded
+ * independently. Decompression runs on the calling thread, outside of the
+ * cache lock : frames are decompressed in parallel by the threads getting
+ * them.
+ *
+ * Layout : [raw size][chunk count]([raw chunk size][encoded chunk size])* encoded chunks
+ * Sizes are 32 bits, larger entries are kept uncompressed.
+ */
+template<size_t CHUNK_SIZE = 256 * 1024>
+struct rle_compression {
+	static_assert(CHUNK_SIZE > 0, "CHUNK_SIZE must be positive");
+	// an encoded chunk is at most 129/128 of the chunk
+	static_assert(CHUNK_SIZE <= (size_t(1) << 31), "CHUNK_SIZE must fit the 32 bits sizes");
+
+	static const bool enabled = true;
+
+	template<typename DATA, typename METRIC>
+	static bool compress(const DATA &raw, DATA &compressed, METRIC &weight) {
+		const size_t rawSize = raw.size();
+		if (rawSize == 0 || uint64_t(rawSize) > UINT32_MAX)
+			return false;
+		const uint8_t *pRaw = reinterpret_cast<const uint8_t*>(&raw[0]);
+		const size_t chunks = (rawSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		std::vector<uint8_t> header;
+		std::vector<uint8_t> payload;
+		header.reserve(8 + chunks * 8);
+		details::write32(header, uint32_t(rawSize));
+		details::write32(header, uint32_t(chunks));
+		for (size_t offset = 0; offset < rawSize; offset += CHUNK_SIZE) {
+			const size_t chunkSize = std::min(CHUNK_SIZE, rawSize - offset);
+			const size_t before = payload.size();
+			details::rle_encode(pRaw + offset, chunkSize, payload);
+			details::write32(header, uint32_t(chunkSize));
+			details::write32(header, uint32_t(payload.size() - before));
+			if (header.size() + payload.size() >= rawSize)
+				return false; // not worth it
+		}
+		const size_t compressedSize = header.size() + payload.size();
+		compressed.resize(compressedSize);
+		uint8_t *pCompressed = reinterpret_cast<uint8_t*>(&compressed[0]);
+		std::copy(payload.begin(), payload.end(), std::copy(header.begin(), header.end(), pCompressed));
+		const METRIC scaled = METRIC(double(weight) * compressedSize / rawSize);
+		weight = std::max<METRIC>(scaled, 1);
+		return true;
+	}
+
+	template<typename DATA>
+	static void decompress(const DATA &compressed, DATA &raw) {
+		if (compressed.size() < 8)
+			CONCURRENT_THROW(std::runtime_error("corrupted rle stream"));
+		const uint8_t *pCompressed = reinterpret_cast<const uint8_t*>(&compressed[0]);
+		const size_t rawSize = details::read32(pCompressed);
+		const size_t chunks = details::read32(pCompressed + 4);
+		const uint8_t *pPayload = pCompressed + 8 + chunks * 8;
+		if (pPayload > pCompressed + compressed.size())
+			CONCURRENT_THROW(std::runtime_error("corrupted rle stream"));
+		raw.resize(rawSize);
+		if (rawSize == 0)
+			return;
+		uint8_t *pRaw = reinterpret_cast<uint8_t*>(&raw[0]);
+
+		struct Chunk {
+			const uint8_t *in;
+			size_t inSize;
+			uint8_t *out;
+			size_t outSize;
+		};
+		std::vector<Chunk> work;
+		work.reserve(chunks);
+		const uint8_t *pHeader = pCompressed + 8;
+		for (size_t i = 0; i < chunks; ++i, pHeader += 8) {
+			const Chunk chunk = { pPayload, details::read32(pHeader + 4), pRaw, details::read32(pHeader) };
+			pPayload += chunk.inSize;
+			pRaw += chunk.outSize;
+			work.push_back(chunk);
+		}
+		if (pPayload != pCompressed + compressed.size() || pRaw != reinterpret_cast<uint8_t*>(&raw[0]) + rawSize)
+			CONCURRENT_THROW(std::runtime_error("corrupted rle stream"));
+
+		for (const Chunk &chunk : work)
+			if (!details::rle_decode(chunk.in, chunk.inSize, chunk.out, chunk.outSize))
+				CONCURRENT_THROW(std::runtime_error("corrupted rle stream"));
+	}
+};
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* COMPRESSION_HPP_ */
@@ -0,0 +1,159 @@
+/*
+ * leveled_id.hpp
+ *
+ *  Ids of frames cached at several resolutions, e.g. full resolution and
+ *  proxies. Level 0 is the full resolution, higher levels are coarser.
+ *
+ *  getBest serves the finest level of a frame currently cached, so that a
+ *  scrubbing display shows a proxy at once while the full resolution is
+ *  still loading. leveled_range turns a range of frames into a job
+ *  requesting the cheap levels ahead of the expensive ones.
+ *
+ *  typedef leveled_id<size_t> id_type;
+ *  cache.process(leveled_range<Job>(Job(playhead, 100), {2, 0}, 8));
+ *  id_type found;
+ *  if (cache.getBest(id_type(frame), found, data))
+ *      draw(data, found.level);
+ */
+
+#ifndef LEVELED_ID_HPP_
+#define LEVELED_ID_HPP_
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace concurrent {
+namespace cache {
+
+/**
+ * Ordered by frame then level : the levels of a frame are contiguous in the
+ * cache, finest first.
+ */
+template<typename FRAME = size_t, typename LEVEL = unsigned>
+struct leveled_id {
+	typedef FRAME frame_type;
+	typedef LEVEL level_type;
+
+	FRAME frame;
+	LEVEL level;
+
+	leveled_id() :
+			frame(), level() {
+	}
+	explicit leveled_id(const FRAME &frame, const LEVEL level = LEVEL()) :
+			frame(frame), level(level) {
+	}
+
+	bool operator<(const leveled_id &other) const {
+		return frame < other.frame || (!(other.frame < frame) && level < other.level);
+	}
+	bool operator==(const leveled_id &other) const {
+		return frame == other.frame && level == other.level;
+	}
+	bool operator!=(const leveled_id &other) const {
+		return !(*this == other);
+	}
+};
+
+/**
+ * Bounds of the ids getBest looks for : every level of the frame
+ */
+template<typename FRAME, typename LEVEL>
+inline void level_bounds(const leveled_id<FRAME, LEVEL> &id, leveled_id<FRAME, LEVEL> &first, leveled_id<FRAME, LEVEL> &last) {
+	first = leveled_id<FRAME, LEVEL>(id.frame, std::numeric_limits<LEVEL>::min());
+	last = leveled_id<FRAME, LEVEL>(id.frame, std::numeric_limits<LEVEL>::max());
+}
+
+template<typename FRAME, typename LEVEL>
+inline uint64_t trace_key(const leveled_id<FRAME, LEVEL> &id) {
+	return (uint64_t(id.frame) << 8) | (uint64_t(id.level) & 0xFF);
+}
+
+/**
+ * Job adaptor requesting every frame of FRAME_RANGE at several levels.
+ * Levels are given from the cheapest to the most expensive and each one
+ * runs 'lead' frames ahead of the next : with levels {2, 0} and a lead of 0
+ * the ids are (f0, 2) (f0, 0) (f1, 2) (f1, 0)... with a lead of 2 they are
+ * (f0, 2) (f1, 2) (f2, 2) (f0, 0) (f3, 2) (f1, 0)...
+ *
+ * Earlier requests have a higher priority, so the proxies also outlive the
+ * full resolution frames when the cache runs out of room.
+ */
+template<typename FRAME_RANGE, typename LEVEL = unsigned>
+struct leveled_range {
+	typedef typename std::decay<decltype(std::declval<FRAME_RANGE&>().next())>::type frame_type;
+	typedef leveled_id<frame_type, LEVEL> id_type;
+
+	leveled_range() :
+			m_Lead(0), m_Step(0), m_Level(0), m_First(0), m_Done(true) {
+	}
+
+	leveled_range(const FRAME_RANGE &frames, const std::vector<LEVEL> &levels, const size_t lead = 0) :
+			m_Frames(frames), m_Levels(levels), m_Lead(lead), m_Step(0), m_Level(0), m_First(0), m_Done(levels.empty()) {
+		seek();
+	}
+
+	bool empty() const {
+		return m_Done;
+	}
+
+	id_type next() {
+		const size_t index = m_Step - m_Lead * m_Level;
+		const id_type id(m_Window[index - m_First], m_Levels[m_Level]);
+		if (m_Level + 1 == m_Levels.size()) {
+			// every other level is past this frame
+			m_Window.pop_front();
+			++m_First;
+		}
+		++m_Level;
+		seek();
+		return id;
+	}
+
+	void clear() {
+		m_Done = true;
+		m_Window.clear();
+	}
+
+private:
+	/**
+	 * Moves to the next step and level with a frame, fetching the frames
+	 * the cheapest level reaches
+	 */
+	void seek() {
+		for (; !m_Done; ++m_Level) {
+			if (m_Level == m_Levels.size()) {
+				m_Level = 0;
+				++m_Step;
+			}
+			const size_t offset = m_Lead * m_Level;
+			if (m_Step < offset)
+				continue;
+			const size_t index = m_Step - offset;
+			while (m_First + m_Window.size() <= index && !m_Frames.empty())
+				m_Window.push_back(m_Frames.next());
+			if (index < m_First + m_Window.size())
+				return;
+			// the most expensive level is the last one to run out of frames
+			m_Done = m_Level + 1 == m_Levels.size();
+		}
+	}
+
+	FRAME_RANGE m_Frames;
+	std::vector<LEVEL> m_Levels;
+	size_t m_Lead;
+	size_t m_Step; // the cheapest level is at frame m_Step
+	size_t m_Level; // index in m_Levels of the next id
+	size_t m_First; // index of m_Window's first frame
+	std::deque<frame_type> m_Window; // frames between the most expensive and the cheapest level
+	bool m_Done;
+};
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* LEVELED_ID_HPP_ */
@@ -10,11 +10,19 @@
 
 #include "priority_cache_details.hpp"
 
-#include <concurrent/slot.hpp>
+#include <concurrent/wait_strategy.hpp>
+#include <concurrent/details/atomic_wait.hpp>
+#include <concurrent/details/mutex.hpp>
 
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <new>
 #include <set>
+#include <vector>
 #include <cassert>
 
 namespace concurrent {
@@ -30,99 +38,475 @@ namespace cache {
  * - add an iterator to process whenever you want
  *
  * Cache will ensure every thread will stop by firing a 'terminated' exception
- * upon 'pop' when terminate is set to true
+ * upon 'pop' when terminate is set to true, or by returning
+ * pop_status::TERMINATED from the std::nothrow and timed pops
  */
-template<typename ID_TYPE, typename METRIC_TYPE, typename DATA_TYPE, typename WORK_UNIT_RANGE>
+template<typename ID_TYPE, typename METRIC_TYPE, typename DATA_TYPE, typename WORK_UNIT_RANGE, typename POLICY = default_cache_policy>
 struct lookahead_cache {
     typedef ID_TYPE id_type;
     typedef METRIC_TYPE metric_type;
     typedef DATA_TYPE data_type;
     typedef WORK_UNIT_RANGE WorkUnitItr;
+    typedef priority_cache_details<id_type, metric_type, data_type, POLICY> cache_type;
+    typedef typename cache_type::compression_type compression_type;
+    typedef typename cache_type::stats_type stats_type;
+    typedef typename POLICY::combining_type combining_type;
+    typedef concurrent::details::mutex_type mutex_type;
 
 #if __cplusplus >= 201103L
     static_assert(std::is_default_constructible<WORK_UNIT_RANGE>::value, "WorkUnitItr should be default constructible");
 #endif
 
     lookahead_cache(const metric_type cache_limit) :
-        m_SharedCache(cache_limit) {
+        m_SharedCache(cache_limit), m_InstalledGeneration(0), m_WorkerTerminated(false), m_JobPending(false), m_Terminated(false), m_JobGeneration(0), m_AsyncWaiters(0) {
+        concurrent::details::name_lock(m_WorkerMutex, "lookahead_cache::m_WorkerMutex");
+        concurrent::details::name_lock(m_CacheMutex, "lookahead_cache::m_CacheMutex");
     }
 
     // Cache functions
     inline bool get(const id_type &id, data_type &data) const {
-        std::lock_guard<std::mutex> lock(m_CacheMutex);
-        return m_SharedCache.get(id, data);
+        bool compressed = false;
+        {
+            const std::unique_lock<mutex_type> lock(lockCache());
+            if (!m_SharedCache.getStored(id, data, compressed))
+                return false;
+        }
+        // decompressing outside of the critical section
+        if (compressed) {
+            const data_type stored(data);
+            compression_type::decompress(stored, data);
+        }
+        return true;
+    }
+
+    /**
+     * Gets the finest cached level of id's frame with leveled ids, see
+     * leveled_id.hpp. found is set to the id served.
+     */
+    inline bool getBest(const id_type &id, id_type &found, data_type &data) const {
+        bool compressed = false;
+        {
+            const std::unique_lock<mutex_type> lock(lockCache());
+            if (!m_SharedCache.getStoredBest(id, found, data, compressed))
+                return false;
+        }
+        if (compressed) {
+            const data_type stored(data);
+            compression_type::decompress(stored, data);
+        }
+        return true;
+    }
+
+    /**
+     * Gets without blocking the thread : returns true if id is cached,
+     * otherwise 'ready' is called with the data once id is pushed, or with
+     * nullptr once the cache is terminated. 'ready' is called by the pushing
+     * thread and must not block.
+     */
+    bool getOrNotify(const id_type &id, data_type &data, const std::function<void(const data_type*)> &ready) {
+        bool compressed = false;
+        {
+            const std::unique_lock<mutex_type> lock(lockCache());
+            if (m_Terminated)
+                CONCURRENT_THROW(terminated());
+            if (!m_SharedCache.getStored(id, data, compressed)) {
+                m_AsyncGetters.insert(std::make_pair(id, ready));
+                return false;
+            }
+        }
+        if (compressed) {
+            const data_type stored(data);
+            compression_type::decompress(stored, data);
+        }
+        return true;
+    }
+
+    /**
+     * Compresses at most maxEntries entries lying at least 'distance' units
+     * away from the playhead. Meant to be called periodically from a
+     * background thread, compression happens outside of the critical section.
+     * Only the ids are collected up front, the entries are copied one at a
+     * time in the critical section committing the previous one.
+     * Returns the number of compressed entries.
+     */
+    size_t compress(const size_t distance, const size_t maxEntries = size_t(-1)) {
+        std::vector<id_type> ids;
+        {
+            const std::unique_lock<mutex_type> lock(lockCache());
+            m_SharedCache.coldIds(distance, ids, maxEntries);
+        }
+        size_t count = 0;
+        data_type raw, compressed;
+        metric_type weight = 0;
+        bool success = false;
+        bool pending = false; // compressed holds ids[i - 1]
+        for (size_t i = 0; i < ids.size() || pending; ++i) {
+            bool cold = false;
+            {
+                const std::unique_lock<mutex_type> lock(lockCache());
+                if (pending) {
+                    m_SharedCache.commitCompressed(ids[i - 1], success, compressed, weight);
+                    if (success)
+                        ++count;
+                }
+                if (i < ids.size())
+                    cold = m_SharedCache.coldEntry(ids[i], raw, weight);
+            }
+            pending = cold;
+            if (cold) {
+                compressed = data_type();
+                success = compression_type::compress(raw, compressed, weight);
+                raw = data_type();
+            }
+        }
+        return count;
     }
 
+    /**
+     * Copies every cached id with the cache locked, a range_index is
+     * cheaper to read frequently.
+     */
     inline metric_type dumpKeys(std::vector<id_type> &allKeys) const {
-    	std::lock_guard<std::mutex> lock(m_CacheMutex);
+    	const std::unique_lock<mutex_type> lock(lockCache());
         m_SharedCache.dumpKeys(allKeys);
         return m_SharedCache.weight();
     }
 
     void process(const WorkUnitItr &job) {
-        m_PendingJob.set(job);
+        m_SharedCache.tracer().onProcess();
+        {
+            const std::unique_lock<mutex_type> lock(lockCache());
+            m_PendingJob = job;
+            m_JobPending = true;
+        }
+        m_JobGeneration.fetch_add(1);
+        m_JobWaiter.notify_all(m_JobGeneration);
+        if (m_AsyncWaiters.load())
+            notifyAsync(false);
     }
 
     inline void setMaxWeight(const metric_type size) {
-    	std::lock_guard<std::mutex> lock(m_CacheMutex);
+    	const std::unique_lock<mutex_type> lock(lockCache());
         m_SharedCache.setMaxWeight(size);
     }
 
+    inline void setEvictionMode(const EvictionMode mode) {
+    	const std::unique_lock<mutex_type> lock(lockCache());
+        m_SharedCache.setEvictionMode(mode);
+    }
+
+    /**
+     * Evicts in eviction order until the weight is at most 'weight', at most
+     * maxEvictions entries per call, see priority_cache_details::reclaim.
+     * Returns the weight.
+     */
+    inline metric_type reclaim(const metric_type weight, const size_t maxEvictions = size_t(-1)) {
+        const std::unique_lock<mutex_type> lock(lockCache());
+        return m_SharedCache.reclaim(weight, maxEvictions);
+    }
+
+    inline metric_type weight() const {
+        const std::unique_lock<mutex_type> lock(lockCache());
+        return m_SharedCache.weight();
+    }
+
     void terminate(bool value = true) {
-        m_PendingJob.terminate(value);
+        AsyncGetters getters;
+        {
+            const std::unique_lock<mutex_type> lock(lockCache());
+            m_Terminated = value;
+            getters.swap(m_AsyncGetters);
+        }
+        m_JobGeneration.fetch_add(1);
+        m_JobWaiter.notify_all(m_JobGeneration);
+        for (const auto &getter : getters)
+            getter.second(nullptr);
+        if (value && m_AsyncWaiters.load())
+            notifyAsync(true);
+    }
+
+    /**
+     * Relaxed view of the cache statistics, does not lock the cache.
+     * All zeros unless the policy enables them.
+     */
+    inline cache_stats_snapshot stats() const {
+        return m_SharedCache.stats().snapshot();
+    }
+
+    /**
+     * Access to the tracer policy instance, e.g. to flush a ring_tracer.
+     */
+    inline typename cache_type::tracer_type& tracer() const {
+        return m_SharedCache.tracer();
+    }
+
+    /**
+     * Access to the index policy instance, e.g. to read the ranges of a
+     * range_index without locking the cache instead of calling dumpKeys.
+     */
+    inline typename cache_type::index_type& index() const {
+        return m_SharedCache.index();
+    }
+
+    /**
+     * Fills ids with at most count ids the next pops would serve, without
+     * claiming them, e.g. to open or prefetch files ahead of time. Ids can
+     * still be served in a different order if pushes or a new job happen in
+     * between. Throws terminated like pop.
+     *
+     * Read only : a job set by process is peeked without being picked, and
+     * the ids pending for the current job are not discarded.
+     */
+    size_t peekUpcoming(std::vector<id_type> &ids, const size_t count) {
+        std::lock_guard<mutex_type> lock(m_WorkerMutex);
+        const std::unique_lock<mutex_type> cacheLock(lockCache());
+        if (m_Terminated)
+            CONCURRENT_THROW(terminated());
+        return peek_upcoming(m_SharedCache, m_JobPending ? m_PendingJob : m_SharedWorkUnitItr, ids, count);
     }
 
     // worker functions
     void pop(id_type &unit) {
-    	std::lock_guard<std::mutex> lock(m_WorkerMutex);
-        do {
-            unit = nextWorkUnit();
-            D_( std::cout << "next unit is : " << unit.filename << std::endl);
-            std::lock_guard<std::mutex> lock(m_CacheMutex);
-            switch (m_SharedCache.update(unit)) {
-                case FULL:
-                    D_( std::cout << "cache is full, emptying current job" << std::endl);
-                    m_SharedWorkUnitItr.clear();
-                    break;
-                case NOT_NEEDED:
-                    D_( std::cout << "unit updated, checking another one" << std::endl);
-                    break;
-                case NEEDED:
-                    D_( std::cout << "serving " << unit << std::endl);
-                    return;
+        if (popUntil(unit, nullptr) == pop_status::TERMINATED)
+            CONCURRENT_THROW(terminated());
+    }
+
+    /**
+     * Non blocking pop, returns false if there is nothing to work on
+     */
+    bool tryPop(id_type &unit) {
+        const pop_status status = tryPop(unit, std::nothrow);
+        if (status == pop_status::TERMINATED)
+            CONCURRENT_THROW(terminated());
+        return status == pop_status::OK;
+    }
+
+    /**
+     * Status returning pops, termination is reported without unwinding the
+     * workers' stacks : stopping and restarting the workers on every job
+     * change is cheap, and workers build without exceptions.
+     *
+     * while (cache.pop(id, std::nothrow) == concurrent::pop_status::OK)
+     *     cache.push(id, weight, decode(id));
+     */
+    pop_status pop(id_type &unit, const std::nothrow_t&) {
+        return popUntil(unit, nullptr);
+    }
+
+    template<typename Rep, typename Period>
+    pop_status pop(id_type &unit, const std::chrono::duration<Rep, Period> &timeout) {
+        const concurrent::details::clock_type::time_point deadline = concurrent::details::deadline_after(timeout);
+        return popUntil(unit, &deadline);
+    }
+
+    pop_status tryPop(id_type &unit, const std::nothrow_t&) {
+        bool more = false;
+        {
+            std::lock_guard<mutex_type> lock(m_WorkerMutex);
+            if (updateJob() == pop_status::TERMINATED)
+                return pop_status::TERMINATED;
+            do {
+                if (m_SharedWorkUnitItr.empty())
+                    return pop_status::TIMEOUT;
+                unit = m_SharedWorkUnitItr.next();
+            } while (!issue(unit));
+            more = !m_SharedWorkUnitItr.empty();
+        }
+        // there is work left for another asynchronous worker
+        if (more && m_AsyncWaiters.load())
+            notifyAsync(false);
+        return pop_status::OK;
+    }
+
+    /**
+     * Pops without blocking the thread : returns true if unit was popped,
+     * otherwise 'ready' is called once there may be work - a new job or a
+     * worker leaving work behind - or the cache is terminated and the
+     * caller should try again. 'ready' must not block.
+     *
+     * Workers blocked in pop wait for a job without the worker mutex, both
+     * kinds of workers can serve the same cache.
+     */
+    bool popOrNotify(id_type &unit, const std::function<void()> &ready) {
+        for (;;) {
+            const uint32_t generation = m_JobGeneration.load();
+            if (tryPop(unit))
+                return true;
+            const std::lock_guard<std::mutex> lock(m_AsyncMutex);
+            // announced before checking, process and terminate check it after updating
+            m_AsyncWaiters.fetch_add(1);
+            if (m_JobGeneration.load() == generation) {
+                m_AsyncCallbacks.push_back(ready);
+                return false;
             }
-        } while (true);
+            m_AsyncWaiters.fetch_sub(1);
+        }
     }
 
-    inline bool push(const id_type &id, const metric_type weight, const data_type &data) {
-    	std::lock_guard<std::mutex> lock(m_CacheMutex);
-        return m_SharedCache.put(id, weight, data);
+    inline bool push(const id_type &id, const metric_type weight, const data_type &data, const metric_type cost = 0) {
+        std::vector<std::function<void(const data_type*)> > getters;
+        bool pushed;
+        auto put = [&]() {
+            pushed = m_SharedCache.put(id, weight, data, cost);
+            if (!m_AsyncGetters.empty()) {
+                const auto range = m_AsyncGetters.equal_range(id);
+                for (auto itr = range.first; itr != range.second; ++itr)
+                    getters.push_back(itr->second);
+                m_AsyncGetters.erase(range.first, range.second);
+            }
+        };
+        locked(put);
+        // getters are served even if the cache could not keep the data
+        for (const auto &getter : getters)
+            getter(&data);
+        return pushed;
     }
 
 private:
-    inline id_type nextWorkUnit() {
-        if (updateJob()) {
-        	std::lock_guard<std::mutex> lock(m_CacheMutex);
-            m_SharedCache.discardPending();
+    inline std::unique_lock<mutex_type> lockCache() const {
+        const typename stats_type::stopwatch_type watch;
+        std::unique_lock<mutex_type> lock(m_CacheMutex);
+        m_SharedCache.stats().onLockWait(watch.elapsed());
+        return lock;
+    }
+
+    /**
+     * Runs op with the cache lock held, possibly by another thread when the
+     * policy combines the operations
+     */
+    template<typename OP>
+    inline void locked(OP &op) {
+        locked(op, m_Combining);
+    }
+
+    template<typename OP>
+    inline void locked(OP &op, no_combining &) {
+        const std::unique_lock<mutex_type> lock(lockCache());
+        op();
+    }
+
+    template<typename OP, typename COMBINING>
+    inline void locked(OP &op, COMBINING &combining) {
+        // the wait includes the operations applied meanwhile
+        const typename stats_type::stopwatch_type watch;
+        combining.execute(m_CacheMutex, op);
+        m_SharedCache.stats().onLockWait(watch.elapsed());
+    }
+
+    /**
+     * Returns true if unit has to be computed, empties the job if the cache is
+     * full. The worker mutex must be held.
+     */
+    inline bool issue(const id_type &unit) {
+        UpdateStatus status;
+        auto update = [&]() {
+            status = m_SharedCache.update(unit);
+        };
+        locked(update);
+        switch (status) {
+            case FULL:
+                D_( std::cout << "cache is full, emptying current job" << std::endl);
+                m_SharedWorkUnitItr.clear();
+                return false;
+            case NOT_NEEDED:
+                D_( std::cout << "unit updated, checking another one" << std::endl);
+                return false;
+            case NEEDED:
+                D_( std::cout << "serving " << unit << std::endl);
+                return true;
+        }
+        return false;
+    }
+
+    void notifyAsync(const bool all) {
+        std::vector<std::function<void()> > ready;
+        {
+            const std::lock_guard<std::mutex> lock(m_AsyncMutex);
+            while (!m_AsyncCallbacks.empty() && (all || ready.empty())) {
+                ready.push_back(m_AsyncCallbacks.front());
+                m_AsyncCallbacks.pop_front();
+                m_AsyncWaiters.fetch_sub(1);
+            }
         }
-        return m_SharedWorkUnitItr.next();
+        for (const auto &callback : ready)
+            callback();
     }
 
-    inline bool updateJob() {
-        bool updated = m_PendingJob.tryGet(m_SharedWorkUnitItr);
-        while (m_SharedWorkUnitItr.empty()) {
-            m_PendingJob.waitGet(m_SharedWorkUnitItr);
-            updated = true;
+    /**
+     * Pops the next unit to compute, waiting for a job while there is none
+     * until deadline, or forever if deadline is null. Returns TIMEOUT or
+     * TERMINATED instead of throwing.
+     */
+    pop_status popUntil(id_type &unit, const concurrent::details::clock_type::time_point *deadline) {
+        for (;;) {
+            // read before looking at the job so that a job set meanwhile wakes us up
+            const uint32_t generation = m_JobGeneration.load();
+            {
+                std::lock_guard<mutex_type> lock(m_WorkerMutex);
+                if (updateJob() == pop_status::TERMINATED)
+                    return pop_status::TERMINATED;
+                while (!m_SharedWorkUnitItr.empty()) {
+                    unit = m_SharedWorkUnitItr.next();
+                    D_( std::cout << "next unit is : " << unit.filename << std::endl);
+                    if (issue(unit))
+                        return pop_status::OK;
+                }
+            }
+            // idle workers park without the worker mutex, tryPop, popOrNotify
+            // and peekUpcoming never wait behind them
+            if (!deadline)
+                m_JobWaiter.wait(m_JobGeneration, generation);
+            else if (concurrent::details::clock_type::now() < *deadline)
+                m_JobWaiter.wait_until(m_JobGeneration, generation, *deadline);
+            else
+                return pop_status::TIMEOUT;
+        }
+    }
+
+    /**
+     * Picks the job set by process if any and reports termination. The worker
+     * mutex must be held, the cache is only locked when process or terminate
+     * were called since the previous update.
+     */
+    inline pop_status updateJob() {
+        const uint32_t generation = m_JobGeneration.load();
+        if (generation != m_InstalledGeneration) {
+            const std::unique_lock<mutex_type> cacheLock(lockCache());
+            m_InstalledGeneration = generation;
+            m_WorkerTerminated = m_Terminated;
+            if (m_JobPending) {
+                m_SharedWorkUnitItr = m_PendingJob;
+                m_PendingJob = WorkUnitItr();
+                m_JobPending = false;
+                m_SharedCache.discardPending();
+            }
         }
-        assert(!m_SharedWorkUnitItr.empty());
-        return updated;
+        return m_WorkerTerminated ? pop_status::TERMINATED : pop_status::OK;
     }
 
-    mutable std::mutex m_WorkerMutex;
-    mutable std::mutex m_CacheMutex;
-    priority_cache_details<id_type, metric_type, data_type> m_SharedCache;
-    slot<WorkUnitItr> m_PendingJob;
+    mutable mutex_type m_WorkerMutex;
+    mutable mutex_type m_CacheMutex;
+    combining_type m_Combining; // push and update
+    cache_type m_SharedCache;
+
+    // current job, protected by the worker mutex
     WorkUnitItr m_SharedWorkUnitItr;
+    uint32_t m_InstalledGeneration; // m_JobGeneration the job was updated at
+    bool m_WorkerTerminated;
+
+    // next job and asynchronous getters, protected by the cache mutex
+    typedef std::multimap<id_type, std::function<void(const data_type*)> > AsyncGetters;
+    WorkUnitItr m_PendingJob;
+    bool m_JobPending;
+    bool m_Terminated;
+    AsyncGetters m_AsyncGetters;
+
+    // idle and asynchronous workers
+    concurrent::details::wait_word m_JobGeneration; // bumped by process and terminate
+    concurrent::details::atomic_waiter<block_wait> m_JobWaiter;
+    std::atomic<uint32_t> m_AsyncWaiters; // registered or registering popOrNotify
+    std::mutex m_AsyncMutex;
+    std::deque<std::function<void()> > m_AsyncCallbacks;
 };
 
 } // namespace cache
@@ -0,0 +1,205 @@
+/*
+ * memory_pressure.hpp
+ *
+ *  Shrinks the caches when the machine is short of memory, before the
+ *  frames being played get swapped out, and grows them back once the
+ *  pressure clears.
+ *
+ *  Reads the Linux pressure stall information of a cgroup - memory.pressure,
+ *  or /proc/pressure/memory for the whole system - and optionally its
+ *  memory.current. The caches are reclaimed in bounded batches so that the
+ *  workers and the readers are never locked out for long.
+ *
+ *  memory_pressure_watcher watcher;
+ *  watcher.watch(cache, 2ull << 30);
+ *  watcher.start(std::chrono::milliseconds(500));
+ */
+
+#ifndef MEMORY_PRESSURE_HPP_
+#define MEMORY_PRESSURE_HPP_
+
+#include "cache_governor.hpp"
+
+#include <concurrent/common.hpp>
+#include <concurrent/slot.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace concurrent {
+namespace cache {
+
+struct pressure_options {
+	std::string pressurePath; // PSI file, unread if empty
+	std::string currentPath; // cgroup memory.current, unread if empty
+	double high; // 'some avg10' stall percentage above which the caches shrink
+	double low; // below which they grow back
+	uint64_t currentHigh; // bytes of memory.current above which the caches shrink, 0 to ignore
+	double minScale; // the caches keep at least this fraction of their nominal weight
+	double shrinkStep; // fraction of the nominal weight taken per poll under pressure
+	double growStep; // fraction given back per poll once the pressure cleared
+	size_t batch; // evictions per cache and per poll
+
+	pressure_options() :
+			pressurePath("/sys/fs/cgroup/memory.pressure"), currentPath("/sys/fs/cgroup/memory.current"), high(10), low(1), currentHigh(0), minScale(0.1), shrinkStep(0.1), growStep(0.05), batch(256) {
+	}
+};
+
+struct memory_reading {
+	bool hasPressure;
+	double some10; // share of the last 10 seconds some tasks stalled on memory, in percent
+	bool hasCurrent;
+	uint64_t current; // bytes
+
+	memory_reading() :
+			hasPressure(false), some10(0), hasCurrent(false), current(0) {
+	}
+};
+
+/**
+ * Parses the 'some avg10=' field of a PSI file :
+ * some avg10=0.12 avg60=0.05 avg300=0.01 total=123456
+ * full avg10=0.00 avg60=0.00 avg300=0.00 total=4567
+ */
+inline bool read_memory_pressure(const std::string &path, double &some10) {
+	std::ifstream file(path.c_str());
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		std::string kind, field;
+		fields >> kind >> field;
+		if (kind == "some" && field.compare(0, 6, "avg10=") == 0) {
+			std::istringstream value(field.substr(6));
+			return bool(value >> some10);
+		}
+	}
+	return false;
+}
+
+inline bool read_memory_current(const std::string &path, uint64_t &bytes) {
+	std::ifstream file(path.c_str());
+	return bool(file >> bytes);
+}
+
+/**
+ * Every poll moves a scale between minScale and 1 : down by shrinkStep while
+ * under pressure, up by growStep once the pressure is below 'low', unchanged
+ * in between. Each watched cache gets its nominal weight times the scale as
+ * maximum weight and is reclaimed by at most 'batch' evictions, the next
+ * polls carry on until it fits.
+ *
+ * Caches leased from a cache_governor are not watched themselves, the
+ * governor's budget is.
+ */
+struct memory_pressure_watcher: private noncopyable {
+	explicit memory_pressure_watcher(const pressure_options &options = pressure_options()) :
+			m_Options(options), m_Scale(1) {
+	}
+
+	~memory_pressure_watcher() {
+		stop();
+	}
+
+	/**
+	 * The cache must outlive the watcher
+	 */
+	template<typename CACHE>
+	void watch(CACHE &cache, const typename CACHE::metric_type nominal) {
+		typedef typename CACHE::metric_type metric_type;
+		const std::lock_guard<std::mutex> lock(m_Mutex);
+		const size_t batch = m_Options.batch;
+		m_Caches.push_back([&cache, nominal, batch](double scale) {
+			const metric_type weight = metric_type(nominal * scale);
+			cache.setMaxWeight(weight);
+			cache.reclaim(weight, batch);
+		});
+		m_Caches.back()(m_Scale);
+	}
+
+	/**
+	 * Scales the budget of the governor, which reclaims its caches at once
+	 */
+	template<typename METRIC_TYPE>
+	void watch(cache_governor<METRIC_TYPE> &governor, const METRIC_TYPE nominal) {
+		const std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Caches.push_back([&governor, nominal](double scale) {
+			governor.setBudget(METRIC_TYPE(nominal * scale));
+		});
+		m_Caches.back()(m_Scale);
+	}
+
+	memory_reading read() const {
+		memory_reading reading;
+		if (!m_Options.pressurePath.empty())
+			reading.hasPressure = read_memory_pressure(m_Options.pressurePath, reading.some10);
+		if (!m_Options.currentPath.empty())
+			reading.hasCurrent = read_memory_current(m_Options.currentPath, reading.current);
+		return reading;
+	}
+
+	/**
+	 * Reads the files and resizes the caches, returns the new scale
+	 */
+	double poll() {
+		const memory_reading reading = read();
+		const bool overCurrent = m_Options.currentHigh && reading.hasCurrent && reading.current >= m_Options.currentHigh;
+		const bool pressure = (reading.hasPressure && reading.some10 >= m_Options.high) || overCurrent;
+		// unreadable files hold the scale
+		const bool relaxed = (reading.hasPressure || reading.hasCurrent) && !overCurrent && (!reading.hasPressure || reading.some10 < m_Options.low);
+		const std::lock_guard<std::mutex> lock(m_Mutex);
+		if (pressure)
+			m_Scale = std::max(m_Options.minScale, m_Scale - m_Options.shrinkStep);
+		else if (relaxed)
+			m_Scale = std::min(1., m_Scale + m_Options.growStep);
+		for (const auto &resize : m_Caches)
+			resize(m_Scale);
+		return m_Scale;
+	}
+
+	double scale() const {
+		const std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Scale;
+	}
+
+	/**
+	 * Polls from a background thread
+	 */
+	void start(const std::chrono::milliseconds period) {
+		if (m_Thread.joinable())
+			return;
+		m_Stop.terminate(false);
+		m_Thread = std::thread([this, period]() {
+			bool dummy;
+			while (m_Stop.waitGet(dummy, period) != pop_status::TERMINATED)
+				poll();
+		});
+	}
+
+	void stop() {
+		if (!m_Thread.joinable())
+			return;
+		m_Stop.terminate();
+		m_Thread.join();
+	}
+
+private:
+	const pressure_options m_Options;
+	mutable std::mutex m_Mutex;
+	double m_Scale;
+	std::vector<std::function<void(double)> > m_Caches;
+	slot<bool> m_Stop; // terminated to stop the thread
+	std::thread m_Thread;
+};
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* MEMORY_PRESSURE_HPP_ */
@@ -10,6 +10,8 @@
 
 #include "priority_cache_details.hpp"
 
+#include <algorithm>
+
 #include <iostream>
 #include <cassert>
 
@@ -24,12 +26,13 @@ namespace cache {
  * - add an iterator to process
  * - loop on pop until false, for each unit process and push to cache
  */
-template<typename ID_TYPE, typename METRIC_TYPE, typename DATA_TYPE, typename WORK_UNIT_RANGE>
+template<typename ID_TYPE, typename METRIC_TYPE, typename DATA_TYPE, typename WORK_UNIT_RANGE, typename POLICY = default_cache_policy>
 struct priority_cache {
     typedef ID_TYPE id_type;
     typedef METRIC_TYPE metric_type;
     typedef DATA_TYPE data_type;
     typedef WORK_UNIT_RANGE WorkUnitItr;
+    typedef priority_cache_details<id_type, metric_type, data_type, POLICY> cache_type;
 
 #if __cplusplus >= 201103L
     static_assert(std::is_default_constructible<WORK_UNIT_RANGE>::value, "WorkUnitItr should be default constructible");
@@ -44,12 +47,20 @@ struct priority_cache {
         return m_Cache.get(id, data);
     }
 
+    /**
+     * See priority_cache_details::getBest
+     */
+    inline bool getBest(const id_type &id, id_type &found, data_type &data) const {
+        return m_Cache.getBest(id, found, data);
+    }
+
     inline metric_type dumpKeys(std::vector<id_type> &allKeys) const {
         m_Cache.dumpKeys(allKeys);
         return m_Cache.weight();
     }
 
     void process(const WorkUnitItr &job) {
+        m_Cache.tracer().onProcess();
     	m_WorkUnitItr = job;
     }
 
@@ -57,6 +68,37 @@ struct priority_cache {
         m_Cache.setMaxWeight(size);
     }
 
+    inline void setEvictionMode(const EvictionMode mode) {
+        m_Cache.setEvictionMode(mode);
+    }
+
+    /**
+     * Compresses entries lying at least 'distance' units away from the playhead.
+     */
+    inline size_t compress(const size_t distance) {
+        return m_Cache.compress(distance);
+    }
+
+    inline cache_stats_snapshot stats() const {
+        return m_Cache.stats().snapshot();
+    }
+
+    inline typename cache_type::tracer_type& tracer() const {
+        return m_Cache.tracer();
+    }
+
+    inline typename cache_type::index_type& index() const {
+        return m_Cache.index();
+    }
+
+    /**
+     * Fills ids with at most count ids the next pops would serve, without
+     * claiming them. Assumes no push happens in between.
+     */
+    size_t peekUpcoming(std::vector<id_type> &ids, const size_t count) const {
+        return peek_upcoming(m_Cache, m_WorkUnitItr, ids, count);
+    }
+
     // worker functions
     bool pop(id_type &unit) {
         do {
@@ -79,12 +121,12 @@ struct priority_cache {
         } while (true);
     }
 
-    inline bool push(const id_type &id, const metric_type weight, const data_type &data) {
-        return m_Cache.put(id, weight, data);
+    inline bool push(const id_type &id, const metric_type weight, const data_type &data, const metric_type cost = 0) {
+        return m_Cache.put(id, weight, data, cost);
     }
 
 private:
-    priority_cache_details<id_type, metric_type, data_type> m_Cache;
+    cache_type m_Cache;
     WorkUnitItr m_WorkUnitItr;
 };
 
@@ -8,6 +8,8 @@
 #ifndef PRIORITYCACHE_DETAILS_HPP_
 #define PRIORITYCACHE_DETAILS_HPP_
 
+#include "cache_policy.hpp"
+
 #include <concurrent/common.hpp>
 
 #include <vector>
@@ -34,27 +36,91 @@ enum UpdateStatus {
 	FULL, NEEDED, NOT_NEEDED
 };
 
+/**
+ * How entries which are not requested by the current job are evicted.
+ * - PRIORITY : entries requested by the most recent jobs are kept longer.
+ * - GREEDY_DUAL_SIZE : entries with the highest cost per unit of weight are
+ * kept longer, credits are refreshed on get and update and aged as entries
+ * are evicted.
+ * In both modes the pending entries are evicted last, lowest priority first.
+ */
+enum EvictionMode {
+	PRIORITY, GREEDY_DUAL_SIZE
+};
+
 /**
  * This is the backend for the look ahead cache. It is thread unsafe and
  * not meant to be used directly.
  */
-template<typename ID_TYPE, typename METRIC_TYPE, typename DATA_TYPE>
+template<typename ID_TYPE, typename METRIC_TYPE, typename DATA_TYPE, typename POLICY = default_cache_policy>
 struct priority_cache_details: private noncopyable {
 	typedef ID_TYPE id_type;
 	typedef METRIC_TYPE metric_type;
 	typedef DATA_TYPE data_type;
+	typedef typename POLICY::compression_type compression_type;
+	typedef typename POLICY::stats_type stats_type;
+	typedef typename POLICY::tracer_type tracer_type;
+	typedef typename POLICY::index_type index_type;
 
 	static_assert(std::is_unsigned<metric_type>::value, "metric_type must be unsigned");
 
 private:
-	typedef std::deque<id_type> IdContainer;
-	typedef typename IdContainer::iterator IdItr;
+	/**
+	 * Requests are tagged with the job - epoch - they belong to and a stamp
+	 * unique to each request. Lists are only appended to, an entry is live
+	 * as long as the index holds its stamp. Removing an id is a map erase,
+	 * the stale entries are compacted lazily.
+	 */
+	struct Tag {
+		size_t epoch;
+		size_t stamp;
+	};
+	struct Request {
+		id_type id;
+		size_t stamp;
+	};
+	typedef std::deque<Request> RequestContainer;
+	typedef std::map<id_type, Tag> RequestIndex;
+	typedef typename RequestIndex::const_iterator RequestConstItr;
+
+	enum {
+		UNREQUESTED = 0, // epoch of the ids pushed without being requested
+		MIN_STALE = 64 // below this, stale entries are not worth compacting
+	};
+
+	enum CompressionState {
+		RAW, COMPRESSED, INCOMPRESSIBLE
+	};
+
+	/**
+	 * Cached ids by credit in GREEDY_DUAL_SIZE eviction mode, the lowest
+	 * credit is evicted first. Equal credits go in PRIORITY order : oldest
+	 * job first, from its end.
+	 */
+	struct CreditKey {
+		double credit;
+		size_t epoch;
+		size_t stamp;
+		bool operator<(const CreditKey &other) const {
+			if (credit != other.credit)
+				return credit < other.credit;
+			if (epoch != other.epoch)
+				return epoch < other.epoch;
+			return stamp > other.stamp;
+		}
+	};
+	typedef std::map<CreditKey, id_type> CreditIndex;
+	typedef typename CreditIndex::iterator CreditItr;
 
 	struct WeightedData {
 		metric_type weight;
 		data_type data;
-		WeightedData(const metric_type &weight, const data_type &data) :
-				weight(weight), data(data) {
+		CompressionState state;
+		metric_type cost;
+		mutable double credit; // GreedyDual-Size H value
+		mutable CreditItr rank; // in m_Credits, GREEDY_DUAL_SIZE mode only
+		WeightedData(const metric_type &weight, const data_type &data, const metric_type &cost, double credit) :
+				weight(weight), data(data), state(RAW), cost(cost), credit(credit), rank() {
 		}
 	};
 
@@ -64,7 +130,7 @@ private:
 
 public:
 	priority_cache_details(metric_type limit) :
-			m_MaxWeight(limit) {
+			m_MaxWeight(limit), m_EvictionMode(PRIORITY), m_Inflation(0), m_Weight(0), m_Epoch(UNREQUESTED + 1), m_Stamp(0), m_Stale(0), m_ContiguousCount(0), m_ContiguousStamp(0), m_ContiguousWeight(0) {
 		D_( std::cout << "########################################" << std::endl);
 	}
 
@@ -84,112 +150,389 @@ public:
 	}
 
 	inline bool pending(id_type id) const {
-		return in(m_PendingIds, id);
+		const RequestConstItr itr = m_Requests.find(id);
+		return itr != m_Requests.end() && itr->second.epoch == m_Epoch;
 	}
 
 	inline metric_type weight() const {
 		return currentWeight();
 	}
 
+	/**
+	 * O(1) : the pending ids become the most recent discardable job by
+	 * switching epoch.
+	 */
 	void discardPending() {
-		m_DiscardableIds.insert(m_DiscardableIds.begin(), m_PendingIds.begin(), m_PendingIds.end());
-		m_PendingIds.clear();
+		if (!m_PendingIds.empty()) {
+			m_DiscardableIds.push_front(RequestContainer());
+			m_DiscardableIds.front().swap(m_PendingIds);
+		}
+		++m_Epoch;
+		resetContiguous();
 	}
 
 	UpdateStatus update(id_type id) {
-		if (full())
+		compactIfNeeded();
+		if (full()) {
+			m_Stats.onUpdate(FULL);
 			return FULL; //
+		}
 		D_( std::cout << "Updating " << id << std::endl);
+		m_Tracer.onRequest(id);
 		const bool wasRequested = remove(id);
-		m_PendingIds.push_back(id);
-		const UpdateStatus status = wasRequested || contains(id) ? NOT_NEEDED : NEEDED;
-		if (status == NEEDED)
+		request(m_PendingIds, id, m_Epoch);
+		const CacheConstItr itr = m_Cache.find(id);
+		if (itr != m_Cache.end())
+			refreshCredit(itr); // requested again
+		const UpdateStatus status = wasRequested || itr != m_Cache.end() ? NOT_NEEDED : NEEDED;
+		if (status == NEEDED) {
 			dump("update dump");
+			m_Tracer.onIssue(id);
+		}
+		m_Stats.onUpdate(status);
 		return status;
 	}
 
-	bool put(const id_type &id, const metric_type weight, const data_type &data) {
+	/**
+	 * What update(id) would return, without touching the bookkeeping
+	 */
+	UpdateStatus peek(id_type id) const {
+		if (full())
+			return FULL;
+		return m_Requests.find(id) != m_Requests.end() || contains(id) ? NOT_NEEDED : NEEDED;
+	}
+
+	/**
+	 * cost is the price to recompute the entry (e.g. load + decode time), it
+	 * is only used in GREEDY_DUAL_SIZE eviction mode.
+	 */
+	bool put(const id_type &id, const metric_type weight, const data_type &data, const metric_type cost = 0) {
 		D_( std::cout << "========================================" << std::endl);
 		if (weight == 0)
-			throw std::logic_error("can't put an id with no weight");
+			CONCURRENT_THROW(std::logic_error("can't put an id with no weight"));
 		if (contains(id))
-			throw std::logic_error("id is already present in cache");
+			CONCURRENT_THROW(std::logic_error("id is already present in cache"));
+		compactIfNeeded();
 
 		if (full()) {
 			D_( std::cout << "cache is *full*, discarding " << id << std::endl);
 			remove(id); // no more pending
 			dump("cache full dump");
+			m_Stats.onPut(false);
+			m_Tracer.onPush(id, false);
 			return false;
 		}
 		if (!canFit(weight)) {
 			D_( std::cout << "trying to make room for " << id << std::endl);
 			makeRoomFor(id, weight);
 		}
-		if (full())
+		if (full()) {
+			m_Stats.onPut(false);
+			m_Tracer.onPush(id, false);
 			return false;
-		addToCache(id, weight, data);
+		}
+		addToCache(id, weight, data, cost);
+		m_Stats.onPut(true);
+		m_Tracer.onPush(id, true);
 		return true;
 	}
 
 	bool get(const id_type &id, data_type &data) const {
+		bool compressed = false;
+		if (!getStored(id, data, compressed))
+			return false;
+		if (compressed) {
+			const data_type stored(data);
+			compression_type::decompress(stored, data);
+		}
+		return true;
+	}
+
+	/**
+	 * Retrieves the data as stored in the cache, compressed is set to true
+	 * if data has to go through compression_type::decompress before use.
+	 * This allows the caller to decompress outside of its critical section.
+	 */
+	bool getStored(const id_type &id, data_type &data, bool &compressed) const {
 		const CacheConstItr itr = m_Cache.find(id);
-		if (itr == m_Cache.end())
+		m_Stats.onGet(itr != m_Cache.end());
+		m_Tracer.onGet(id, itr != m_Cache.end());
+		return read(itr, data, compressed);
+	}
+
+	/**
+	 * Gets the first cached id between the bounds 'level_bounds(id, first,
+	 * last)' returns, found by argument dependent lookup : with leveled ids
+	 * the finest level of id's frame currently cached. found is set to the
+	 * id served.
+	 */
+	bool getBest(const id_type &id, id_type &found, data_type &data) const {
+		bool compressed = false;
+		if (!getStoredBest(id, found, data, compressed))
+			return false;
+		if (compressed) {
+			const data_type stored(data);
+			compression_type::decompress(stored, data);
+		}
+		return true;
+	}
+
+	bool getStoredBest(const id_type &id, id_type &found, data_type &data, bool &compressed) const {
+		id_type first, last;
+		level_bounds(id, first, last);
+		CacheConstItr itr = m_Cache.lower_bound(first);
+		if (itr != m_Cache.end() && last < itr->first)
+			itr = m_Cache.end();
+		m_Stats.onGet(itr != m_Cache.end());
+		m_Tracer.onGet(itr != m_Cache.end() ? itr->first : id, itr != m_Cache.end());
+		if (itr != m_Cache.end())
+			found = itr->first;
+		return read(itr, data, compressed);
+	}
+
+	/**
+	 * Lists the ids of the uncompressed entries lying at least 'distance'
+	 * units away from the playhead - the first pending id. At most
+	 * maxEntries are returned. Their data is fetched one at a time with
+	 * coldEntry.
+	 */
+	void coldIds(const size_t distance, std::vector<id_type> &ids, const size_t maxEntries = size_t(-1)) const {
+		ids.clear();
+		if (!compression_type::enabled)
+			return;
+		size_t position = 0;
+		const auto collect = [&](const RequestContainer &requests) {
+			for (const auto &request : requests) {
+				if (ids.size() >= maxEntries)
+					return;
+				if (!live(request) || position++ < distance)
+					continue;
+				const CacheConstItr itr = m_Cache.find(request.id);
+				if (itr != m_Cache.end() && itr->second.state == RAW)
+					ids.push_back(request.id);
+			}
+		};
+		collect(m_PendingIds);
+		for (const auto &job : m_DiscardableIds)
+			collect(job);
+	}
+
+	/**
+	 * Copies the data of a cold id, returns false if it has been evicted or
+	 * compressed in the meantime.
+	 */
+	bool coldEntry(const id_type &id, data_type &data, metric_type &weight) const {
+		const CacheConstItr itr = m_Cache.find(id);
+		if (itr == m_Cache.end() || itr->second.state != RAW)
 			return false;
 		data = itr->second.data;
+		weight = itr->second.weight;
 		return true;
 	}
 
+	/**
+	 * Replaces a cold entry previously returned by coldEntry with its
+	 * compressed version. The entry is left untouched if it has been evicted
+	 * or compressed in the meantime. Passing success == false flags the entry
+	 * as incompressible so it won't be returned by coldIds anymore.
+	 */
+	void commitCompressed(const id_type &id, const bool success, const data_type &compressed, const metric_type weight) {
+		const CacheItr itr = m_Cache.find(id);
+		if (itr == m_Cache.end() || itr->second.state != RAW)
+			return;
+		if (!success) {
+			itr->second.state = INCOMPRESSIBLE;
+			return;
+		}
+		D_( std::cout << "compressing " << id << " " << itr->second.weight << " -> " << weight << std::endl);
+		const RequestConstItr requestItr = m_Requests.find(id);
+		if (requestItr != m_Requests.end() && counted(requestItr->second))
+			m_ContiguousWeight = m_ContiguousWeight - itr->second.weight + weight;
+		m_Weight = m_Weight - itr->second.weight + weight;
+		itr->second.data = compressed;
+		itr->second.weight = weight;
+		itr->second.state = COMPRESSED;
+	}
+
+	/**
+	 * Compresses entries lying at least 'distance' units away from the
+	 * playhead, returns the number of compressed entries.
+	 */
+	size_t compress(const size_t distance) {
+		std::vector<id_type> ids;
+		coldIds(distance, ids);
+		size_t count = 0;
+		for (const id_type &id : ids) {
+			data_type raw, compressed;
+			metric_type weight = 0;
+			if (!coldEntry(id, raw, weight))
+				continue;
+			const bool success = compression_type::compress(raw, compressed, weight);
+			commitCompressed(id, success, compressed, weight);
+			if (success)
+				++count;
+		}
+		return count;
+	}
+
 	inline void setMaxWeight(const metric_type size) {
 		m_MaxWeight = size;
 	}
+
+	/**
+	 * Switching to GREEDY_DUAL_SIZE ranks every cached entry, O(n log n)
+	 */
+	inline void setEvictionMode(const EvictionMode mode) {
+		if (mode == m_EvictionMode)
+			return;
+		m_EvictionMode = mode;
+		m_Credits.clear();
+		if (mode == GREEDY_DUAL_SIZE)
+			for (CacheConstItr itr = m_Cache.begin(); itr != m_Cache.end(); ++itr)
+				rank(itr);
+	}
+
+	/**
+	 * Evicts in eviction order until the weight is at most 'weight', the
+	 * cached ids about to be served go last. Does not change the maximum
+	 * weight. At most maxEvictions entries are evicted so that a large
+	 * reclaim can be split in short critical sections. Returns the weight.
+	 */
+	metric_type reclaim(const metric_type weight, const size_t maxEvictions = size_t(-1)) {
+		compactIfNeeded();
+		if (currentWeight() > weight && maxEvictions)
+			evictDownTo(weight, true, maxEvictions);
+		return currentWeight();
+	}
+
+	/**
+	 * Statistics are atomic counters, they can be updated and read without
+	 * holding the lock protecting the cache.
+	 */
+	inline stats_type& stats() const {
+		return m_Stats;
+	}
+
+	/**
+	 * The tracer is called with the lock protecting the cache held but it
+	 * can be flushed without it.
+	 */
+	inline tracer_type& tracer() const {
+		return m_Tracer;
+	}
+
+	/**
+	 * The index is updated with the lock protecting the cache held, what it
+	 * publishes is read without it.
+	 */
+	inline index_type& index() const {
+		return m_Index;
+	}
 private:
 	inline void dump(const char* dumpMessage) const {
 #ifdef DEBUG_CACHE
 		using namespace std;
 		cout << dumpMessage << endl;
+		const auto display = [&](const RequestContainer &requests) {
+			for (const auto &request : requests)
+				if (live(request))
+					cout << "\t" << request.id << endl;
+		};
 		cout << "pendings {" << endl;
 		display(m_PendingIds);
 		cout << "}" << endl;
 		cout << "discardables {" << endl;
-		display(m_DiscardableIds);
+		for (const auto &job : m_DiscardableIds)
+			display(job);
 		cout << "}" << endl;
 		cout << "----------------------------------------" << endl;
 #endif
 	}
 
-	inline static bool in(const IdContainer &container, const id_type &value) {
-		return std::find(container.begin(), container.end(), value) != container.end();
+	inline bool live(const Request &request) const {
+		const RequestConstItr itr = m_Requests.find(request.id);
+		return itr != m_Requests.end() && itr->second.stamp == request.stamp;
+	}
+
+	inline void request(RequestContainer &requests, const id_type &id, const size_t epoch) {
+		const Tag tag = { epoch, ++m_Stamp };
+		m_Requests[id] = tag;
+		requests.push_back(Request { id, tag.stamp });
 	}
 
-	inline static bool remove(IdContainer &container, const id_type &value) {
-		IdItr itr = std::remove(container.begin(), container.end(), value);
-		if (itr == container.end())
+	/**
+	 * Forgets about id, returns false if it was neither pending nor
+	 * discardable.
+	 */
+	inline bool remove(const id_type &value) {
+		const typename RequestIndex::iterator itr = m_Requests.find(value);
+		if (itr == m_Requests.end())
 			return false;
-		container.erase(itr, container.end());
+		if (counted(itr->second))
+			resetContiguous();
+		m_Requests.erase(itr);
+		++m_Stale;
 		return true;
 	}
 
-	inline bool remove(const id_type &value) {
-		return remove(m_PendingIds, value) || remove(m_DiscardableIds, value);
+	/**
+	 * Drops the stale entries, amortized over the removals which made them
+	 * stale. Not called from remove so that the lists can be walked while
+	 * evicting.
+	 */
+	inline void compactIfNeeded() {
+		if (m_Stale >= MIN_STALE && m_Stale > m_Requests.size())
+			compact();
+	}
+
+	void compact() {
+		const auto dropStale = [this](RequestContainer &requests) {
+			requests.erase(std::remove_if(requests.begin(), requests.end(), [this](const Request &request) {
+				return !live(request);
+			}), requests.end());
+		};
+		dropStale(m_PendingIds);
+		for (auto &job : m_DiscardableIds)
+			dropStale(job);
+		m_DiscardableIds.erase(std::remove_if(m_DiscardableIds.begin(), m_DiscardableIds.end(), [](const RequestContainer &job) {
+			return job.empty();
+		}), m_DiscardableIds.end());
+		m_Stale = 0;
+		resetContiguous();
 	}
 
+	/**
+	 * Weight of the cached prefix of the pending ids. The scan resumes where
+	 * it stopped last time, it only restarts when an entry already counted
+	 * is evicted or no longer pending.
+	 */
 	inline metric_type contiguousWeight() const {
-		metric_type sum = 0;
 		const CacheConstItr &end = m_Cache.end();
-		for (const auto& id : m_PendingIds) {
-			const CacheConstItr &itr = m_Cache.find(id);
+		for (; m_ContiguousCount < m_PendingIds.size(); ++m_ContiguousCount) {
+			const Request &request = m_PendingIds[m_ContiguousCount];
+			if (!live(request))
+				continue;
+			const CacheConstItr &itr = m_Cache.find(request.id);
 			if (itr == end)
-				return sum;
-			sum += itr->second.weight;
+				break;
+			m_ContiguousWeight += itr->second.weight;
+			m_ContiguousStamp = request.stamp;
 		}
-		return sum;
+		return m_ContiguousWeight;
+	}
+
+	inline bool counted(const Tag &tag) const {
+		return tag.epoch == m_Epoch && tag.stamp <= m_ContiguousStamp;
+	}
+
+	inline void resetContiguous() {
+		m_ContiguousCount = 0;
+		m_ContiguousStamp = 0;
+		m_ContiguousWeight = 0;
 	}
 
-	metric_type currentWeight() const {
-		metric_type sum = 0;
-		for (const auto &pair : m_Cache)
-			sum += pair.second.weight;
-		return sum;
+	inline metric_type currentWeight() const {
+		return m_Weight;
 	}
 
 	inline bool canFit(const metric_type weight) const {
@@ -201,47 +544,165 @@ private:
 
 	void makeRoomFor(const id_type currentId, const metric_type weight) {
 		D_( std::cout << "{ " << currentWeight() << std::endl);
+		evictDownTo(m_MaxWeight - weight, false, size_t(-1));
+		D_( std::cout << "} " << currentWeight() << std::endl);
+	}
 
-		const IdItr firstMissing = std::find_if(m_PendingIds.begin(), m_PendingIds.end(), [&](const id_type& id){
-			return m_Cache.find(id) == m_Cache.end();
-		});
+	/**
+	 * Evicts the discardable ids, then the pending ids after the first
+	 * missing one farthest first, until the weight is at most maxWeight.
+	 * With 'prefix' set the cached prefix of the job goes last, from its far
+	 * end. Stops after maxEvictions evictions.
+	 */
+	void evictDownTo(const metric_type maxWeight, const bool prefix, const size_t maxEvictions) {
+		size_t evictions = 0;
+		const auto evictUntilFits = [&](const id_type &id) {
+			if (evict(id))
+				++evictions;
+			return currentWeight() <= maxWeight || evictions == maxEvictions;
+		};
+		contiguousWeight();
+		const size_t firstMissing = m_ContiguousCount;
+		if (evictDiscardables(evictUntilFits))
+			return;
+		for (size_t i = m_PendingIds.size(); i-- > firstMissing;)
+			if (live(m_PendingIds[i]) && evictUntilFits(m_PendingIds[i].id))
+				return;
+		for (size_t i = firstMissing; prefix && i-- > 0;)
+			if (live(m_PendingIds[i]) && evictUntilFits(m_PendingIds[i].id))
+				return;
+	}
 
-		IdContainer discardables(firstMissing, m_PendingIds.end());
-		discardables.insert(discardables.end(), m_DiscardableIds.begin(), m_DiscardableIds.end());
+	/**
+	 * Calls 'bool evictUntilFits(id)' on the discardable ids in eviction
+	 * order until it returns true. In PRIORITY mode the scan stops as soon as
+	 * enough room is made, oldest job first.
+	 */
+	template<typename Fn>
+	bool evictDiscardables(Fn evictUntilFits) {
+		if (m_EvictionMode == PRIORITY) {
+			for (auto job = m_DiscardableIds.rbegin(); job != m_DiscardableIds.rend(); ++job)
+				for (auto request = job->rbegin(); request != job->rend(); ++request)
+					if (live(*request) && evictUntilFits(request->id))
+						return true;
+			return false;
+		}
+		// lowest credit first, the pending entries are skipped : being
+		// requested again refreshed their credit, they are mostly at the end
+		for (CreditItr entry = m_Credits.begin(); entry != m_Credits.end();) {
+			const id_type id = (entry++)->second; // evicting erases the entry
+			if (!pending(id) && evictUntilFits(id))
+				return true;
+		}
+		return false;
+	}
 
-		const metric_type maxWeight = m_MaxWeight - weight;
-		std::reverse(discardables.begin(), discardables.end());
-		for (const auto &id : discardables) {
-			evict(id);
-			if (currentWeight() <= maxWeight)
-				break;
-		} //
-		D_( std::cout << "} " << currentWeight() << std::endl);
+	inline bool read(const CacheConstItr itr, data_type &data, bool &compressed) const {
+		if (itr == m_Cache.end())
+			return false;
+		data = itr->second.data;
+		compressed = itr->second.state == COMPRESSED;
+		refreshCredit(itr);
+		return true;
+	}
+
+	inline double credit(const metric_type weight, const metric_type cost) const {
+		return m_Inflation + double(cost) / weight;
+	}
+
+	/**
+	 * O(log n) in GREEDY_DUAL_SIZE mode : the entry moves to its new credit
+	 */
+	inline void refreshCredit(const CacheConstItr itr) const {
+		itr->second.credit = credit(itr->second.weight, itr->second.cost);
+		if (m_EvictionMode != GREEDY_DUAL_SIZE)
+			return;
+		m_Credits.erase(itr->second.rank);
+		rank(itr);
 	}
 
-	inline void evict(id_type id) {
+	/**
+	 * The request of a cached id is only replaced by update, which refreshes
+	 * the credit : the key stays valid until the next refresh.
+	 */
+	inline void rank(const CacheConstItr itr) const {
+		const RequestConstItr request = m_Requests.find(itr->first);
+		const Tag tag = request == m_Requests.end() ? Tag { UNREQUESTED, 0 } : request->second;
+		const CreditKey key = { itr->second.credit, tag.epoch, tag.stamp };
+		itr->second.rank = m_Credits.insert(std::make_pair(key, itr->first)).first;
+	}
+
+	inline bool evict(id_type id) {
 		CacheItr itr = m_Cache.find(id);
 		if (itr == m_Cache.end())
-			return; // not found
+			return false; // not found
+		if (m_EvictionMode == GREEDY_DUAL_SIZE) {
+			m_Inflation = std::max(m_Inflation, itr->second.credit);
+			m_Credits.erase(itr->second.rank);
+		}
+		m_Weight -= itr->second.weight;
 		m_Cache.erase(itr);
+		m_Stats.onEvict();
+		m_Tracer.onEvict(id);
+		m_Index.onErase(id);
 		remove(id);
 		D_( std::cout << "\t- " << id << std::endl);
+		return true;
 	}
 
-	inline void addToCache(const id_type &id, const metric_type weight, const data_type &data) {
-		if (!(in(m_PendingIds, id) || in(m_DiscardableIds, id)))
-			m_DiscardableIds.push_back(id);
-		m_Cache.insert(std::make_pair(id, WeightedData(weight, data)));
+	inline void addToCache(const id_type &id, const metric_type weight, const data_type &data, const metric_type cost) {
+		if (m_Requests.find(id) == m_Requests.end()) {
+			if (m_DiscardableIds.empty())
+				m_DiscardableIds.push_back(RequestContainer());
+			request(m_DiscardableIds.back(), id, UNREQUESTED);
+		}
+		m_Weight += weight;
+		const CacheItr itr = m_Cache.insert(std::make_pair(id, WeightedData(weight, data, cost, credit(weight, cost)))).first;
+		if (m_EvictionMode == GREEDY_DUAL_SIZE)
+			rank(itr);
+		m_Index.onInsert(id);
 		D_( std::cout << "+ " << id << std::endl);
 	}
 
 private:
 	metric_type m_MaxWeight;
-	IdContainer m_DiscardableIds;
-	IdContainer m_PendingIds;
+	EvictionMode m_EvictionMode;
+	double m_Inflation; // GreedyDual-Size L value
+	mutable stats_type m_Stats;
+	mutable tracer_type m_Tracer;
+	mutable index_type m_Index;
+	metric_type m_Weight;
+	size_t m_Epoch; // current job
+	size_t m_Stamp; // last request
+	size_t m_Stale; // entries of the lists no longer live
+	RequestIndex m_Requests; // live requests
+	std::deque<RequestContainer> m_DiscardableIds; // most recent job first
+	RequestContainer m_PendingIds;
+	mutable size_t m_ContiguousCount; // pending entries scanned by contiguousWeight
+	mutable size_t m_ContiguousStamp; // stamp of the last entry counted
+	mutable metric_type m_ContiguousWeight;
 	CacheContainer m_Cache;
+	mutable CreditIndex m_Credits;
 };
 
+/**
+ * Walks a copy of the job, collecting the ids update would mark as NEEDED
+ */
+template<typename CACHE, typename WORK_UNIT_RANGE>
+size_t peek_upcoming(const CACHE &cache, const WORK_UNIT_RANGE &job, std::vector<typename CACHE::id_type> &ids, const size_t count) {
+	ids.clear();
+	WORK_UNIT_RANGE upcoming(job);
+	while (ids.size() < count && !upcoming.empty()) {
+		const typename CACHE::id_type id = upcoming.next();
+		const UpdateStatus status = cache.peek(id);
+		if (status == FULL)
+			break;
+		if (status == NEEDED && std::find(ids.begin(), ids.end(), id) == ids.end())
+			ids.push_back(id);
+	}
+	return ids.size();
+}
+
 } // namespace cache
 } // namespace concurrent
 
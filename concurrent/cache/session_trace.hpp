@@ -0,0 +1,211 @@
+/*
+ * session_trace.hpp
+ *
+ *  Text traces of cache sessions, used to replay production sessions and
+ *  synthetic workloads offline.
+ *
+ *  The format extends the 'load decode' timing files found in
+ *  tests/benchmark/data, one record per line :
+ *  - <load ms> <decode ms>               timing of the next frame (ids start at 0)
+ *  - frame <id> <load ms> <decode ms>    timing of a given frame
+ *  - process <us>                        a new job is posted
+ *  - request <us> <id>                   the job asks for id
+ *  - pop <us> <id>                       id is issued to a worker
+ *  - push <us> <id> <accepted>           a worker pushes id
+ *  - get <us> <id> <hit>                 the client reads id
+ *  - evict <us> <id>                     id leaves the cache
+ *  Lines starting with '#' are comments. Timestamps are microseconds since
+ *  the start of the session.
+ *
+ *  A file with timings only describes a linear playback of all the frames.
+ */
+
+#ifndef SESSION_TRACE_HPP_
+#define SESSION_TRACE_HPP_
+
+#include "tracer.hpp"
+
+#include <concurrent/common.hpp>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <cstdint>
+
+namespace concurrent {
+namespace cache {
+
+enum session_event_type {
+	SESSION_PROCESS, SESSION_REQUEST, SESSION_POP, SESSION_PUSH, SESSION_GET, SESSION_EVICT
+};
+
+struct session_event {
+	session_event_type type;
+	uint64_t time; // us
+	uint64_t id;
+	bool flag; // accepted for push, hit for get
+};
+
+struct frame_timing {
+	uint64_t load; // ms
+	uint64_t decode; // ms
+};
+
+struct session_trace {
+	std::map<uint64_t, frame_timing> timings;
+	std::vector<session_event> events;
+
+	/**
+	 * Groups the requests by job, the result has one entry per process event.
+	 */
+	std::vector<std::vector<uint64_t> > jobs() const {
+		std::vector<std::vector<uint64_t> > result;
+		for (const session_event &e : events)
+			if (e.type == SESSION_PROCESS)
+				result.push_back(std::vector<uint64_t>());
+			else if (e.type == SESSION_REQUEST && !result.empty())
+				result.back().push_back(e.id);
+		return result;
+	}
+
+	/**
+	 * Recorded sessions have no timings, the time between pop and push is
+	 * used as load time for the frames without timing.
+	 */
+	void deriveTimings() {
+		std::map<uint64_t, uint64_t> popped;
+		for (const session_event &e : events) {
+			if (e.type == SESSION_POP) {
+				popped[e.id] = e.time;
+			} else if (e.type == SESSION_PUSH && popped.count(e.id) && !timings.count(e.id)) {
+				const frame_timing timing = { (e.time - popped[e.id] + 500) / 1000, 0 };
+				timings[e.id] = timing;
+			}
+		}
+	}
+};
+
+static const char * const SESSION_KEYWORDS[] = { "process", "request", "pop", "push", "get", "evict" };
+
+inline session_trace read_session_trace(std::istream &in) {
+	session_trace trace;
+	uint64_t nextFrame = 0;
+	std::string line;
+	size_t lineNumber = 0;
+	while (std::getline(in, line)) {
+		++lineNumber;
+		std::istringstream fields(line);
+		std::string keyword;
+		if (!(fields >> keyword) || keyword[0] == '#')
+			continue;
+		bool valid = true;
+		if (keyword == "frame") {
+			uint64_t id;
+			frame_timing timing;
+			valid = bool(fields >> id >> timing.load >> timing.decode);
+			trace.timings[id] = timing;
+		} else if (keyword.find_first_not_of("0123456789") == std::string::npos) {
+			frame_timing timing;
+			timing.load = std::stoull(keyword);
+			valid = bool(fields >> timing.decode);
+			trace.timings[nextFrame++] = timing;
+		} else {
+			session_event e = { SESSION_PROCESS, 0, 0, false };
+			size_t type = 0;
+			while (type < sizeof(SESSION_KEYWORDS) / sizeof(SESSION_KEYWORDS[0]) && keyword != SESSION_KEYWORDS[type])
+				++type;
+			e.type = session_event_type(type);
+			valid = type < sizeof(SESSION_KEYWORDS) / sizeof(SESSION_KEYWORDS[0]) && fields >> e.time;
+			if (valid && e.type != SESSION_PROCESS)
+				valid = bool(fields >> e.id);
+			if (valid && (e.type == SESSION_PUSH || e.type == SESSION_GET))
+				valid = bool(fields >> e.flag);
+			trace.events.push_back(e);
+		}
+		if (!valid) {
+			std::ostringstream message;
+			message << "invalid session trace at line " << lineNumber << " : " << line;
+			throw std::runtime_error(message.str());
+		}
+	}
+	return trace;
+}
+
+inline void write_session_event(std::ostream &out, const session_event &e) {
+	out << SESSION_KEYWORDS[e.type] << ' ' << e.time;
+	if (e.type != SESSION_PROCESS)
+		out << ' ' << e.id;
+	if (e.type == SESSION_PUSH || e.type == SESSION_GET)
+		out << ' ' << e.flag;
+	out << '\n';
+}
+
+inline void write_session_trace(std::ostream &out, const session_trace &trace) {
+	for (const auto &pair : trace.timings)
+		out << "frame " << pair.first << ' ' << pair.second.load << ' ' << pair.second.decode << '\n';
+	for (const session_event &e : trace.events)
+		write_session_event(out, e);
+}
+
+/**
+ * Tracer policy recording a session in the text format above. Ids are
+ * converted with trace_key.
+ *
+ * The stream must be attached before the cache is used and outlive it.
+ */
+struct session_recorder : private noncopyable {
+	session_recorder() :
+			m_pOut(nullptr), m_Start(std::chrono::steady_clock::now()) {
+	}
+
+	void attach(std::ostream &out) {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_pOut = &out;
+		m_Start = std::chrono::steady_clock::now();
+		out << "# recorded session\n";
+	}
+
+	inline void onProcess() {
+		record(SESSION_PROCESS, 0, false);
+	}
+	template<typename ID> inline void onRequest(const ID &id) {
+		record(SESSION_REQUEST, trace_key(id), false);
+	}
+	template<typename ID> inline void onIssue(const ID &id) {
+		record(SESSION_POP, trace_key(id), false);
+	}
+	template<typename ID> inline void onPush(const ID &id, bool accepted) {
+		record(SESSION_PUSH, trace_key(id), accepted);
+	}
+	template<typename ID> inline void onGet(const ID &id, bool hit) {
+		record(SESSION_GET, trace_key(id), hit);
+	}
+	template<typename ID> inline void onEvict(const ID &id) {
+		record(SESSION_EVICT, trace_key(id), false);
+	}
+
+private:
+	void record(session_event_type type, uint64_t id, bool flag) {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_pOut)
+			return;
+		const uint64_t time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_Start).count();
+		const session_event e = { type, time, id, flag };
+		write_session_event(*m_pOut, e);
+	}
+
+	std::mutex m_Mutex;
+	std::ostream *m_pOut;
+	std::chrono::steady_clock::time_point m_Start;
+};
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* SESSION_TRACE_HPP_ */
@@ -0,0 +1,305 @@
+/*
+ * tracer.hpp
+ *
+ *  Lifecycle tracing of the cache entries.
+ *
+ *  A tracer policy is notified when a new job is processed, when an id is
+ *  requested by the job, issued to a worker, pushed, read and evicted.
+ *  It must provide the following member functions :
+ *  - void onProcess(); called by the thread posting the job
+ *  - template<typename ID> void onRequest(const ID&);
+ *  - template<typename ID> void onIssue(const ID&);
+ *  - template<typename ID> void onPush(const ID&, bool accepted);
+ *  - template<typename ID> void onGet(const ID&, bool hit);
+ *  - template<typename ID> void onEvict(const ID&);
+ *  All but onProcess are called with the cache lock held.
+ */
+
+#ifndef CACHE_TRACER_HPP_
+#define CACHE_TRACER_HPP_
+
+#include <concurrent/common.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <istream>
+#include <ostream>
+#include <cstdint>
+#include <cstring>
+
+namespace concurrent {
+namespace cache {
+
+/**
+ * Default policy, does nothing
+ */
+struct no_tracer {
+	inline void onProcess() {}
+	template<typename ID> inline void onRequest(const ID&) {}
+	template<typename ID> inline void onIssue(const ID&) {}
+	template<typename ID> inline void onPush(const ID&, bool) {}
+	template<typename ID> inline void onGet(const ID&, bool) {}
+	template<typename ID> inline void onEvict(const ID&) {}
+};
+
+enum trace_event_type {
+	TRACE_ISSUE, TRACE_PUSH, TRACE_REJECT, TRACE_GET, TRACE_EVICT
+};
+
+struct trace_event {
+	uint64_t timestamp; // ns since the tracer creation
+	uint64_t key;
+	uint32_t thread;
+	uint32_t type; // trace_event_type
+};
+
+/**
+ * Maps an id to the 64 bits key stored in the trace. Overload this function
+ * in the namespace of your id type for a meaningful key.
+ */
+template<typename ID>
+inline typename std::enable_if<std::is_integral<ID>::value, uint64_t>::type trace_key(const ID &id) {
+	return uint64_t(id);
+}
+
+template<typename ID>
+inline uint64_t trace_key(ID * const &id) {
+	return uint64_t(reinterpret_cast<uintptr_t>(id));
+}
+
+template<typename ID>
+inline typename std::enable_if<!std::is_integral<ID>::value && !std::is_pointer<ID>::value, uint64_t>::type trace_key(const ID &id) {
+	return std::hash<ID>()(id);
+}
+
+static const char TRACE_MAGIC[8] = { 'C', 'C', 'T', 'R', 'A', 'C', 'E', '1' };
+
+/**
+ * Binary layout : magic, event count, events as stored in memory
+ */
+inline void write_binary_trace(std::ostream &out, const std::vector<trace_event> &events) {
+	const uint64_t count = events.size();
+	out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	if (count)
+		out.write(reinterpret_cast<const char*>(&events[0]), count * sizeof(trace_event));
+}
+
+inline bool read_binary_trace(std::istream &in, std::vector<trace_event> &events) {
+	char magic[sizeof(TRACE_MAGIC)];
+	uint64_t count = 0;
+	if (!in.read(magic, sizeof(magic)) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)
+		return false;
+	if (!in.read(reinterpret_cast<char*>(&count), sizeof(count)))
+		return false;
+	events.resize(count);
+	return count == 0 || in.read(reinterpret_cast<char*>(&events[0]), count * sizeof(trace_event));
+}
+
+inline void write_chrome_trace(std::ostream &out, const std::vector<trace_event> &events) {
+	static const char * const names[] = { "issue", "push", "reject", "get", "evict" };
+	out << "{\"traceEvents\":[";
+	for (size_t i = 0; i < events.size(); ++i) {
+		const trace_event &e = events[i];
+		out << (i ? "," : "") << "\n{\"name\":\"" << names[e.type] << "\",\"cat\":\"cache\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1";
+		out << ",\"tid\":" << e.thread << ",\"ts\":" << e.timestamp / 1000. << ",\"args\":{\"id\":" << e.key << "}}";
+	}
+	out << "\n]}\n";
+}
+
+/**
+ * Records events in per thread ring buffers of CAPACITY events, older events
+ * are overwritten. Recording is a few stores, no lock is taken.
+ *
+ * Flushing reads the buffers of all threads, it is meant to be done while
+ * the workers are idle.
+ */
+template<size_t CAPACITY = 1 << 16>
+struct ring_tracer : private noncopyable {
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+	ring_tracer() :
+			m_Serial(nextSerial()), m_Origin(std::chrono::steady_clock::now()) {
+	}
+
+	inline void onProcess() {}
+	template<typename ID> inline void onRequest(const ID&) {}
+	template<typename ID> inline void onIssue(const ID &id) {
+		record(TRACE_ISSUE, trace_key(id));
+	}
+	template<typename ID> inline void onPush(const ID &id, bool accepted) {
+		record(accepted ? TRACE_PUSH : TRACE_REJECT, trace_key(id));
+	}
+	template<typename ID> inline void onGet(const ID &id, bool hit) {
+		if (hit)
+			record(TRACE_GET, trace_key(id));
+	}
+	template<typename ID> inline void onEvict(const ID &id) {
+		record(TRACE_EVICT, trace_key(id));
+	}
+
+	/**
+	 * All recorded events sorted by timestamp
+	 */
+	std::vector<trace_event> events() const {
+		std::vector<trace_event> result;
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (const auto &pRing : m_Rings) {
+			const uint64_t head = pRing->head.load(std::memory_order_acquire);
+			const uint64_t first = head > CAPACITY ? head - CAPACITY : 0;
+			for (uint64_t i = first; i < head; ++i)
+				result.push_back(pRing->events[i & (CAPACITY - 1)]);
+		}
+		std::stable_sort(result.begin(), result.end(), [](const trace_event &a, const trace_event &b) {
+			return a.timestamp < b.timestamp;
+		});
+		return result;
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (const auto &pRing : m_Rings)
+			pRing->head.store(0, std::memory_order_release);
+	}
+
+	void writeBinary(std::ostream &out) const {
+		write_binary_trace(out, events());
+	}
+
+	void writeChromeTrace(std::ostream &out) const {
+		write_chrome_trace(out, events());
+	}
+
+private:
+	struct ring {
+		ring(uint32_t thread) :
+				head(0), thread(thread), events(CAPACITY) {
+		}
+		std::atomic<uint64_t> head;
+		const uint32_t thread;
+		std::vector<trace_event> events;
+	};
+
+	struct local_ring {
+		uint64_t serial;
+		ring *pRing;
+	};
+
+	inline static uint64_t nextSerial() {
+		static std::atomic<uint64_t> serial(0);
+		return ++serial;
+	}
+
+	inline void record(trace_event_type type, uint64_t key) {
+		ring &r = localRing();
+		const uint64_t head = r.head.load(std::memory_order_relaxed);
+		trace_event &e = r.events[head & (CAPACITY - 1)];
+		e.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Origin).count();
+		e.key = key;
+		e.thread = r.thread;
+		e.type = type;
+		r.head.store(head + 1, std::memory_order_release);
+	}
+
+	ring& localRing() {
+		// serials are never reused so a stale entry can't match a new tracer
+		static thread_local std::vector<local_ring> rings;
+		for (const local_ring &local : rings)
+			if (local.serial == m_Serial)
+				return *local.pRing;
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Rings.emplace_back(new ring(uint32_t(m_Rings.size() + 1)));
+		const local_ring local = { m_Serial, m_Rings.back().get() };
+		rings.push_back(local);
+		return *local.pRing;
+	}
+
+	const uint64_t m_Serial;
+	const std::chrono::steady_clock::time_point m_Origin;
+	mutable std::mutex m_Mutex;
+	std::deque<std::unique_ptr<ring> > m_Rings;
+};
+
+struct trace_report {
+	uint64_t issued;
+	uint64_t pushed;
+	uint64_t rejected;
+	uint64_t read; // pushed entries read at least once
+	uint64_t wasted; // pushed entries evicted without being read
+	std::vector<uint64_t> leadTimes; // ns between push and first get, sorted
+	std::vector<uint64_t> processTimes; // ns between issue and push, sorted
+
+	trace_report() :
+			issued(0), pushed(0), rejected(0), read(0), wasted(0) {
+	}
+
+	static uint64_t percentile(const std::vector<uint64_t> &sorted, double p) {
+		return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+	}
+};
+
+/**
+ * Computes lead time and wasted work from time ordered events
+ */
+inline trace_report analyze_trace(const std::vector<trace_event> &events) {
+	struct lifecycle {
+		uint64_t issuedAt;
+		uint64_t pushedAt;
+		bool issued;
+		bool cached;
+		bool read;
+	};
+	trace_report report;
+	std::map<uint64_t, lifecycle> entries;
+	for (const trace_event &e : events) {
+		lifecycle &entry = entries.insert(std::make_pair(e.key, lifecycle())).first->second;
+		switch (e.type) {
+			case TRACE_ISSUE:
+				++report.issued;
+				entry.issued = true;
+				entry.issuedAt = e.timestamp;
+				break;
+			case TRACE_PUSH:
+				++report.pushed;
+				if (entry.issued)
+					report.processTimes.push_back(e.timestamp - entry.issuedAt);
+				entry.issued = false;
+				entry.cached = true;
+				entry.read = false;
+				entry.pushedAt = e.timestamp;
+				break;
+			case TRACE_REJECT:
+				++report.rejected;
+				entry.issued = false;
+				break;
+			case TRACE_GET:
+				if (entry.cached && !entry.read) {
+					++report.read;
+					entry.read = true;
+					report.leadTimes.push_back(e.timestamp - entry.pushedAt);
+				}
+				break;
+			case TRACE_EVICT:
+				if (entry.cached && !entry.read)
+					++report.wasted;
+				entry.cached = false;
+				break;
+		}
+	}
+	std::sort(report.leadTimes.begin(), report.leadTimes.end());
+	std::sort(report.processTimes.begin(), report.processTimes.end());
+	return report;
+}
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* CACHE_TRACER_HPP_ */
@@ -8,8 +8,20 @@
 #ifndef COMMON_HPP_
 #define COMMON_HPP_
 
+#include <chrono>
+#include <cstdlib>
 #include <stdexcept>
 
+/**
+ * The throwing members abort instead when exceptions are disabled, use the
+ * status returning overloads there.
+ */
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define CONCURRENT_THROW(exception) throw exception
+#else
+#define CONCURRENT_THROW(exception) std::abort()
+#endif
+
 namespace concurrent {
 
 /**
@@ -17,12 +29,37 @@ namespace concurrent {
  */
 struct terminated : public std::exception {};
 
+/**
+ * Outcome of the status returning pops, e.g. pop(value, std::nothrow).
+ * TIMEOUT is also returned by the try versions when there is nothing to pop.
+ */
+enum class pop_status {
+	OK, TERMINATED, TIMEOUT
+};
+
 struct noncopyable {
 	noncopyable() = default;
 	noncopyable(const noncopyable&) = delete;
 	noncopyable & operator=(const noncopyable&) = delete;
 };
 
+namespace details {
+
+typedef std::chrono::steady_clock clock_type;
+
+/**
+ * Saturates instead of overflowing for huge timeouts
+ */
+template<typename Rep, typename Period>
+inline clock_type::time_point deadline_after(const std::chrono::duration<Rep, Period> &timeout) {
+	const clock_type::time_point now = clock_type::now();
+	if (std::chrono::duration<double>(timeout) >= std::chrono::duration<double>(clock_type::time_point::max() - now))
+		return clock_type::time_point::max();
+	return now + std::chrono::duration_cast<clock_type::duration>(timeout);
+}
+
+} // namespace details
+
 }
 
 #endif /* COMMON_HPP_ */
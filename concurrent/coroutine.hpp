@@ -0,0 +1,234 @@
+/*
+ * coroutine.hpp
+ *
+ *  C++20 awaitables suspending a coroutine instead of blocking a thread :
+ *
+ *  int value = co_await concurrent::async_pop(queue, executor);
+ *  Job job = co_await concurrent::async_get(slot, executor);
+ *  id_type id = co_await concurrent::async_pop(cache, executor);
+ *  data_type data = co_await concurrent::async_get(cache, id, executor);
+ *
+ *  The awaitables complete right away when they can, otherwise the
+ *  coroutine is resumed on the executor : anything with a 'post(F)' member
+ *  taking a 'void()' callable. They throw terminated like their blocking
+ *  counterparts.
+ *
+ *  The rest of the library is C++11, only this header needs C++20.
+ */
+
+#ifndef CONCURRENT_COROUTINE_HPP_
+#define CONCURRENT_COROUTINE_HPP_
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+#error "concurrent/coroutine.hpp needs C++20 coroutines"
+#endif
+
+#include "common.hpp"
+
+#include <coroutine>
+
+namespace concurrent {
+
+/**
+ * Resumes the coroutines on the thread completing the operation, e.g. the
+ * one pushing into the queue. They must not block.
+ */
+struct inline_executor {
+	template<typename F>
+	void post(F &&f) {
+		f();
+	}
+};
+
+template<typename T, typename WAIT>
+struct slot;
+
+namespace details {
+
+/**
+ * Derived provides 'bool attempt(ready)', completing the operation or
+ * registering 'ready' to be called when it is worth attempting again.
+ */
+template<typename Derived, typename Executor>
+struct retrying_awaitable {
+	explicit retrying_awaitable(Executor &executor) :
+			m_Executor(executor), m_Terminated(false) {
+	}
+
+	bool await_ready() const noexcept {
+		return false;
+	}
+
+	bool await_suspend(std::coroutine_handle<> handle) {
+		try {
+			return !static_cast<Derived*>(this)->attempt([this, handle]() {
+				m_Executor.post([this, handle]() {
+					if (!await_suspend(handle))
+						handle.resume();
+				});
+			});
+		} catch (terminated&) {
+			m_Terminated = true;
+			return false;
+		}
+	}
+
+protected:
+	void checkTermination() const {
+		if (m_Terminated)
+			throw terminated();
+	}
+
+private:
+	Executor &m_Executor;
+	bool m_Terminated;
+};
+
+template<typename Queue, typename Executor>
+struct queue_pop_awaitable: public retrying_awaitable<queue_pop_awaitable<Queue, Executor>, Executor> {
+	typedef typename Queue::value_type value_type;
+
+	queue_pop_awaitable(Queue &queue, Executor &executor) :
+			retrying_awaitable<queue_pop_awaitable, Executor>(executor), m_Queue(queue), m_Value() {
+	}
+
+	template<typename Ready>
+	bool attempt(const Ready &ready) {
+		return m_Queue.popOrNotify(m_Value, ready);
+	}
+
+	value_type await_resume() {
+		this->checkTermination();
+		return m_Value;
+	}
+
+private:
+	Queue &m_Queue;
+	value_type m_Value;
+};
+
+template<typename Slot, typename T, typename Executor>
+struct slot_get_awaitable: public retrying_awaitable<slot_get_awaitable<Slot, T, Executor>, Executor> {
+	slot_get_awaitable(Slot &slot, Executor &executor) :
+			retrying_awaitable<slot_get_awaitable, Executor>(executor), m_Slot(slot), m_Value() {
+	}
+
+	template<typename Ready>
+	bool attempt(const Ready &ready) {
+		return m_Slot.getOrNotify(m_Value, ready);
+	}
+
+	T await_resume() {
+		this->checkTermination();
+		return m_Value;
+	}
+
+private:
+	Slot &m_Slot;
+	T m_Value;
+};
+
+template<typename Cache, typename Executor>
+struct cache_pop_awaitable: public retrying_awaitable<cache_pop_awaitable<Cache, Executor>, Executor> {
+	typedef typename Cache::id_type id_type;
+
+	cache_pop_awaitable(Cache &cache, Executor &executor) :
+			retrying_awaitable<cache_pop_awaitable, Executor>(executor), m_Cache(cache), m_Id() {
+	}
+
+	template<typename Ready>
+	bool attempt(const Ready &ready) {
+		return m_Cache.popOrNotify(m_Id, ready);
+	}
+
+	id_type await_resume() {
+		this->checkTermination();
+		return m_Id;
+	}
+
+private:
+	Cache &m_Cache;
+	id_type m_Id;
+};
+
+/**
+ * The pushing thread hands the data over, no need to attempt again
+ */
+template<typename Cache, typename Executor>
+struct cache_get_awaitable {
+	typedef typename Cache::id_type id_type;
+	typedef typename Cache::data_type data_type;
+
+	cache_get_awaitable(Cache &cache, const id_type &id, Executor &executor) :
+			m_Cache(cache), m_Id(id), m_Executor(executor), m_Data(), m_Terminated(false) {
+	}
+
+	bool await_ready() const noexcept {
+		return false;
+	}
+
+	bool await_suspend(std::coroutine_handle<> handle) {
+		return !m_Cache.getOrNotify(m_Id, m_Data, [this, handle](const data_type *data) {
+			if (data)
+				m_Data = *data;
+			else
+				m_Terminated = true;
+			m_Executor.post([handle]() {
+				handle.resume();
+			});
+		});
+	}
+
+	data_type await_resume() {
+		if (m_Terminated)
+			throw terminated();
+		return m_Data;
+	}
+
+private:
+	Cache &m_Cache;
+	const id_type m_Id;
+	Executor &m_Executor;
+	data_type m_Data;
+	bool m_Terminated;
+};
+
+} // namespace details
+
+/**
+ * Works with every queue built on details::queue_base
+ */
+template<typename Queue, typename Executor>
+details::queue_pop_awaitable<Queue, Executor> async_pop(Queue &queue, Executor &executor) {
+	return details::queue_pop_awaitable<Queue, Executor>(queue, executor);
+}
+
+template<typename T, typename WAIT, typename Executor>
+details::slot_get_awaitable<slot<T, WAIT>, T, Executor> async_get(slot<T, WAIT> &slot, Executor &executor) {
+	return details::slot_get_awaitable<concurrent::slot<T, WAIT>, T, Executor>(slot, executor);
+}
+
+namespace cache {
+
+template<typename ID_TYPE, typename METRIC_TYPE, typename DATA_TYPE, typename WORK_UNIT_RANGE, typename POLICY>
+struct lookahead_cache;
+
+template<typename ID_TYPE, typename METRIC_TYPE, typename DATA_TYPE, typename WORK_UNIT_RANGE, typename POLICY, typename Executor>
+concurrent::details::cache_pop_awaitable<lookahead_cache<ID_TYPE, METRIC_TYPE, DATA_TYPE, WORK_UNIT_RANGE, POLICY>, Executor> async_pop(
+		lookahead_cache<ID_TYPE, METRIC_TYPE, DATA_TYPE, WORK_UNIT_RANGE, POLICY> &cache, Executor &executor) {
+	return concurrent::details::cache_pop_awaitable<lookahead_cache<ID_TYPE, METRIC_TYPE, DATA_TYPE, WORK_UNIT_RANGE, POLICY>, Executor>(cache, executor);
+}
+
+/**
+ * Completes once id is cached or pushed
+ */
+template<typename ID_TYPE, typename METRIC_TYPE, typename DATA_TYPE, typename WORK_UNIT_RANGE, typename POLICY, typename Executor>
+concurrent::details::cache_get_awaitable<lookahead_cache<ID_TYPE, METRIC_TYPE, DATA_TYPE, WORK_UNIT_RANGE, POLICY>, Executor> async_get(
+		lookahead_cache<ID_TYPE, METRIC_TYPE, DATA_TYPE, WORK_UNIT_RANGE, POLICY> &cache, const ID_TYPE &id, Executor &executor) {
+	return concurrent::details::cache_get_awaitable<lookahead_cache<ID_TYPE, METRIC_TYPE, DATA_TYPE, WORK_UNIT_RANGE, POLICY>, Executor>(cache, id, executor);
+}
+
+} // namespace cache
+} // namespace concurrent
+
+#endif /* CONCURRENT_COROUTINE_HPP_ */
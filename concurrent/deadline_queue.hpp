@@ -0,0 +1,164 @@
+/*
+ * deadline_queue.hpp
+ *
+ *  Concurrent queue serving the elements by deadline.
+ */
+
+#ifndef DEADLINE_QUEUE_HPP_
+#define DEADLINE_QUEUE_HPP_
+
+#include "priority_queue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+namespace concurrent {
+
+template<typename T, typename Clock = std::chrono::steady_clock>
+struct deadline_entry {
+    typedef typename Clock::time_point time_point;
+
+    time_point deadline;
+    T value;
+
+    deadline_entry() : deadline(), value() {
+    }
+    deadline_entry(time_point deadline, const T& value) : deadline(deadline), value(value) {
+    }
+
+    bool operator==(const deadline_entry &other) const {
+        return deadline == other.deadline && value == other.value;
+    }
+};
+
+template<typename Entry>
+struct later_deadline {
+    inline bool operator()(const Entry &a, const Entry &b) const {
+        return a.deadline > b.deadline;
+    }
+};
+
+/**
+ * Unbounded concurrent queue of deadline_entry, earliest deadline first.
+ *
+ * - pop returns the entry with the earliest deadline as soon as there is one
+ * - waitDue blocks until the earliest deadline is reached, waking up earlier
+ *   if an entry with a closer deadline is pushed or updated
+ */
+template<typename T, typename Clock = std::chrono::steady_clock, typename Policy = default_queue_policy>
+struct deadline_queue : public details::heap_queue<deadline_queue<T, Clock, Policy>, deadline_entry<T, Clock>, later_deadline<deadline_entry<T, Clock> >, std::vector<deadline_entry<T, Clock> >, Policy> {
+    typedef deadline_entry<T, Clock> entry_type;
+    typedef typename entry_type::time_point time_point;
+
+    using deadline_queue::heap_queue::push;
+
+    void push(time_point deadline, const T &value) {
+        this->push(entry_type(deadline, value));
+    }
+
+    /**
+     * Moves the deadline of the first entry holding value, returns false if
+     * not found.
+     */
+    bool reschedule(const T &value, time_point deadline) {
+        std::unique_lock<details::mutex_type> lock(this->acquire());
+        this->checkTermination();
+        bool found = false;
+        this->m_container.updateAll([&](entry_type &entry) {
+            if (!found && entry.value == value) {
+                entry.deadline = deadline;
+                found = true;
+            }
+        });
+        this->m_not_empty.notify_all();
+        return found;
+    }
+
+    void waitDue(entry_type &entry) {
+        if (waitDueUntil(entry, nullptr) == pop_status::TERMINATED)
+            CONCURRENT_THROW(terminated());
+    }
+
+    /**
+     * Status returning waitDue, see queue_base::pop
+     */
+    pop_status waitDue(entry_type &entry, const std::nothrow_t&) {
+        return waitDueUntil(entry, nullptr);
+    }
+
+    /**
+     * Returns pop_status::TIMEOUT if no entry is due within timeout
+     */
+    template<typename Rep, typename Period>
+    pop_status waitDue(entry_type &entry, const std::chrono::duration<Rep, Period> &timeout) {
+        const details::clock_type::time_point deadline = details::deadline_after(timeout);
+        return waitDueUntil(entry, &deadline);
+    }
+
+    bool tryPopDue(entry_type &entry) {
+        const pop_status status = tryPopDue(entry, std::nothrow);
+        if (status == pop_status::TERMINATED)
+            CONCURRENT_THROW(terminated());
+        return status == pop_status::OK;
+    }
+
+    pop_status tryPopDue(entry_type &entry, const std::nothrow_t&) {
+        std::unique_lock<details::mutex_type> lock(this->acquire());
+        if (this->is_terminated())
+            return pop_status::TERMINATED;
+        if (!this->is_not_empty() || this->m_container.top().deadline > Clock::now()) {
+            this->m_stats.onEmpty();
+            return pop_status::TIMEOUT;
+        }
+        entry = this->m_container.pop();
+        this->m_stats.onPop(1, this->m_container.size());
+        return pop_status::OK;
+    }
+
+private:
+    /**
+     * Pops the earliest entry once it is due, waiting until timeout, or
+     * forever if timeout is null or time_point::max(). Returns TIMEOUT or
+     * TERMINATED instead of throwing.
+     */
+    pop_status waitDueUntil(entry_type &entry, const details::clock_type::time_point *timeout) {
+        if (timeout && *timeout == details::clock_type::time_point::max())
+            timeout = nullptr;
+        std::unique_lock<details::mutex_type> lock(this->acquire());
+        const typename deadline_queue::stats_type::stopwatch_type watch;
+        bool waited = false;
+        for (;;) {
+            if (this->is_terminated())
+                return pop_status::TERMINATED;
+            time_point wakeUp = time_point::max();
+            if (this->is_not_empty()) {
+                wakeUp = this->m_container.top().deadline;
+                if (wakeUp <= Clock::now())
+                    break;
+            }
+            if (timeout) {
+                const details::clock_type::time_point now = details::clock_type::now();
+                if (now >= *timeout)
+                    return pop_status::TIMEOUT;
+                // the timeout is on the library clock, the deadlines on Clock
+                const time_point limit = Clock::now() + std::chrono::duration_cast<typename Clock::duration>(*timeout - now);
+                wakeUp = std::min(wakeUp, limit);
+            }
+            if (wakeUp == time_point::max())
+                this->m_not_empty.wait(lock);
+            else
+                this->m_not_empty.wait_until(lock, wakeUp);
+            waited = true;
+        }
+        if (waited)
+            this->m_stats.onPopWait(watch.elapsed());
+        entry = this->m_container.pop();
+        this->m_stats.onPop(1, this->m_container.size());
+        return pop_status::OK;
+    }
+};
+
+} // namespace concurrent
+
+#endif /* DEADLINE_QUEUE_HPP_ */
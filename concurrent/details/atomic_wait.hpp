@@ -0,0 +1,218 @@
+/*
+ * atomic_wait.hpp
+ *
+ *  Blocking on a 32 bits atomic word until it changes, the building block
+ *  of the mutex free synchronization objects.
+ *
+ *  Uses a Linux futex, C++20 std::atomic::wait elsewhere, or a table of
+ *  mutex/condition pairs as a last resort. Define CONCURRENT_NO_FUTEX to
+ *  skip the futex.
+ */
+
+#ifndef ATOMIC_WAIT_HPP_
+#define ATOMIC_WAIT_HPP_
+
+#include <concurrent/common.hpp>
+#include <concurrent/wait_strategy.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__linux__) && !defined(CONCURRENT_NO_FUTEX)
+#define CONCURRENT_FUTEX
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif !defined(__cpp_lib_atomic_wait)
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace concurrent {
+namespace details {
+
+typedef std::atomic<uint32_t> wait_word;
+
+#if !defined(CONCURRENT_FUTEX) && !defined(__cpp_lib_atomic_wait)
+struct parking_bucket {
+	std::mutex mutex;
+	std::condition_variable condition;
+};
+
+inline parking_bucket& parking_for(const void *address) {
+	static parking_bucket buckets[64];
+	return buckets[(reinterpret_cast<uintptr_t>(address) >> 4) % 64];
+}
+#endif
+
+/**
+ * Blocks while word == expected, may return spuriously
+ */
+inline void atomic_wait(wait_word &word, const uint32_t expected) {
+#if defined(CONCURRENT_FUTEX)
+	static_assert(sizeof(wait_word) == sizeof(uint32_t), "futex needs a plain 32 bits word");
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#elif defined(__cpp_lib_atomic_wait)
+	word.wait(expected, std::memory_order_acquire);
+#else
+	parking_bucket &bucket = parking_for(&word);
+	std::unique_lock<std::mutex> lock(bucket.mutex);
+	if (word.load(std::memory_order_acquire) == expected)
+		bucket.condition.wait(lock);
+#endif
+}
+
+/**
+ * Same as atomic_wait, also returns once the deadline is reached
+ */
+inline void atomic_wait_until(wait_word &word, const uint32_t expected, const clock_type::time_point &deadline) {
+	const clock_type::time_point now = clock_type::now();
+	if (now >= deadline)
+		return;
+	const std::chrono::nanoseconds timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now);
+#if defined(CONCURRENT_FUTEX)
+	timespec relative;
+	relative.tv_sec = time_t(timeout.count() / 1000000000);
+	relative.tv_nsec = long(timeout.count() % 1000000000);
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, &relative, nullptr, 0);
+#elif defined(__cpp_lib_atomic_wait)
+	// std::atomic::wait has no timeout, polling
+	if (word.load(std::memory_order_acquire) == expected)
+		std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(timeout, std::chrono::milliseconds(1)));
+#else
+	parking_bucket &bucket = parking_for(&word);
+	std::unique_lock<std::mutex> lock(bucket.mutex);
+	if (word.load(std::memory_order_acquire) == expected)
+		bucket.condition.wait_for(lock, timeout);
+#endif
+}
+
+inline void atomic_notify_one(wait_word &word) {
+#if defined(CONCURRENT_FUTEX)
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#elif defined(__cpp_lib_atomic_wait)
+	word.notify_one();
+#else
+	// buckets are shared, everybody checks its own word
+	parking_bucket &bucket = parking_for(&word);
+	std::lock_guard<std::mutex> lock(bucket.mutex);
+	bucket.condition.notify_all();
+#endif
+}
+
+inline void atomic_notify_all(wait_word &word) {
+#if defined(CONCURRENT_FUTEX)
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#elif defined(__cpp_lib_atomic_wait)
+	word.notify_all();
+#else
+	parking_bucket &bucket = parking_for(&word);
+	std::lock_guard<std::mutex> lock(bucket.mutex);
+	bucket.condition.notify_all();
+#endif
+}
+
+/**
+ * Waits for a word to change according to a wait strategy, see
+ * wait_strategy.hpp. Keeps count of the parked threads so that notifiers
+ * only enter the kernel when needed.
+ */
+template<typename WAIT>
+struct atomic_waiter: private noncopyable {
+	atomic_waiter() :
+			m_SpinLimit(WAIT::min_spins), m_Parked(0) {
+	}
+
+	/**
+	 * Returns once word != expected, or spuriously
+	 */
+	void wait(wait_word &word, const uint32_t expected) {
+		if (!spin(word, expected))
+			return;
+		m_Parked.fetch_add(1);
+		if (word.load() == expected)
+			atomic_wait(word, expected);
+		m_Parked.fetch_sub(1);
+	}
+
+	/**
+	 * Returns once word != expected, the deadline is reached, or spuriously
+	 */
+	void wait_until(wait_word &word, const uint32_t expected, const clock_type::time_point &deadline) {
+		if (!WAIT::parks) {
+			while (word.load(std::memory_order_acquire) == expected && clock_type::now() < deadline)
+				cpu_relax();
+			return;
+		}
+		if (!spin(word, expected))
+			return;
+		m_Parked.fetch_add(1);
+		if (word.load() == expected)
+			atomic_wait_until(word, expected, deadline);
+		m_Parked.fetch_sub(1);
+	}
+
+	/**
+	 * To be called after word is modified
+	 */
+	inline void notify_one(wait_word &word) {
+		if (m_Parked.load())
+			atomic_notify_one(word);
+	}
+
+	inline void notify_all(wait_word &word) {
+		if (m_Parked.load())
+			atomic_notify_all(word);
+	}
+
+private:
+	/**
+	 * Spins then yields according to WAIT, returns true if the thread has
+	 * to park
+	 */
+	bool spin(wait_word &word, const uint32_t expected) {
+		if (!WAIT::parks) {
+			while (word.load(std::memory_order_acquire) == expected)
+				cpu_relax();
+			return false;
+		}
+		const unsigned limit = m_SpinLimit.load(std::memory_order_relaxed);
+		for (unsigned i = 0; i < limit; ++i) {
+			cpu_relax();
+			if (word.load(std::memory_order_acquire) != expected) {
+				adapt(limit, true);
+				return false;
+			}
+		}
+		for (unsigned i = 0; i < WAIT::yields; ++i) {
+			std::this_thread::yield();
+			if (word.load(std::memory_order_acquire) != expected) {
+				adapt(limit, false);
+				return false;
+			}
+		}
+		adapt(limit, false);
+		return true;
+	}
+
+	void adapt(const unsigned limit, const bool success) {
+		if (!WAIT::max_spins)
+			return;
+		const unsigned minSpins = WAIT::min_spins;
+		const unsigned maxSpins = WAIT::max_spins;
+		m_SpinLimit.store(success ? std::min(maxSpins, limit * 2) : std::max(minSpins, limit / 2), std::memory_order_relaxed);
+	}
+
+	std::atomic<unsigned> m_SpinLimit;
+	std::atomic<uint32_t> m_Parked;
+};
+
+} // namespace details
+} // namespace concurrent
+
+#endif /* ATOMIC_WAIT_HPP_ */
@@ -0,0 +1,236 @@
+/*
+ * io_uring.hpp
+ *
+ *  Minimal io_uring ring on top of the raw system calls, only what the
+ *  cache loader needs : reads and no-ops. Reads go through IORING_OP_READV,
+ *  supported since Linux 5.1 like io_uring itself. Define
+ *  CONCURRENT_NO_IO_URING to leave it out.
+ */
+
+#ifndef IO_URING_HPP_
+#define IO_URING_HPP_
+
+#include <concurrent/common.hpp>
+
+#if defined(__linux__) && !defined(CONCURRENT_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CONCURRENT_IO_URING
+#endif
+#endif
+
+#ifdef CONCURRENT_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+
+namespace concurrent {
+namespace details {
+
+/**
+ * One thread may submit while another one waits for completions, several
+ * submitters have to be serialized by the caller.
+ */
+struct io_ring: private noncopyable {
+	/**
+	 * Throws std::system_error if the kernel does not support io_uring
+	 */
+	explicit io_ring(unsigned entries) :
+			m_Fd(-1), m_SqRing(MAP_FAILED), m_CqRing(MAP_FAILED), m_Sqes(MAP_FAILED), m_SqRingSize(0), m_CqRingSize(0), m_SqesSize(0) {
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		m_Fd = int(syscall(__NR_io_uring_setup, entries, &params));
+		if (m_Fd < 0)
+			throw std::system_error(errno, std::system_category(), "io_uring_setup");
+		m_SqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		m_SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+		if (singleMap)
+			m_SqRingSize = m_CqRingSize = std::max(m_SqRingSize, m_CqRingSize);
+		m_SqRing = map(m_SqRingSize, IORING_OFF_SQ_RING);
+		m_CqRing = singleMap ? m_SqRing : map(m_CqRingSize, IORING_OFF_CQ_RING);
+		m_Sqes = map(m_SqesSize, IORING_OFF_SQES);
+
+		char * const sq = static_cast<char*>(m_SqRing);
+		m_SqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+		m_SqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		m_SqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		m_SqEntries = params.sq_entries;
+		m_SqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		char * const cq = static_cast<char*>(m_CqRing);
+		m_CqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		m_CqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		m_CqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		m_Cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+		m_SqLocalTail = *m_SqTail;
+		m_Pending = 0;
+	}
+
+	~io_ring() {
+		release();
+	}
+
+	/**
+	 * Queues a read, returns false if the submission queue is full. vector
+	 * must stay valid until the read completes.
+	 */
+	bool prepareRead(int fd, const iovec *vector, uint64_t offset, uint64_t userData) {
+		io_uring_sqe * const sqe = next();
+		if (!sqe)
+			return false;
+		sqe->opcode = IORING_OP_READV;
+		sqe->fd = fd;
+		sqe->addr = reinterpret_cast<uintptr_t>(vector);
+		sqe->len = 1;
+		sqe->off = offset;
+		sqe->user_data = userData;
+		return true;
+	}
+
+	bool prepareNop(uint64_t userData) {
+		io_uring_sqe * const sqe = next();
+		if (!sqe)
+			return false;
+		sqe->opcode = IORING_OP_NOP;
+		sqe->user_data = userData;
+		return true;
+	}
+
+	/**
+	 * Hands the prepared requests to the kernel, in a single system call
+	 * unless it takes them in several steps. Returns the number of requests
+	 * taken, in preparation order. On failure the requests the kernel did
+	 * not take are dropped, they will never complete, and the error is
+	 * thrown if it took none.
+	 */
+	unsigned submit() {
+		// the kernel reads the entries up to the published tail
+		__atomic_store_n(m_SqTail, m_SqLocalTail, __ATOMIC_RELEASE);
+		const unsigned prepared = m_Pending;
+		while (m_Pending) {
+			const int submitted = enter(m_Pending, 0, 0);
+			if (submitted < 0) {
+				// the kernel only consumes entries within io_uring_enter, rewinding is safe
+				m_SqLocalTail = __atomic_load_n(m_SqHead, __ATOMIC_ACQUIRE);
+				__atomic_store_n(m_SqTail, m_SqLocalTail, __ATOMIC_RELEASE);
+				const unsigned taken = prepared - m_Pending;
+				m_Pending = 0;
+				if (!taken)
+					throw std::system_error(-submitted, std::system_category(), "io_uring_enter");
+				return taken;
+			}
+			m_Pending -= submitted;
+		}
+		return prepared;
+	}
+
+	/**
+	 * Calls 'void fn(uint64_t userData, int result)' for each completion,
+	 * blocks until there is at least one. Returns the number of completions.
+	 */
+	template<typename Fn>
+	size_t reap(Fn fn) {
+		for (;;) {
+			const size_t count = poll(fn);
+			if (count)
+				return count;
+			const int result = enter(0, 1, IORING_ENTER_GETEVENTS);
+			if (result < 0 && result != -EINTR && result != -EAGAIN)
+				throw std::system_error(-result, std::system_category(), "io_uring_enter");
+		}
+	}
+
+	/**
+	 * Same as reap without blocking
+	 */
+	template<typename Fn>
+	size_t poll(Fn fn) {
+		unsigned head = *m_CqHead;
+		const unsigned tail = __atomic_load_n(m_CqTail, __ATOMIC_ACQUIRE);
+		size_t count = 0;
+		for (; head != tail; ++head, ++count) {
+			const io_uring_cqe &cqe = m_Cqes[head & m_CqMask];
+			fn(uint64_t(cqe.user_data), int(cqe.res));
+		}
+		__atomic_store_n(m_CqHead, head, __ATOMIC_RELEASE);
+		return count;
+	}
+
+private:
+	void release() {
+		if (m_Sqes != MAP_FAILED)
+			munmap(m_Sqes, m_SqesSize);
+		if (m_CqRing != MAP_FAILED && m_CqRing != m_SqRing)
+			munmap(m_CqRing, m_CqRingSize);
+		if (m_SqRing != MAP_FAILED)
+			munmap(m_SqRing, m_SqRingSize);
+		if (m_Fd >= 0)
+			close(m_Fd);
+	}
+
+	void* map(size_t size, off_t offset) {
+		void * const address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, offset);
+		if (address == MAP_FAILED) {
+			const int error = errno;
+			release();
+			throw std::system_error(error, std::system_category(), "io_uring mmap");
+		}
+		return address;
+	}
+
+	io_uring_sqe* next() {
+		if (m_SqLocalTail - __atomic_load_n(m_SqHead, __ATOMIC_ACQUIRE) >= m_SqEntries)
+			return nullptr;
+		const unsigned index = m_SqLocalTail++ & m_SqMask;
+		io_uring_sqe * const sqe = static_cast<io_uring_sqe*>(m_Sqes) + index;
+		memset(sqe, 0, sizeof(*sqe));
+		m_SqArray[index] = index;
+		++m_Pending;
+		return sqe;
+	}
+
+	int enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+		for (;;) {
+			const int result = int(syscall(__NR_io_uring_enter, m_Fd, toSubmit, minComplete, flags, nullptr, 0));
+			if (result >= 0)
+				return result;
+			if (errno != EINTR || toSubmit == 0)
+				return -errno;
+		}
+	}
+
+	int m_Fd;
+	void *m_SqRing;
+	void *m_CqRing;
+	void *m_Sqes;
+	size_t m_SqRingSize;
+	size_t m_CqRingSize;
+	size_t m_SqesSize;
+	unsigned *m_SqHead;
+	unsigned *m_SqTail;
+	unsigned m_SqMask;
+	unsigned m_SqEntries;
+	unsigned *m_SqArray;
+	unsigned *m_CqHead;
+	unsigned *m_CqTail;
+	unsigned m_CqMask;
+	io_uring_cqe *m_Cqes;
+	unsigned m_SqLocalTail; // tail including the prepared entries
+	unsigned m_Pending; // prepared but not submitted
+};
+
+} // namespace details
+} // namespace concurrent
+
+#endif /* CONCURRENT_IO_URING */
+
+#endif /* IO_URING_HPP_ */
@@ -0,0 +1,41 @@
+/*
+ * mutex.hpp
+ *
+ *  Selects the mutex used by the queues and the caches.
+ */
+
+#ifndef DETAILS_MUTEX_HPP_
+#define DETAILS_MUTEX_HPP_
+
+#include <mutex>
+#include <condition_variable>
+
+#ifdef CONCURRENT_PROFILE_LOCKS
+#include <concurrent/profiled_mutex.hpp>
+#endif
+
+namespace concurrent {
+namespace details {
+
+#ifdef CONCURRENT_PROFILE_LOCKS
+typedef profiled_mutex mutex_type;
+typedef std::condition_variable_any condition_type;
+
+inline void name_lock(profiled_mutex &mutex, const char *name) {
+	mutex.setName(name);
+}
+#else
+typedef std::mutex mutex_type;
+typedef std::condition_variable condition_type;
+#endif
+
+/**
+ * Lock sites are only named when profiling
+ */
+inline void name_lock(std::mutex &, const char *) {
+}
+
+} // namespace details
+} // namespace concurrent
+
+#endif /* DETAILS_MUTEX_HPP_ */
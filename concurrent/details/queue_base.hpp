@@ -9,65 +9,148 @@
 #define COMMON_QUEUE_HPP_
 
 #include "call_type_traits.hpp"
+#include "mutex.hpp"
 
 #include <concurrent/common.hpp>
+#include <concurrent/queue_policy.hpp>
+#include <deque>
+#include <functional>
 #include <mutex>
+#include <new>
 #include <iterator>
+#include <vector>
 
 namespace concurrent {
 namespace details {
 
+/**
+ * Moves all the elements of a container to another one. Overloaded for the
+ * containers needing a specific order, found by argument dependent lookup.
+ */
+template<typename C1, typename C2>
+inline void drain_container(C1& from, C2& to) {
+	std::copy(from.begin(), from.end(), std::back_inserter(to));
+	from.clear();
+}
+
 /**
  * base implementation of the queues functionalities via Static Polymorphism
  * and use of the CRTP ( Curiously Recurring Template Pattern )
+ *
+ * By setting terminate to true, every push and pop - blocked or not - will
+ * throw a terminated exception, or return pop_status::TERMINATED for the
+ * std::nothrow and timed pops. The queue content is left untouched.
  */
-template<typename Derived, typename Container>
+template<typename Derived, typename Container, typename Policy>
 struct queue_base: private noncopyable {
 	typedef Container container_type;
+	typedef typename Policy::stats_type stats_type;
 	typedef typename container_type::size_type size_type;
 	typedef typename container_type::value_type value_type;
 	typedef typename call_traits<value_type>::reference reference;
 	typedef typename call_traits<value_type>::param_type param_type;
 
 	static_assert(std::is_trivial<size_type>::value,"size_type must be trivial");
+
+	queue_base() :
+			m_terminated(false) {
+		name_lock(m_mutex, "queue_base::m_mutex");
+	}
+
 	static_assert(std::is_copy_assignable<value_type>::value,"value_type must be copy assignable");
 
 	void push(param_type value) {
-		std::unique_lock<std::mutex> lock(m_mutex);
-		exact()->wait_not_full(lock);
+		std::unique_lock<mutex_type> lock(acquire());
+		checkTermination();
+		if (!exact()->is_not_full()) {
+			const typename stats_type::stopwatch_type watch;
+			exact()->wait_not_full(lock);
+			m_stats.onPushWait(watch.elapsed());
+			checkTermination();
+		}
 		exact()->_push(value);
+		m_stats.onPush(1, exact()->_size());
 		exact()->notify_not_empty();
+		notifyAsync(lock, 1);
 	}
 
 	bool tryPush(param_type value) {
-		std::lock_guard<std::mutex> lock(m_mutex);
-		if (!exact()->is_not_full())
+		std::unique_lock<mutex_type> lock(acquire());
+		checkTermination();
+		if (!exact()->is_not_full()) {
+			m_stats.onFull();
 			return false; // full
+		}
 		exact()->_push(value);
+		m_stats.onPush(1, exact()->_size());
 		exact()->notify_not_empty();
+		notifyAsync(lock, 1);
 		return true;
 	}
 
 	void pop(reference value) {
-		std::unique_lock<std::mutex> lock(m_mutex);
-		exact()->wait_not_empty(lock);
+		if (popUntil(value, nullptr) == pop_status::TERMINATED)
+			CONCURRENT_THROW(terminated());
+	}
+
+	bool tryPop(reference value) {
+		const pop_status status = tryPop(value, std::nothrow);
+		if (status == pop_status::TERMINATED)
+			CONCURRENT_THROW(terminated());
+		return status == pop_status::OK;
+	}
+
+	/**
+	 * Status returning pops, termination is reported without throwing
+	 */
+	pop_status pop(reference value, const std::nothrow_t&) {
+		return popUntil(value, nullptr);
+	}
+
+	template<typename Rep, typename Period>
+	pop_status pop(reference value, const std::chrono::duration<Rep, Period> &timeout) {
+		const clock_type::time_point deadline = deadline_after(timeout);
+		return popUntil(value, &deadline);
+	}
+
+	pop_status tryPop(reference value, const std::nothrow_t&) {
+		std::unique_lock<mutex_type> lock(acquire());
+		if (m_terminated)
+			return pop_status::TERMINATED;
+		if (!exact()->is_not_empty()) {
+			m_stats.onEmpty();
+			return pop_status::TIMEOUT; // empty
+		}
 		value = exact()->_pop();
+		m_stats.onPop(1, exact()->_size());
 		exact()->notify_not_full();
+		return pop_status::OK;
 	}
 
-	bool tryPop(reference value) {
-		std::lock_guard<std::mutex> lock(m_mutex);
-		if (!exact()->is_not_empty())
-			return false; // empty
+	/**
+	 * Pops without blocking the thread : returns true if value was popped,
+	 * otherwise 'ready' is called once an element is pushed or the queue is
+	 * terminated and the caller should try again. 'ready' is called by the
+	 * pushing thread without the lock held, it must not block.
+	 */
+	bool popOrNotify(reference value, const std::function<void()> &ready) {
+		std::unique_lock<mutex_type> lock(acquire());
+		checkTermination();
+		if (!exact()->is_not_empty()) {
+			m_asyncPoppers.push_back(ready);
+			return false;
+		}
 		value = exact()->_pop();
+		m_stats.onPop(1, exact()->_size());
 		exact()->notify_not_full();
 		return true;
 	}
 
 	void clear() {
-		std::lock_guard<std::mutex> lock(m_mutex);
+		std::unique_lock<mutex_type> lock(acquire());
 		if (exact()->is_not_empty()) {
 			exact()->_clear();
+			m_stats.onClear();
 			exact()->notify_not_full();
 		}
 	}
@@ -76,34 +159,123 @@ struct queue_base: private noncopyable {
 	void drainFrom(CompatibleContainer &collection) {
 		if (collection.empty())
 			return;
-		std::lock_guard<std::mutex> lock(m_mutex);
+		std::unique_lock<mutex_type> lock(acquire());
+		checkTermination();
+		const size_type before = exact()->_size();
 		drain<CompatibleContainer, container_type>(collection, exact()->m_container);
+		m_stats.onPush(exact()->_size() - before, exact()->_size());
 		exact()->notify_not_empty();
+		notifyAsync(lock, exact()->_size() - before);
 	}
 
 	template<typename CompatibleContainer>
 	bool drainTo(CompatibleContainer& collection) {
-		std::lock_guard<std::mutex> lock(m_mutex);
+		std::unique_lock<mutex_type> lock(acquire());
+		checkTermination();
 		if (exact()->is_not_empty()) {
+			const size_type count = exact()->_size();
 			drain<container_type, CompatibleContainer>(exact()->m_container, collection);
+			m_stats.onPop(count, 0);
 			exact()->notify_not_full();
 			return true;
 		}
 		return false;
 	}
 
+	void terminate(bool value = true) {
+		std::unique_lock<mutex_type> lock(acquire());
+		m_terminated = value;
+		exact()->notify_all();
+		if (value)
+			notifyAsync(lock, m_asyncPoppers.size());
+	}
+
+	/**
+	 * Relaxed view of the queue statistics, all zeros unless the policy
+	 * enables them.
+	 */
+	queue_stats_snapshot stats() const {
+		return m_stats.snapshot();
+	}
+
+protected:
+	/**
+	 * For the derived wait predicates, mutex *must* be locked
+	 */
+	inline bool is_terminated() const {
+		return m_terminated;
+	}
+
+	inline void checkTermination() const {
+		if (m_terminated)
+			CONCURRENT_THROW(terminated());
+	}
+
+	inline std::unique_lock<mutex_type> acquire() {
+		const typename stats_type::stopwatch_type watch;
+		std::unique_lock<mutex_type> lock(m_mutex);
+		m_stats.onLockWait(watch.elapsed());
+		return lock;
+	}
+
+	stats_type m_stats;
+
 private:
 	Derived* exact() {
 		return static_cast<Derived*>(this);
 	}
 
+	/**
+	 * Pops the front element, waiting while the queue is empty until deadline,
+	 * or forever if deadline is null. Returns TIMEOUT or TERMINATED instead
+	 * of throwing, the public pops map TERMINATED to the terminated exception.
+	 */
+	pop_status popUntil(reference value, const clock_type::time_point *deadline) {
+		std::unique_lock<mutex_type> lock(acquire());
+		if (m_terminated)
+			return pop_status::TERMINATED;
+		if (!exact()->is_not_empty()) {
+			const typename stats_type::stopwatch_type watch;
+			if (deadline)
+				exact()->wait_not_empty_until(lock, *deadline);
+			else
+				exact()->wait_not_empty(lock);
+			m_stats.onPopWait(watch.elapsed());
+			if (m_terminated)
+				return pop_status::TERMINATED;
+			if (!exact()->is_not_empty())
+				return pop_status::TIMEOUT;
+		}
+		value = exact()->_pop();
+		m_stats.onPop(1, exact()->_size());
+		exact()->notify_not_full();
+		return pop_status::OK;
+	}
+
 	template<typename C1, typename C2>
 	inline static void drain(C1& from, C2& to) {
-		std::copy(from.begin(), from.end(), std::back_inserter(to));
-		from.clear();
+		drain_container(from, to);
+	}
+
+	/**
+	 * Calls up to 'count' popOrNotify callbacks, releases the lock
+	 */
+	inline void notifyAsync(std::unique_lock<mutex_type> &lock, size_type count) {
+		if (m_asyncPoppers.empty())
+			return;
+		std::vector<std::function<void()> > ready;
+		for (; count && !m_asyncPoppers.empty(); --count) {
+			ready.push_back(m_asyncPoppers.front());
+			m_asyncPoppers.pop_front();
+		}
+		lock.unlock();
+		for (const auto &callback : ready)
+			callback();
 	}
 
-	std::mutex m_mutex;
+	mutex_type m_mutex;
+	bool m_terminated;
+	std::deque<std::function<void()> > m_asyncPoppers; // protected by the mutex
 };
 
 } // namespace details
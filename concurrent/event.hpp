@@ -0,0 +1,82 @@
+/*
+ * event.hpp
+ *
+ *  Broadcast event : once set, every waiter - present and future - is
+ *  released until the event is reset.
+ */
+
+#ifndef EVENT_HPP_
+#define EVENT_HPP_
+
+#include "common.hpp"
+#include "wait_strategy.hpp"
+#include "details/atomic_wait.hpp"
+
+namespace concurrent {
+
+/**
+ * Manual reset event, unlike notifier any number of threads can wait on it.
+ *
+ * By setting terminate to true, waiters will throw a terminated exception
+ */
+template<typename WAIT = block_wait>
+struct basic_event : private noncopyable {
+    basic_event(bool set = false) : m_State(set ? SET : 0) {
+    }
+
+    void set() {
+        m_State.fetch_or(SET);
+        m_Waiter.notify_all(m_State);
+    }
+
+    void reset() {
+        m_State.fetch_and(~SET);
+    }
+
+    bool isSet() const {
+        return m_State.load() & SET;
+    }
+
+    void terminate(bool value = true) {
+        if (value)
+            m_State.fetch_or(TERMINATED);
+        else
+            m_State.fetch_and(~TERMINATED);
+        m_Waiter.notify_all(m_State);
+    }
+
+    void wait() {
+        for (;;) {
+            const uint32_t state = m_State.load();
+            if (ready(state))
+                return;
+            m_Waiter.wait(m_State, state);
+        }
+    }
+
+    /**
+     * Returns true if the event is set, does not block
+     */
+    bool tryWait() {
+        return ready(m_State.load());
+    }
+private:
+    enum {
+        SET = 1, TERMINATED = 2
+    };
+
+    static inline bool ready(const uint32_t state) {
+        if (state & TERMINATED)
+            CONCURRENT_THROW(terminated());
+        return state & SET;
+    }
+
+    details::wait_word m_State;
+    details::atomic_waiter<WAIT> m_Waiter;
+};
+
+typedef basic_event<> event;
+
+}  // namespace concurrent
+
+#endif /* EVENT_HPP_ */
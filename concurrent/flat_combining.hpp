@@ -0,0 +1,159 @@
+/*
+ * flat_combining.hpp
+ *
+ *  Flat combining : threads publish their operation in a slot instead of
+ *  queuing on the mutex, whichever thread gets the mutex applies every
+ *  published operation in one go. The protected data stays in the cache of
+ *  a single core and the mutex changes hands once per batch instead of once
+ *  per operation.
+ */
+
+#ifndef FLAT_COMBINING_HPP_
+#define FLAT_COMBINING_HPP_
+
+#include "common.hpp"
+#include "wait_strategy.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+
+namespace concurrent {
+
+/**
+ * Default, the operations are applied by their own thread holding the mutex
+ */
+struct no_combining {
+};
+
+/**
+ * Each thread publishes in one of SLOTS slots, threads sharing a busy slot
+ * take the mutex themselves. SPINS is how long a thread waits for a combiner
+ * before blocking on the mutex.
+ *
+ * Operations must not block nor take the mutex. Their exceptions are
+ * rethrown in the publishing thread.
+ */
+template<size_t SLOTS = 64, unsigned SPINS = 256>
+struct flat_combining: private noncopyable {
+	static_assert(SLOTS > 0, "flat_combining needs at least one slot");
+
+	/**
+	 * Returns once op() has run with mutex held, by this thread or by
+	 * another one
+	 */
+	template<typename MUTEX, typename OP>
+	void execute(MUTEX &mutex, OP &op) {
+		Request request(&invoke<OP>, &op);
+		std::atomic<Request*> &slot = m_Slots[slotHint() % SLOTS].request;
+		Request *expected = nullptr;
+		if (!slot.compare_exchange_strong(expected, &request, std::memory_order_release, std::memory_order_relaxed)) {
+			const std::lock_guard<MUTEX> lock(mutex);
+			combine();
+			op();
+			return;
+		}
+		for (unsigned spins = 0; !request.done.load(std::memory_order_acquire);) {
+			if (spins < SPINS && !mutex.try_lock()) {
+				++spins;
+				details::cpu_relax();
+				continue;
+			}
+			if (spins == SPINS)
+				mutex.lock();
+			// applies this request unless a combiner did meanwhile
+			combine();
+			mutex.unlock();
+			break;
+		}
+		request.rethrow();
+	}
+
+private:
+	struct Request {
+		Request(void (*apply)(void*), void *operation) :
+				apply(apply), operation(operation), done(false) {
+		}
+
+		void run() {
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+			try {
+				apply(operation);
+			} catch (...) {
+				error = std::current_exception();
+			}
+#else
+			apply(operation);
+#endif
+		}
+
+		void rethrow() const {
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+			if (error)
+				std::rethrow_exception(error);
+#endif
+		}
+
+		void (* const apply)(void*);
+		void * const operation;
+		std::atomic<bool> done;
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+		std::exception_ptr error;
+#endif
+	};
+
+	/**
+	 * Padded so that two slots never share a cache line
+	 */
+	struct Slot {
+		std::atomic<Request*> request;
+		char padding[64 - sizeof(std::atomic<Request*>)];
+
+		Slot() :
+				request(nullptr) {
+		}
+	};
+
+	template<typename OP>
+	static void invoke(void *operation) {
+		(*static_cast<OP*>(operation))();
+	}
+
+	/**
+	 * Spreads the threads over the slots
+	 */
+	static size_t slotHint() {
+		static std::atomic<size_t> next(0);
+		static thread_local const size_t hint = next.fetch_add(1, std::memory_order_relaxed);
+		return hint;
+	}
+
+	/**
+	 * The mutex must be held. Passes over the slots until one finds nothing,
+	 * at most a few times so that the combiner is not kept forever.
+	 */
+	void combine() {
+		for (int pass = 0; pass < 4; ++pass) {
+			bool found = false;
+			for (Slot &slot : m_Slots) {
+				Request * const request = slot.request.load(std::memory_order_acquire);
+				if (!request)
+					continue;
+				request->run();
+				// freed before done : the publisher may leave as soon as it is set
+				slot.request.store(nullptr, std::memory_order_relaxed);
+				request->done.store(true, std::memory_order_release);
+				found = true;
+			}
+			if (!found)
+				return;
+		}
+	}
+
+	Slot m_Slots[SLOTS];
+};
+
+} // namespace concurrent
+
+#endif /* FLAT_COMBINING_HPP_ */
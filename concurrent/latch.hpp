@@ -0,0 +1,81 @@
+/*
+ * latch.hpp
+ *
+ *  Single use countdown : waiters are released once the count reaches zero,
+ *  e.g. when all the tiles of a frame are done.
+ */
+
+#ifndef LATCH_HPP_
+#define LATCH_HPP_
+
+#include "common.hpp"
+#include "wait_strategy.hpp"
+#include "details/atomic_wait.hpp"
+
+#include <cassert>
+
+namespace concurrent {
+
+/**
+ * By setting terminate to true, waiters will throw a terminated exception
+ */
+template<typename WAIT = block_wait>
+struct basic_latch : private noncopyable {
+    explicit basic_latch(uint32_t count) : m_State(count * COUNT) {
+    }
+
+    void countDown(uint32_t n = 1) {
+        const uint32_t previous = m_State.fetch_sub(n * COUNT);
+        assert(previous / COUNT >= n);
+        if (previous / COUNT == n)
+            m_Waiter.notify_all(m_State);
+    }
+
+    void terminate(bool value = true) {
+        if (value)
+            m_State.fetch_or(TERMINATED);
+        else
+            m_State.fetch_and(~TERMINATED);
+        m_Waiter.notify_all(m_State);
+    }
+
+    void wait() {
+        for (;;) {
+            const uint32_t state = m_State.load();
+            if (ready(state))
+                return;
+            m_Waiter.wait(m_State, state);
+        }
+    }
+
+    /**
+     * Returns true if the count reached zero, does not block
+     */
+    bool tryWait() {
+        return ready(m_State.load());
+    }
+
+    void countDownAndWait(uint32_t n = 1) {
+        countDown(n);
+        wait();
+    }
+private:
+    enum {
+        TERMINATED = 1, COUNT = 2
+    };
+
+    static inline bool ready(const uint32_t state) {
+        if (state & TERMINATED)
+            CONCURRENT_THROW(terminated());
+        return state / COUNT == 0;
+    }
+
+    details::wait_word m_State; // count and terminate flag
+    details::atomic_waiter<WAIT> m_Waiter;
+};
+
+typedef basic_latch<> latch;
+
+}  // namespace concurrent
+
+#endif /* LATCH_HPP_ */
@@ -0,0 +1,127 @@
+/*
+ * latest_slot.hpp
+ *
+ *  Triple buffered channel publishing the latest value of a single writer
+ *  to a single reader, e.g. the playhead position or the frame to display.
+ */
+
+#ifndef LATEST_SLOT_HPP_
+#define LATEST_SLOT_HPP_
+
+#include "common.hpp"
+#include "wait_strategy.hpp"
+#include "details/atomic_wait.hpp"
+
+#include <atomic>
+
+namespace concurrent {
+
+/**
+ * Latest value holder for one writer and one reader
+ *
+ * By setting terminate to true, getters will throw a terminated exception
+ *
+ * WAIT is the waiting strategy of waitGet, see wait_strategy.hpp
+ *
+ * The writer fills the back buffer and swaps it with the middle one, the
+ * reader swaps the front buffer with the middle one when it has been
+ * published since the last read. Both sides are wait free and never copy
+ * under a lock, values are never torn whatever the size of T. Values
+ * published faster than they are read are dropped, only the latest counts.
+ */
+template<typename T, typename WAIT = block_wait>
+struct latest_slot : private noncopyable {
+    latest_slot() : m_Buffers(), m_Front(0), m_Middle(1), m_Back(2), m_State(0) {
+    }
+
+    latest_slot(const T&object) : m_Buffers(), m_Front(0), m_Middle(1 | DIRTY), m_Back(2), m_State(0) {
+        m_Buffers[1].value = object;
+    }
+
+    /**
+     * Writer side : the buffer to fill in place before calling publish.
+     * Saves a copy for large objects.
+     */
+    T& back() {
+        return m_Buffers[m_Back].value;
+    }
+
+    void publish() {
+        m_Back = m_Middle.exchange(m_Back | DIRTY, std::memory_order_acq_rel) & INDEX;
+        // notifying shared structure is updated
+        m_State.fetch_add(SEQUENCE);
+        m_Waiter.notify_one(m_State);
+    }
+
+    void set(const T& object) {
+        back() = object;
+        publish();
+    }
+
+    void terminate(bool value = true) {
+        if (value)
+            m_State.fetch_or(TERMINATED);
+        else
+            m_State.fetch_and(~TERMINATED);
+        m_Waiter.notify_all(m_State);
+    }
+
+    /**
+     * Blocks until a value newer than the last one read is published
+     */
+    void waitGet(T& value) {
+        for (;;) {
+            const uint32_t state = m_State.load();
+            checkTermination(state);
+            if (take(value))
+                return;
+            m_Waiter.wait(m_State, state);
+        }
+    }
+
+    /**
+     * Returns false if nothing was published since the last read
+     */
+    bool tryGet(T& holder) {
+        checkTermination(m_State.load());
+        return take(holder);
+    }
+private:
+    enum {
+        INDEX = 3, DIRTY = 4
+    };
+    enum {
+        TERMINATED = 1, SEQUENCE = 2
+    };
+
+    struct buffer {
+        T value;
+        char padding[64]; // keeps the reader and the writer off each other's cache lines
+    };
+
+    static inline void checkTermination(const uint32_t state) {
+        if (state & TERMINATED)
+            CONCURRENT_THROW(terminated());
+    }
+
+    inline bool take(T& value) {
+        if (!(m_Middle.load(std::memory_order_relaxed) & DIRTY))
+            return false;
+        m_Front = m_Middle.exchange(m_Front, std::memory_order_acq_rel) & INDEX;
+        value = m_Buffers[m_Front].value;
+        return true;
+    }
+
+    buffer m_Buffers[3];
+    uint32_t m_Front; // reader's
+    char m_FrontPadding[64];
+    std::atomic<uint32_t> m_Middle; // index and dirty flag
+    char m_MiddlePadding[64];
+    uint32_t m_Back; // writer's
+    details::wait_word m_State; // terminate flag and publish counter
+    details::atomic_waiter<WAIT> m_Waiter;
+};
+
+}  // namespace concurrent
+
+#endif /* LATEST_SLOT_HPP_ */
@@ -12,6 +12,10 @@
 
 namespace concurrent {
 
+/**
+ * One to one handshake : each ack releases a single wait. Use event, latch
+ * or barrier when several threads have to be released.
+ */
 struct notifier : private slot<bool> {
     void ack() {
         slot<bool>::set(true);
@@ -0,0 +1,366 @@
+/*
+ * pipeline.hpp
+ *
+ *  Chains processing stages with bounded queues in between.
+ *
+ *  A source produces items, stages transform them and sinks consume them.
+ *  Each one runs on its own threads and reads from the bounded queue filled
+ *  by the previous one : a slow stage blocks the producers upstream.
+ *
+ *  concurrent::pipeline p(16);
+ *  auto ids = p.source<int>("load", 2, [&](int &id) { id = readNext(); });
+ *  auto frames = p.stage<Frame>("decode", ids, 4, [](const int &id) { return decode(id); });
+ *  p.sink("display", frames, 1, [](const Frame &frame) { show(frame); }, true);
+ *  p.start();
+ *  ...
+ *  p.terminate();
+ *
+ *  Every item gets a sequence number when produced, an ordered stage or sink
+ *  emits its results in sequence order whatever the thread that produced
+ *  them. Sources stop by throwing a concurrent::terminated exception, e.g. a
+ *  lookahead_cache::pop once the cache is terminated.
+ *
+ *  Stage functions must not throw anything else than terminated.
+ */
+
+#ifndef PIPELINE_HPP_
+#define PIPELINE_HPP_
+
+#include "bounded_queue.h"
+#include "queue_policy.hpp"
+#include "stats.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace concurrent {
+
+/**
+ * Relaxed view of a stage activity
+ */
+struct stage_stats_snapshot {
+	std::string name;
+	size_t threads;
+	uint64_t processed; // items emitted by the stage
+	double seconds; // since the pipeline started
+	double busy; // fraction of the threads time spent in the stage function
+	size_t inputCapacity; // 0 for sources
+	double meanOccupancy; // input queue depth seen by the workers
+	uint64_t maxOccupancy;
+
+	stage_stats_snapshot() :
+			threads(0), processed(0), seconds(0), busy(0), inputCapacity(0), meanOccupancy(0), maxOccupancy(0) {
+	}
+
+	double throughput() const {
+		return seconds > 0 ? processed / seconds : 0;
+	}
+};
+
+template<typename T>
+struct sequenced {
+	uint64_t sequence;
+	T value;
+};
+
+struct pipeline: private noncopyable {
+	struct queue_policy: public default_queue_policy {
+		typedef queue_stats stats_type;
+	};
+
+	/**
+	 * Output of a source or a stage, to be connected to a stage or a sink
+	 */
+	template<typename T>
+	struct port {
+		typedef T value_type;
+		typedef bounded_queue<sequenced<T>, std::vector<sequenced<T> >, queue_policy> queue_type;
+
+		std::shared_ptr<queue_type> queue;
+		size_t capacity;
+	};
+
+	/**
+	 * capacity is the default size of the queues between the stages
+	 */
+	explicit pipeline(size_t capacity = 16) :
+			m_Capacity(capacity), m_InFlight(0), m_RunningSources(0) {
+	}
+
+	~pipeline() {
+		terminate();
+	}
+
+	/**
+	 * Source calls 'void fn(T&)' in a loop from 'threads' threads until it
+	 * throws terminated.
+	 */
+	template<typename T, typename Fn>
+	port<T> source(const std::string &name, size_t threads, Fn fn, size_t capacity = 0) {
+		stage_state &current = addStage(name, threads, 0);
+		const port<T> output = makePort<T>(capacity);
+		current.body = [this, &current, output, fn]() mutable {
+			try {
+				for (;;) {
+					sequenced<T> item = sequenced<T>();
+					const clock::time_point start = clock::now();
+					fn(item.value);
+					current.busyNs.fetch_add(elapsedNs(start), std::memory_order_relaxed);
+					item.sequence = current.sequence.fetch_add(1);
+					beginItem();
+					output.queue->push(item);
+					current.processed.fetch_add(1, std::memory_order_relaxed);
+				}
+			} catch (const terminated&) {
+			}
+			endSource();
+		};
+		m_RunningSources += threads;
+		return output;
+	}
+
+	/**
+	 * Stage calls 'Out fn(const In&)' for every item of input from 'threads'
+	 * threads. If ordered, the results are emitted in sequence order.
+	 */
+	template<typename Out, typename In, typename Fn>
+	port<Out> stage(const std::string &name, const port<In> &input, size_t threads, Fn fn, bool ordered = false, size_t capacity = 0) {
+		stage_state &current = addStage(name, threads, input.capacity);
+		const port<Out> output = makePort<Out>(capacity);
+		const std::shared_ptr<reorder<Out> > pending(ordered ? new reorder<Out>() : nullptr);
+		current.body = [this, &current, input, output, fn, pending]() mutable {
+			run<In, Out>(current, input, [&](const sequenced<In> &in) {
+				sequenced<Out> out;
+				out.sequence = in.sequence;
+				out.value = fn(in.value);
+				return out;
+			}, [&](const sequenced<Out> &out) {
+				output.queue->push(out);
+			}, pending.get());
+		};
+		return output;
+	}
+
+	/**
+	 * Sink calls 'void fn(const In&)' for every item of input from 'threads'
+	 * threads. If ordered, fn is called in sequence order.
+	 */
+	template<typename In, typename Fn>
+	void sink(const std::string &name, const port<In> &input, size_t threads, Fn fn, bool ordered = false) {
+		stage_state &current = addStage(name, threads, input.capacity);
+		const std::shared_ptr<reorder<In> > pending(ordered ? new reorder<In>() : nullptr);
+		current.body = [this, &current, input, fn, pending]() mutable {
+			run<In, In>(current, input, [](const sequenced<In> &in) {
+				return in;
+			}, [&](const sequenced<In> &in) {
+				const clock::time_point start = clock::now();
+				fn(in.value);
+				current.busyNs.fetch_add(elapsedNs(start), std::memory_order_relaxed);
+				endItem();
+			}, pending.get());
+		};
+	}
+
+	/**
+	 * Called by terminate before stopping the stages, e.g. to terminate the
+	 * cache a source pops from.
+	 */
+	void onTerminate(const std::function<void()> &hook) {
+		m_Hooks.push_back(hook);
+	}
+
+	void start() {
+		m_Start = clock::now();
+		for (const std::unique_ptr<stage_state> &current : m_Stages)
+			for (size_t i = 0; i < current->threads; ++i)
+				m_Threads.emplace_back(current->body);
+	}
+
+	/**
+	 * Waits for the sources to stop and every produced item to reach a sink,
+	 * then terminates. Every port must be connected.
+	 */
+	void finish() {
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Done.wait(lock, [this]() {
+				return m_RunningSources == 0 && m_InFlight == 0;
+			});
+		}
+		terminate();
+	}
+
+	/**
+	 * Stops all the threads, items left in the queues are dropped.
+	 */
+	void terminate() {
+		if (m_Threads.empty())
+			return;
+		for (const std::function<void()> &hook : m_Hooks)
+			hook();
+		for (const std::function<void()> &terminateQueue : m_Queues)
+			terminateQueue();
+		for (std::thread &thread : m_Threads)
+			thread.join();
+		m_Threads.clear();
+		m_Stop = clock::now();
+	}
+
+	/**
+	 * One entry per source, stage and sink in creation order
+	 */
+	std::vector<stage_stats_snapshot> stats() const {
+		const uint64_t ns = m_Threads.empty() ? std::chrono::duration_cast<std::chrono::nanoseconds>(m_Stop - m_Start).count() : elapsedNs(m_Start);
+		std::vector<stage_stats_snapshot> result;
+		for (const std::unique_ptr<stage_state> &current : m_Stages) {
+			stage_stats_snapshot snapshot;
+			snapshot.name = current->name;
+			snapshot.threads = current->threads;
+			snapshot.processed = current->processed.load(std::memory_order_relaxed);
+			snapshot.seconds = ns / 1e9;
+			if (ns && current->threads)
+				snapshot.busy = double(current->busyNs.load(std::memory_order_relaxed)) / (double(ns) * current->threads);
+			snapshot.inputCapacity = current->capacity;
+			const uint64_t pops = current->pops.load(std::memory_order_relaxed);
+			if (pops)
+				snapshot.meanOccupancy = double(current->occupancy.load(std::memory_order_relaxed)) / pops;
+			snapshot.maxOccupancy = current->maxOccupancy.load(std::memory_order_relaxed);
+			result.push_back(snapshot);
+		}
+		return result;
+	}
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	struct stage_state {
+		stage_state() :
+				threads(0), capacity(0), sequence(0), processed(0), busyNs(0), pops(0), occupancy(0), maxOccupancy(0) {
+		}
+
+		std::string name;
+		size_t threads;
+		size_t capacity; // of the input queue
+		std::function<void()> body;
+		std::atomic<uint64_t> sequence; // sources only
+		std::atomic<uint64_t> processed;
+		std::atomic<uint64_t> busyNs;
+		std::atomic<uint64_t> pops;
+		std::atomic<uint64_t> occupancy; // sum of the input depths seen on pop
+		std::atomic<uint64_t> maxOccupancy;
+	};
+
+	/**
+	 * Results waiting for the previous sequence numbers to be emitted
+	 */
+	template<typename T>
+	struct reorder {
+		reorder() :
+				next(0) {
+		}
+
+		std::mutex mutex;
+		uint64_t next;
+		std::map<uint64_t, sequenced<T> > waiting;
+	};
+
+	static uint64_t elapsedNs(clock::time_point start) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+	}
+
+	stage_state& addStage(const std::string &name, size_t threads, size_t capacity) {
+		std::unique_ptr<stage_state> current(new stage_state());
+		current->name = name;
+		current->threads = threads;
+		current->capacity = capacity;
+		m_Stages.push_back(std::move(current));
+		return *m_Stages.back();
+	}
+
+	template<typename T>
+	port<T> makePort(size_t capacity) {
+		port<T> result;
+		result.capacity = capacity ? capacity : m_Capacity;
+		result.queue = std::make_shared<typename port<T>::queue_type>(result.capacity);
+		const std::shared_ptr<typename port<T>::queue_type> queue(result.queue);
+		m_Queues.push_back([queue]() {
+			queue->terminate();
+		});
+		return result;
+	}
+
+	template<typename In, typename Out, typename Transform, typename Emit>
+	void run(stage_state &current, const port<In> &input, Transform transform, Emit emit, reorder<Out> *pending) {
+		try {
+			for (;;) {
+				sequenced<In> in = sequenced<In>();
+				input.queue->pop(in);
+				const uint64_t depth = input.queue->stats().depth;
+				current.pops.fetch_add(1, std::memory_order_relaxed);
+				current.occupancy.fetch_add(depth, std::memory_order_relaxed);
+				details::relaxed_max(current.maxOccupancy, depth);
+
+				const clock::time_point start = clock::now();
+				const sequenced<Out> out = transform(in);
+				current.busyNs.fetch_add(elapsedNs(start), std::memory_order_relaxed);
+				if (!pending) {
+					emit(out);
+					current.processed.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+				// emitting under the lock keeps the order, backpressure included
+				std::lock_guard<std::mutex> lock(pending->mutex);
+				pending->waiting.insert(std::make_pair(out.sequence, out));
+				auto itr = pending->waiting.begin();
+				while (itr != pending->waiting.end() && itr->first == pending->next) {
+					emit(itr->second);
+					current.processed.fetch_add(1, std::memory_order_relaxed);
+					++pending->next;
+					pending->waiting.erase(itr++);
+				}
+			}
+		} catch (const terminated&) {
+		}
+	}
+
+	void beginItem() {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		++m_InFlight;
+	}
+
+	void endItem() {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (--m_InFlight == 0)
+			m_Done.notify_all();
+	}
+
+	void endSource() {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		--m_RunningSources;
+		m_Done.notify_all();
+	}
+
+	const size_t m_Capacity;
+	std::vector<std::unique_ptr<stage_state> > m_Stages;
+	std::vector<std::function<void()> > m_Queues; // terminates a queue
+	std::vector<std::function<void()> > m_Hooks;
+	std::vector<std::thread> m_Threads;
+	clock::time_point m_Start;
+	clock::time_point m_Stop;
+	std::mutex m_Mutex;
+	std::condition_variable m_Done;
+	size_t m_InFlight;
+	size_t m_RunningSources;
+};
+
+} // namespace concurrent
+
+#endif /* PIPELINE_HPP_ */
@@ -0,0 +1,190 @@
+/*
+ * priority_queue.hpp
+ *
+ *  Concurrent queue serving the elements by priority rather than arrival.
+ */
+
+#ifndef CONCURRENT_PRIORITY_QUEUE_HPP_
+#define CONCURRENT_PRIORITY_QUEUE_HPP_
+
+#include "details/queue_base.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+namespace concurrent {
+namespace details {
+
+/**
+ * Binary heap over a random access container, the top is the greatest
+ * element according to Compare like std::priority_queue.
+ */
+template<typename T, typename Compare, typename Container>
+struct heap_container {
+    typedef typename Container::value_type value_type;
+    typedef typename Container::size_type size_type;
+    typedef typename Container::reference reference;
+    typedef typename Container::const_reference const_reference;
+
+    inline void push(const_reference value) {
+        m_container.push_back(value);
+        std::push_heap(m_container.begin(), m_container.end(), m_compare);
+    }
+    inline value_type pop() {
+        std::pop_heap(m_container.begin(), m_container.end(), m_compare);
+        value_type top(m_container.back());
+        m_container.pop_back();
+        return top;
+    }
+    inline const_reference top() const {
+        return m_container.front();
+    }
+    inline size_type size() const {
+        return m_container.size();
+    }
+    inline bool empty() const {
+        return m_container.empty();
+    }
+    inline void clear() {
+        m_container.clear();
+    }
+
+    /**
+     * Replaces the first element equal to 'from', returns false if not found.
+     * Increasing the priority sifts the element up in O(log n).
+     */
+    bool update(const_reference from, const_reference to) {
+        const typename Container::iterator itr = std::find(m_container.begin(), m_container.end(), from);
+        if (itr == m_container.end())
+            return false;
+        const bool increased = m_compare(*itr, to);
+        *itr = to;
+        if (increased)
+            std::push_heap(m_container.begin(), itr + 1, m_compare);
+        else
+            std::make_heap(m_container.begin(), m_container.end(), m_compare);
+        return true;
+    }
+
+    /**
+     * Calls fn on every element then restores the heap in O(n)
+     */
+    template<typename Fn>
+    void updateAll(Fn fn) {
+        std::for_each(m_container.begin(), m_container.end(), fn);
+        std::make_heap(m_container.begin(), m_container.end(), m_compare);
+    }
+
+private:
+    Container m_container;
+    Compare m_compare;
+};
+
+/**
+ * Draining a heap yields its elements by decreasing priority
+ */
+template<typename T, typename Compare, typename Container, typename C2>
+inline void drain_container(heap_container<T, Compare, Container>& from, C2& to) {
+    std::back_insert_iterator<C2> inserter(to);
+    while (!from.empty())
+        *inserter++ = from.pop();
+}
+
+template<typename C1, typename T, typename Compare, typename Container>
+inline void drain_container(C1& from, heap_container<T, Compare, Container>& to) {
+    for (typename C1::const_iterator itr = from.begin(); itr != from.end(); ++itr)
+        to.push(*itr);
+    from.clear();
+}
+
+/**
+ * Implementation shared by the heap based queues
+ */
+template<typename Derived, typename T, typename Compare, typename Container, typename Policy>
+struct heap_queue : public queue_base<Derived, heap_container<T, Compare, Container>, Policy> {
+    typedef heap_container<T, Compare, Container> container_type;
+    typedef typename container_type::value_type value_type;
+    typedef typename container_type::size_type size_type;
+    typedef typename container_type::const_reference const_reference;
+
+    /**
+     * Decrease-key : replaces an element already in the queue, e.g. to
+     * reprioritize a request after a seek. Returns false if not found.
+     */
+    bool update(const_reference from, const_reference to) {
+        std::unique_lock<mutex_type> lock(this->acquire());
+        this->checkTermination();
+        if (!m_container.update(from, to))
+            return false;
+        m_not_empty.notify_all();
+        return true;
+    }
+
+    /**
+     * Calls 'void fn(T&)' on every element in the queue and reorders them.
+     */
+    template<typename Fn>
+    void updateAll(Fn fn) {
+        std::unique_lock<mutex_type> lock(this->acquire());
+        this->checkTermination();
+        m_container.updateAll(fn);
+        m_not_empty.notify_all();
+    }
+
+protected:
+    template<typename _T, typename _Container, typename _Policy>
+    friend struct queue_base;
+
+    inline void _clear() {
+        m_container.clear();
+    }
+    inline void _push(const_reference value) {
+        m_container.push(value);
+    }
+    inline size_type _size() const {
+        return m_container.size();
+    }
+    inline value_type _pop() {
+        return m_container.pop();
+    }
+    inline void wait_not_empty(std::unique_lock<mutex_type> &lock) {
+        m_not_empty.wait(lock, [this]() { return is_not_empty() || this->is_terminated(); });
+    }
+    inline void wait_not_empty_until(std::unique_lock<mutex_type> &lock, const details::clock_type::time_point &deadline) {
+        m_not_empty.wait_until(lock, deadline, [this]() { return is_not_empty() || this->is_terminated(); });
+    }
+    inline void wait_not_full(std::unique_lock<mutex_type> &lock) {
+    }
+    inline bool is_not_empty() const {
+        return !m_container.empty();
+    }
+    inline bool is_not_full() const {
+        return true;
+    }
+    inline void notify_not_full() {
+    }
+    inline void notify_not_empty() {
+        m_not_empty.notify_one();
+    }
+    inline void notify_all() {
+        m_not_empty.notify_all();
+    }
+
+    container_type m_container;
+    wait_condition<typename Policy::wait_type> m_not_empty;
+};
+
+} // namespace details
+
+/**
+ * Unbounded concurrent queue, pop returns the greatest element according to
+ * Compare. Elements must be equality comparable to be updated.
+ */
+template<typename T, typename Compare = std::less<T>, typename Container = std::vector<T>, typename Policy = default_queue_policy>
+struct priority_queue : public details::heap_queue<priority_queue<T, Compare, Container, Policy>, T, Compare, Container, Policy> {
+};
+
+} // namespace concurrent
+
+#endif /* CONCURRENT_PRIORITY_QUEUE_HPP_ */
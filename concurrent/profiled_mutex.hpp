@@ -0,0 +1,256 @@
+/*
+ * profiled_mutex.hpp
+ *
+ *  A mutex recording acquire latency, hold time and contention per named
+ *  lock site.
+ *
+ *  Define CONCURRENT_PROFILE_LOCKS before including any header of this
+ *  library to have the queues and the lookahead cache use it.
+ */
+
+#ifndef PROFILED_MUTEX_HPP_
+#define PROFILED_MUTEX_HPP_
+
+#include "common.hpp"
+#include "stats.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <cstdint>
+
+namespace concurrent {
+
+/**
+ * Aggregated measures for all the mutexes sharing the same name
+ */
+struct lock_profile : private noncopyable {
+	explicit lock_profile(const std::string &name) :
+			name(name), acquisitions(0), contentions(0), acquireNs(0), maxAcquireNs(0), holdNs(0), maxHoldNs(0) {
+	}
+
+	const std::string name;
+	std::atomic<uint64_t> acquisitions;
+	std::atomic<uint64_t> contentions; // lock was already held
+	std::atomic<uint64_t> acquireNs;
+	std::atomic<uint64_t> maxAcquireNs;
+	std::atomic<uint64_t> holdNs;
+	std::atomic<uint64_t> maxHoldNs;
+};
+
+/**
+ * Singleton holding the lock profiles and the optional trace events.
+ */
+struct lock_registry : private noncopyable {
+	typedef std::chrono::steady_clock clock;
+
+	static lock_registry& instance() {
+		static lock_registry registry;
+		return registry;
+	}
+
+	/**
+	 * Returns the profile for the given name, the reference is valid for the
+	 * whole program lifetime.
+	 */
+	lock_profile& site(const std::string &name) {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (const auto &pProfile : m_Profiles)
+			if (pProfile->name == name)
+				return *pProfile;
+		m_Profiles.emplace_back(new lock_profile(name));
+		return *m_Profiles.back();
+	}
+
+	/**
+	 * When enabled, each acquisition records a wait and a hold event which
+	 * can be exported with writeChromeTrace.
+	 */
+	void setTracing(bool enabled) {
+		m_Tracing.store(enabled, std::memory_order_relaxed);
+	}
+
+	inline bool tracing() const {
+		return m_Tracing.load(std::memory_order_relaxed);
+	}
+
+	void record(const lock_profile &profile, clock::time_point requested, clock::time_point acquired, clock::time_point released) {
+		thread_buffer &buffer = localBuffer();
+		std::lock_guard<std::mutex> lock(buffer.mutex); // only contended while exporting
+		const event e = { &profile, requested, acquired, released };
+		buffer.events.push_back(e);
+	}
+
+	void reset() {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (const auto &pProfile : m_Profiles) {
+			pProfile->acquisitions = 0;
+			pProfile->contentions = 0;
+			pProfile->acquireNs = 0;
+			pProfile->maxAcquireNs = 0;
+			pProfile->holdNs = 0;
+			pProfile->maxHoldNs = 0;
+		}
+		for (const auto &pBuffer : m_Buffers) {
+			std::lock_guard<std::mutex> bufferLock(pBuffer->mutex);
+			pBuffer->events.clear();
+		}
+	}
+
+	/**
+	 * One line per lock site, times in microseconds
+	 */
+	void writeSummary(std::ostream &out) const {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		out << "lock\tacquisitions\tcontentions\tavg acquire\tmax acquire\tavg hold\tmax hold\n";
+		for (const auto &pProfile : m_Profiles) {
+			const lock_profile &p = *pProfile;
+			const uint64_t count = p.acquisitions.load();
+			const double divider = count ? count * 1000. : 1;
+			out << p.name << '\t' << count << '\t' << p.contentions.load() << '\t';
+			out << p.acquireNs.load() / divider << '\t' << p.maxAcquireNs.load() / 1000. << '\t';
+			out << p.holdNs.load() / divider << '\t' << p.maxHoldNs.load() / 1000. << '\n';
+		}
+	}
+
+	/**
+	 * Writes the recorded events in the Chrome trace event format, load the
+	 * file in chrome://tracing or Perfetto to see lock convoys.
+	 */
+	void writeChromeTrace(std::ostream &out) const {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		out << "{\"traceEvents\":[";
+		bool first = true;
+		const auto write = [&](const char *prefix, const lock_profile &profile, size_t tid, clock::time_point from, clock::time_point to) {
+			if (!first)
+				out << ',';
+			first = false;
+			out << "\n{\"name\":\"" << prefix << profile.name << "\",\"cat\":\"lock\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid;
+			out << ",\"ts\":" << micros(from - m_Origin) << ",\"dur\":" << micros(to - from) << '}';
+		};
+		for (const auto &pBuffer : m_Buffers) {
+			std::lock_guard<std::mutex> bufferLock(pBuffer->mutex);
+			for (const event &e : pBuffer->events) {
+				write("wait ", *e.profile, pBuffer->tid, e.requested, e.acquired);
+				write("hold ", *e.profile, pBuffer->tid, e.acquired, e.released);
+			}
+		}
+		out << "\n]}\n";
+	}
+
+private:
+	struct event {
+		const lock_profile *profile;
+		clock::time_point requested;
+		clock::time_point acquired;
+		clock::time_point released;
+	};
+
+	struct thread_buffer {
+		size_t tid;
+		std::mutex mutex;
+		std::vector<event> events;
+	};
+
+	lock_registry() :
+			m_Tracing(false), m_Origin(clock::now()) {
+	}
+
+	inline static double micros(clock::duration duration) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / 1000.;
+	}
+
+	thread_buffer& localBuffer() {
+		// buffers are owned by the registry so events survive their thread
+		static thread_local thread_buffer *pBuffer = nullptr;
+		if (!pBuffer) {
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Buffers.emplace_back(new thread_buffer());
+			pBuffer = m_Buffers.back().get();
+			pBuffer->tid = m_Buffers.size();
+		}
+		return *pBuffer;
+	}
+
+	mutable std::mutex m_Mutex;
+	std::deque<std::unique_ptr<lock_profile> > m_Profiles;
+	std::deque<std::unique_ptr<thread_buffer> > m_Buffers;
+	std::atomic<bool> m_Tracing;
+	const clock::time_point m_Origin;
+};
+
+/**
+ * Drop in replacement for std::mutex, use with std::condition_variable_any
+ */
+struct profiled_mutex : private noncopyable {
+	typedef lock_registry::clock clock;
+
+	explicit profiled_mutex(const char *name = "unnamed") :
+			m_pProfile(&lock_registry::instance().site(name)) {
+	}
+
+	void setName(const char *name) {
+		m_pProfile = &lock_registry::instance().site(name);
+	}
+
+	void lock() {
+		const clock::time_point requested = clock::now();
+		if (!m_Mutex.try_lock()) {
+			m_pProfile->contentions.fetch_add(1, std::memory_order_relaxed);
+			m_Mutex.lock();
+		}
+		acquired(requested);
+	}
+
+	bool try_lock() {
+		const clock::time_point requested = clock::now();
+		if (!m_Mutex.try_lock()) {
+			m_pProfile->contentions.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		acquired(requested);
+		return true;
+	}
+
+	void unlock() {
+		const clock::time_point released = clock::now();
+		const clock::time_point requested = m_Requested;
+		const clock::time_point acquiredAt = m_Acquired;
+		m_Mutex.unlock();
+		const uint64_t hold = nanos(released - acquiredAt);
+		m_pProfile->holdNs.fetch_add(hold, std::memory_order_relaxed);
+		details::relaxed_max(m_pProfile->maxHoldNs, hold);
+		lock_registry &registry = lock_registry::instance();
+		if (registry.tracing())
+			registry.record(*m_pProfile, requested, acquiredAt, released);
+	}
+
+private:
+	inline static uint64_t nanos(clock::duration duration) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+	}
+
+	inline void acquired(const clock::time_point requested) {
+		// only the owner writes these
+		m_Requested = requested;
+		m_Acquired = clock::now();
+		m_pProfile->acquisitions.fetch_add(1, std::memory_order_relaxed);
+		const uint64_t wait = nanos(m_Acquired - requested);
+		m_pProfile->acquireNs.fetch_add(wait, std::memory_order_relaxed);
+		details::relaxed_max(m_pProfile->maxAcquireNs, wait);
+	}
+
+	std::mutex m_Mutex;
+	lock_profile *m_pProfile;
+	clock::time_point m_Requested;
+	clock::time_point m_Acquired;
+};
+
+} // namespace concurrent
+
+#endif /* PROFILED_MUTEX_HPP_ */
@@ -3,8 +3,6 @@
 
 #include "details/queue_base.hpp"
 
-#include <condition_variable>
-#include <functional>
 #include <deque>
 
 namespace concurrent {
@@ -15,16 +13,14 @@ namespace concurrent {
  * Please note that a single Mutex is used for synchronization of front() and back()
  * thus leading to contention if consumer and producer are accessing the container at the same time.
  */
-template<typename T, typename Container = std::deque<T> >
-struct queue : public details::queue_base< queue<T>, Container > {
+template<typename T, typename Container = std::deque<T>, typename Policy = default_queue_policy>
+struct queue : public details::queue_base< queue<T, Container, Policy>, Container, Policy > {
     typedef Container container_type;
     typedef typename Container::value_type value_type;
     typedef typename Container::const_reference const_reference;
 
 private:
-    typedef queue<T, Container> ME;
-
-    template<typename _T,typename _Container>
+    template<typename _T, typename _Container, typename _Policy>
     friend struct details::queue_base;
 
     inline void _clear() {
@@ -33,15 +29,21 @@ private:
     inline void _push(value_type value) {
         m_container.push_back(value);
     }
+    inline typename container_type::size_type _size() const {
+        return m_container.size();
+    }
     inline value_type _pop() {
         value_type tmp(m_container.front());
         m_container.pop_front();
         return tmp;
     }
-    inline void wait_not_empty(std::unique_lock<std::mutex> &lock) {
-        m_not_empty.wait(lock, std::bind(&ME::is_not_empty, this));
+    inline void wait_not_empty(std::unique_lock<details::mutex_type> &lock) {
+        m_not_empty.wait(lock, [this]() { return is_not_empty() || this->is_terminated(); });
     }
-    inline void wait_not_full(std::unique_lock<std::mutex> &lock) {
+    inline void wait_not_empty_until(std::unique_lock<details::mutex_type> &lock, const details::clock_type::time_point &deadline) {
+        m_not_empty.wait_until(lock, deadline, [this]() { return is_not_empty() || this->is_terminated(); });
+    }
+    inline void wait_not_full(std::unique_lock<details::mutex_type> &lock) {
     }
     inline bool is_not_empty() const {
         return !m_container.empty();
@@ -54,9 +56,12 @@ private:
     inline void notify_not_empty() {
         m_not_empty.notify_one();
     }
+    inline void notify_all() {
+        m_not_empty.notify_all();
+    }
 private:
     container_type m_container;
-    std::condition_variable m_not_empty;
+    details::wait_condition<typename Policy::wait_type> m_not_empty;
 };
 
 } // namespace concurrent
@@ -0,0 +1,33 @@
+/*
+ * queue_policy.hpp
+ *
+ *  Compile time customization of the queues.
+ */
+
+#ifndef QUEUE_POLICY_HPP_
+#define QUEUE_POLICY_HPP_
+
+#include "stats.hpp"
+#include "wait_strategy.hpp"
+
+namespace concurrent {
+
+/**
+ * Default behavior of the queues.
+ *
+ * To customize a queue, inherit from this struct and shadow the typedefs you
+ * want to change, then pass it as the last template argument of the queue.
+ *
+ * struct my_policy : public default_queue_policy {
+ *     typedef queue_stats stats_type;
+ *     typedef adaptive_spin_wait wait_type;
+ * };
+ */
+struct default_queue_policy {
+	typedef no_queue_stats stats_type;
+	typedef block_wait wait_type;
+};
+
+} // namespace concurrent
+
+#endif /* QUEUE_POLICY_HPP_ */
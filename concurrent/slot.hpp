@@ -9,90 +9,185 @@
 #define CONCURRENTSLOT_HPP_
 
 #include "common.hpp"
+#include "wait_strategy.hpp"
+#include "details/atomic_wait.hpp"
 
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <mutex>
-#include <condition_variable>
-#include <cassert>
+#include <new>
+#include <vector>
 
 namespace concurrent {
 
 /**
  * Thread safe access to a T object
  *
- * By setting terminate to true, getters will throw a terminated exception
+ * By setting terminate to true, getters will throw a terminated exception,
+ * the std::nothrow and timed getters return pop_status::TERMINATED instead
+ *
+ * WAIT is the waiting strategy of waitGet, see wait_strategy.hpp
+ *
+ * No mutex is involved : the object lives in a node swapped atomically,
+ * tryGet is lock free and waitGet blocks on a futex (or atomic wait). The
+ * consumed node is kept aside so that steady state set/get do not allocate.
  */
-template<typename T>
+template<typename T, typename WAIT = block_wait>
 struct slot : private noncopyable {
-    slot() : m_SharedObjectSet(false), m_SharedTerminate(false) {
+    slot() : m_Value(nullptr), m_Spare(nullptr), m_State(0), m_AsyncWaiters(0) {
+    }
+
+    slot(const T&object) : m_Value(new node(object)), m_Spare(nullptr), m_State(0), m_AsyncWaiters(0) {
     }
 
-    slot(const T&object) : m_SharedObject(object), m_SharedObjectSet(true), m_SharedTerminate(false) {
+    ~slot() {
+        delete m_Value.load();
+        delete m_Spare.load();
     }
 
     void set(const T& object) {
-        // locking the shared object
-        std::unique_lock<std::mutex> lock(m_Mutex);
-        internal_set(object);
-        lock.unlock();
+        node *pNode = m_Spare.exchange(nullptr);
+        if (pNode)
+            pNode->value = object;
+        else
+            pNode = new node(object);
+        recycle(m_Value.exchange(pNode));
         // notifying shared structure is updated
-        m_Condition.notify_one();
+        m_State.fetch_add(SEQUENCE);
+        m_Waiter.notify_one(m_State);
+        if (m_AsyncWaiters.load())
+            notifyAsync(false);
     }
 
     void terminate(bool value = true) {
-    	std::unique_lock<std::mutex> lock(m_Mutex);
-        m_SharedTerminate = value;
-        lock.unlock();
-        m_Condition.notify_all();
+        if (value)
+            m_State.fetch_or(TERMINATED);
+        else
+            m_State.fetch_and(~TERMINATED);
+        m_Waiter.notify_all(m_State);
+        if (value && m_AsyncWaiters.load())
+            notifyAsync(true);
     }
 
     void waitGet(T& value) {
-    	std::unique_lock<std::mutex> lock(m_Mutex);
-
-        checkTermination();
+        if (waitUntil(value, nullptr) == pop_status::TERMINATED)
+            CONCURRENT_THROW(terminated());
+    }
 
-        // blocking until set or terminate
-        while (!m_SharedObjectSet) {
-            m_Condition.wait(lock);
-            checkTermination();
-        }
+    bool tryGet(T& holder) {
+        const pop_status status = tryGet(holder, std::nothrow);
+        if (status == pop_status::TERMINATED)
+            CONCURRENT_THROW(terminated());
+        return status == pop_status::OK;
+    }
 
-        internal_unset(value);
+    /**
+     * Status returning getters, termination is reported without throwing
+     */
+    pop_status waitGet(T& value, const std::nothrow_t&) {
+        return waitUntil(value, nullptr);
     }
 
-    bool tryGet(T& holder) {
-        // locking the shared object
-        ::std::lock_guard<std::mutex> lock(m_Mutex);
-        checkTermination();
+    template<typename Rep, typename Period>
+    pop_status waitGet(T& value, const std::chrono::duration<Rep, Period> &timeout) {
+        const details::clock_type::time_point deadline = details::deadline_after(timeout);
+        return waitUntil(value, &deadline);
+    }
 
-        if (!m_SharedObjectSet)
-            return false;
+    pop_status tryGet(T& holder, const std::nothrow_t&) {
+        if (m_State.load() & TERMINATED)
+            return pop_status::TERMINATED;
+        return take(holder) ? pop_status::OK : pop_status::TIMEOUT;
+    }
 
-        internal_unset(holder);
-        return true;
+    /**
+     * Gets without blocking the thread : returns true if value was taken,
+     * otherwise 'ready' is called once the slot is set or terminated and the
+     * caller should try again. 'ready' is called by the setting thread and
+     * must not block. Only these waiters go through a mutex.
+     */
+    bool getOrNotify(T& value, const std::function<void()> &ready) {
+        const std::lock_guard<std::mutex> lock(m_AsyncMutex);
+        // announced before checking, set and terminate check it after updating
+        m_AsyncWaiters.fetch_add(1);
+        const pop_status status = tryGet(value, std::nothrow);
+        if (status != pop_status::TIMEOUT) {
+            m_AsyncWaiters.fetch_sub(1);
+            if (status == pop_status::TERMINATED)
+                CONCURRENT_THROW(terminated());
+            return true;
+        }
+        m_AsyncCallbacks.push_back(ready);
+        return false;
     }
 private:
-    inline void checkTermination() const {
-        // mutex *must* be locked here, we are reading a shared variable
-        if (m_SharedTerminate)
-            throw terminated();
+    enum {
+        TERMINATED = 1, SEQUENCE = 2
+    };
+
+    struct node {
+        node(const T &value) : value(value) {
+        }
+        T value;
+    };
+
+    /**
+     * Takes the value, waiting until it is set or until deadline, or forever
+     * if deadline is null. Returns TIMEOUT or TERMINATED instead of throwing.
+     */
+    pop_status waitUntil(T& value, const details::clock_type::time_point *deadline) {
+        // blocking until set, terminate or the deadline
+        for (;;) {
+            const uint32_t state = m_State.load();
+            if (state & TERMINATED)
+                return pop_status::TERMINATED;
+            if (take(value))
+                return pop_status::OK;
+            if (!deadline)
+                m_Waiter.wait(m_State, state);
+            else if (details::clock_type::now() < *deadline)
+                m_Waiter.wait_until(m_State, state, *deadline);
+            else
+                return pop_status::TIMEOUT;
+        }
     }
 
-    inline void internal_set(const T& value){
-        m_SharedObject = value;
-        m_SharedObjectSet = true;
+    inline bool take(T& value) {
+        node * const pNode = m_Value.exchange(nullptr);
+        if (!pNode)
+            return false;
+        value = pNode->value;
+        recycle(pNode);
+        return true;
     }
 
-    inline void internal_unset(T& value){
-        assert(m_SharedObjectSet);
-        value = m_SharedObject;
-        m_SharedObjectSet = false;
+    inline void recycle(node *pNode) {
+        if (pNode)
+            delete m_Spare.exchange(pNode);
+    }
+
+    void notifyAsync(const bool all) {
+        std::vector<std::function<void()> > ready;
+        {
+            const std::lock_guard<std::mutex> lock(m_AsyncMutex);
+            while (!m_AsyncCallbacks.empty() && (all || ready.empty())) {
+                ready.push_back(m_AsyncCallbacks.front());
+                m_AsyncCallbacks.pop_front();
+                m_AsyncWaiters.fetch_sub(1);
+            }
+        }
+        for (const auto &callback : ready)
+            callback();
     }
 
-    mutable std::mutex m_Mutex;
-    ::std::condition_variable m_Condition;
-    T m_SharedObject;
-    bool m_SharedObjectSet;
-    bool m_SharedTerminate;
+    std::atomic<node*> m_Value;
+    std::atomic<node*> m_Spare;
+    details::wait_word m_State; // terminate flag and set counter
+    details::atomic_waiter<WAIT> m_Waiter;
+    std::atomic<uint32_t> m_AsyncWaiters; // registered or registering getOrNotify
+    std::mutex m_AsyncMutex;
+    std::deque<std::function<void()> > m_AsyncCallbacks;
 };
 
 }  // namespace concurrent
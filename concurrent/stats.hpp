@@ -0,0 +1,232 @@
+/*
+ * stats.hpp
+ *
+ *  Statistics policies for the queues.
+ *
+ *  Counters are relaxed atomics : they can be read at any time from any
+ *  thread but a snapshot is not a consistent view of all the counters.
+ *  The no_* variants have the same interface and compile to nothing.
+ */
+
+#ifndef STATS_HPP_
+#define STATS_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace concurrent {
+
+/**
+ * Measures elapsed time in nanoseconds
+ */
+struct stopwatch {
+	stopwatch() :
+			m_Start(std::chrono::steady_clock::now()) {
+	}
+	inline uint64_t elapsed() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Start).count();
+	}
+private:
+	std::chrono::steady_clock::time_point m_Start;
+};
+
+/**
+ * Does not read the clock at all
+ */
+struct null_stopwatch {
+	inline uint64_t elapsed() const {
+		return 0;
+	}
+};
+
+/**
+ * Immutable copy of a histogram, bucket i counts values in [2^(i-1), 2^i[
+ */
+struct histogram_snapshot {
+	static const size_t BUCKETS = 40;
+
+	uint64_t buckets[BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+
+	histogram_snapshot() :
+			count(0), sum(0) {
+		for (auto &bucket : buckets)
+			bucket = 0;
+	}
+
+	inline double mean() const {
+		return count ? double(sum) / count : 0;
+	}
+
+	/**
+	 * Upper bound of the bucket holding the given percentile (in [0,1])
+	 */
+	uint64_t percentile(const double p) const {
+		const uint64_t rank = uint64_t(p * count);
+		uint64_t accumulated = 0;
+		for (size_t i = 0; i < BUCKETS; ++i) {
+			accumulated += buckets[i];
+			if (accumulated > rank)
+				return i == 0 ? 0 : uint64_t(1) << i;
+		}
+		return count ? uint64_t(1) << (BUCKETS - 1) : 0;
+	}
+};
+
+/**
+ * Lock free log2 histogram
+ */
+struct histogram {
+	static const size_t BUCKETS = histogram_snapshot::BUCKETS;
+
+	histogram() :
+			m_Count(0), m_Sum(0) {
+		for (auto &bucket : m_Buckets)
+			bucket.store(0, std::memory_order_relaxed);
+	}
+
+	inline void record(const uint64_t value) {
+		m_Buckets[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+		m_Count.fetch_add(1, std::memory_order_relaxed);
+		m_Sum.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	histogram_snapshot snapshot() const {
+		histogram_snapshot result;
+		for (size_t i = 0; i < BUCKETS; ++i)
+			result.buckets[i] = m_Buckets[i].load(std::memory_order_relaxed);
+		result.count = m_Count.load(std::memory_order_relaxed);
+		result.sum = m_Sum.load(std::memory_order_relaxed);
+		return result;
+	}
+
+private:
+	inline static size_t bucket(uint64_t value) {
+		size_t index = 0;
+		while (value && index < BUCKETS - 1) {
+			value >>= 1;
+			++index;
+		}
+		return index;
+	}
+
+	std::atomic<uint64_t> m_Buckets[BUCKETS];
+	std::atomic<uint64_t> m_Count;
+	std::atomic<uint64_t> m_Sum;
+};
+
+namespace details {
+
+inline void relaxed_max(std::atomic<uint64_t> &value, const uint64_t candidate) {
+	uint64_t current = value.load(std::memory_order_relaxed);
+	while (current < candidate && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed))
+		;
+}
+
+} // namespace details
+
+struct queue_stats_snapshot {
+	uint64_t pushes;
+	uint64_t pops;
+	uint64_t depth;
+	uint64_t maxDepth;
+	uint64_t fullTryPush; // tryPush on a full queue
+	uint64_t emptyTryPop; // tryPop on an empty queue
+	histogram_snapshot lockWait; // ns to acquire the queue mutex
+	histogram_snapshot pushWait; // ns blocked waiting for room
+	histogram_snapshot popWait; // ns blocked waiting for an item
+
+	queue_stats_snapshot() :
+			pushes(0), pops(0), depth(0), maxDepth(0), fullTryPush(0), emptyTryPop(0) {
+	}
+};
+
+/**
+ * Default queue statistics, everything is optimized away
+ */
+struct no_queue_stats {
+	typedef null_stopwatch stopwatch_type;
+	static const bool enabled = false;
+
+	inline void onPush(size_t, size_t) {}
+	inline void onPop(size_t, size_t) {}
+	inline void onClear() {}
+	inline void onFull() {}
+	inline void onEmpty() {}
+	inline void onLockWait(uint64_t) {}
+	inline void onPushWait(uint64_t) {}
+	inline void onPopWait(uint64_t) {}
+
+	queue_stats_snapshot snapshot() const {
+		return queue_stats_snapshot();
+	}
+};
+
+struct queue_stats {
+	typedef stopwatch stopwatch_type;
+	static const bool enabled = true;
+
+	queue_stats() :
+			m_Pushes(0), m_Pops(0), m_Depth(0), m_MaxDepth(0), m_FullTryPush(0), m_EmptyTryPop(0) {
+	}
+
+	inline void onPush(size_t count, size_t depth) {
+		m_Pushes.fetch_add(count, std::memory_order_relaxed);
+		m_Depth.store(depth, std::memory_order_relaxed);
+		details::relaxed_max(m_MaxDepth, depth);
+	}
+	inline void onPop(size_t count, size_t depth) {
+		m_Pops.fetch_add(count, std::memory_order_relaxed);
+		m_Depth.store(depth, std::memory_order_relaxed);
+	}
+	inline void onClear() {
+		m_Depth.store(0, std::memory_order_relaxed);
+	}
+	inline void onFull() {
+		m_FullTryPush.fetch_add(1, std::memory_order_relaxed);
+	}
+	inline void onEmpty() {
+		m_EmptyTryPop.fetch_add(1, std::memory_order_relaxed);
+	}
+	inline void onLockWait(uint64_t ns) {
+		m_LockWait.record(ns);
+	}
+	inline void onPushWait(uint64_t ns) {
+		m_PushWait.record(ns);
+	}
+	inline void onPopWait(uint64_t ns) {
+		m_PopWait.record(ns);
+	}
+
+	queue_stats_snapshot snapshot() const {
+		queue_stats_snapshot result;
+		result.pushes = m_Pushes.load(std::memory_order_relaxed);
+		result.pops = m_Pops.load(std::memory_order_relaxed);
+		result.depth = m_Depth.load(std::memory_order_relaxed);
+		result.maxDepth = m_MaxDepth.load(std::memory_order_relaxed);
+		result.fullTryPush = m_FullTryPush.load(std::memory_order_relaxed);
+		result.emptyTryPop = m_EmptyTryPop.load(std::memory_order_relaxed);
+		result.lockWait = m_LockWait.snapshot();
+		result.pushWait = m_PushWait.snapshot();
+		result.popWait = m_PopWait.snapshot();
+		return result;
+	}
+
+private:
+	std::atomic<uint64_t> m_Pushes;
+	std::atomic<uint64_t> m_Pops;
+	std::atomic<uint64_t> m_Depth;
+	std::atomic<uint64_t> m_MaxDepth;
+	std::atomic<uint64_t> m_FullTryPush;
+	std::atomic<uint64_t> m_EmptyTryPop;
+	histogram m_LockWait;
+	histogram m_PushWait;
+	histogram m_PopWait;
+};
+
+} // namespace concurrent
+
+#endif /* STATS_HPP_ */
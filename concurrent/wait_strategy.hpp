@@ -0,0 +1,187 @@
+/*
+ * wait_strategy.hpp
+ *
+ *  How a thread waits for a queue or a slot to be ready.
+ *
+ *  - block_wait parks the thread on a condition variable right away
+ *  - adaptive_spin_wait spins, then yields, then parks. The spin budget
+ *    grows when spinning was enough and shrinks when the thread had to park.
+ *  - busy_spin_wait never parks, for threads pinned to their own core.
+ *    It burns a core per waiting thread and starves the producer when the
+ *    cores are oversubscribed.
+ *
+ *  Notifiers skip the condition variable entirely when no thread is parked.
+ */
+
+#ifndef WAIT_STRATEGY_HPP_
+#define WAIT_STRATEGY_HPP_
+
+#include "common.hpp"
+#include "details/mutex.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <thread>
+
+namespace concurrent {
+
+struct block_wait {
+	static const unsigned min_spins = 0;
+	static const unsigned max_spins = 0;
+	static const unsigned yields = 0;
+	static const bool parks = true;
+};
+
+struct adaptive_spin_wait {
+	static const unsigned min_spins = 64;
+	static const unsigned max_spins = 8192;
+	static const unsigned yields = 8;
+	static const bool parks = true;
+};
+
+struct busy_spin_wait {
+	static const unsigned min_spins = 0;
+	static const unsigned max_spins = 0;
+	static const unsigned yields = 0;
+	static const bool parks = false;
+};
+
+namespace details {
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+/**
+ * Condition variable waiting according to Strategy.
+ *
+ * Waits and notifications *must* happen with the associated mutex locked :
+ * the number of parked threads is protected by it.
+ */
+template<typename Strategy, typename Mutex = mutex_type, typename Condition = condition_type>
+struct wait_condition: private noncopyable {
+	typedef std::unique_lock<Mutex> lock_type;
+
+	wait_condition() :
+			m_Epoch(0), m_SpinLimit(Strategy::min_spins), m_Parked(0) {
+	}
+
+	template<typename Predicate>
+	void wait(lock_type &lock, Predicate ready) {
+		if (ready())
+			return;
+		if (!Strategy::parks) {
+			while (!ready())
+				spin(lock, ~0u, 0);
+			return;
+		}
+		if (Strategy::max_spins || Strategy::yields) {
+			// only notifications caught while spinning make spinning worth it
+			const unsigned limit = m_SpinLimit.load(std::memory_order_relaxed);
+			bool spinning = true;
+			for (;;) {
+				const notification notified = spin(lock, limit, Strategy::yields);
+				spinning = spinning && notified == WHILE_SPINNING;
+				if (ready()) {
+					adapt(limit, spinning);
+					return;
+				}
+				if (notified == NONE)
+					break;
+			}
+			adapt(limit, false);
+		}
+		++m_Parked;
+		m_Condition.wait(lock, ready);
+		--m_Parked;
+	}
+
+	/**
+	 * Parks once, the caller checks its own condition
+	 */
+	void wait(lock_type &lock) {
+		++m_Parked;
+		m_Condition.wait(lock);
+		--m_Parked;
+	}
+
+	template<typename TimePoint>
+	void wait_until(lock_type &lock, const TimePoint &deadline) {
+		++m_Parked;
+		m_Condition.wait_until(lock, deadline);
+		--m_Parked;
+	}
+
+	/**
+	 * Parks without spinning until ready() or the deadline, returns ready()
+	 */
+	template<typename TimePoint, typename Predicate>
+	bool wait_until(lock_type &lock, const TimePoint &deadline, Predicate ready) {
+		if (ready())
+			return true;
+		++m_Parked;
+		const bool result = m_Condition.wait_until(lock, deadline, ready);
+		--m_Parked;
+		return result;
+	}
+
+	inline void notify_one() {
+		m_Epoch.fetch_add(1, std::memory_order_release);
+		if (m_Parked)
+			m_Condition.notify_one();
+	}
+
+	inline void notify_all() {
+		m_Epoch.fetch_add(1, std::memory_order_release);
+		if (m_Parked)
+			m_Condition.notify_all();
+	}
+
+private:
+	enum notification {
+		NONE, WHILE_SPINNING, WHILE_YIELDING
+	};
+
+	/**
+	 * Releases the lock and watches for a notification during 'spins' pause
+	 * instructions then 'yields' yields. The lock is held again on return.
+	 */
+	notification spin(lock_type &lock, const unsigned spins, const unsigned yields) {
+		const unsigned epoch = m_Epoch.load(std::memory_order_acquire);
+		lock.unlock();
+		notification notified = NONE;
+		for (unsigned i = 0; notified == NONE && i < spins; ++i) {
+			cpu_relax();
+			if (m_Epoch.load(std::memory_order_acquire) != epoch)
+				notified = WHILE_SPINNING;
+		}
+		for (unsigned i = 0; notified == NONE && i < yields; ++i) {
+			std::this_thread::yield();
+			if (m_Epoch.load(std::memory_order_acquire) != epoch)
+				notified = WHILE_YIELDING;
+		}
+		lock.lock();
+		return notified;
+	}
+
+	void adapt(const unsigned limit, const bool success) {
+		const unsigned minSpins = Strategy::min_spins;
+		const unsigned maxSpins = Strategy::max_spins;
+		const unsigned next = success ? std::min(maxSpins, limit * 2) : std::max(minSpins, limit / 2);
+		m_SpinLimit.store(next, std::memory_order_relaxed);
+	}
+
+	std::atomic<unsigned> m_Epoch; // bumped by every notification
+	std::atomic<unsigned> m_SpinLimit;
+	size_t m_Parked; // protected by the mutex
+	Condition m_Condition;
+};
+
+} // namespace details
+} // namespace concurrent
+
+#endif /* WAIT_STRATEGY_HPP_ */
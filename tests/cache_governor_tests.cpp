@@ -0,0 +1,113 @@
+#include <concurrent/cache/cache_governor.hpp>
+#include <concurrent/cache/lookahead_cache.hpp>
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace concurrent::cache;
+
+namespace {
+
+struct Frames {
+	size_t from;
+	size_t count;
+
+	Frames() :
+			from(0), count(0) {
+	}
+	Frames(size_t from, size_t count) :
+			from(from), count(count) {
+	}
+	size_t next() {
+		--count;
+		return from++;
+	}
+	bool empty() const {
+		return count == 0;
+	}
+	void clear() {
+		count = 0;
+	}
+};
+
+struct StatsPolicy: public default_cache_policy {
+	typedef cache_stats stats_type;
+};
+
+typedef lookahead_cache<size_t, size_t, int, Frames, StatsPolicy> CACHE;
+
+/**
+ * Requests the frames and pushes the first 'pushed' ones served
+ */
+void fill(CACHE &cache, const Frames &frames, size_t pushed = size_t(-1)) {
+	cache.process(frames);
+	size_t id;
+	while (cache.tryPop(id))
+		if (pushed && pushed--)
+			cache.push(id, 1, int(id));
+}
+
+std::vector<size_t> keys(const CACHE &cache) {
+	std::vector<size_t> keys;
+	cache.dumpKeys(keys);
+	return keys;
+}
+
+} // namespace
+
+TEST(CacheGovernor, sharesBudgetEqually ) {
+	cache_governor<> governor(90);
+	CACHE a(1000), b(1000), c(1000);
+	const auto la = governor.lease(a);
+	const auto lb = governor.lease(b);
+	const auto lc = governor.lease(c);
+	EXPECT_EQ( 30U, governor.leased(la) );
+	EXPECT_EQ( 30U, governor.leased(lb) );
+	EXPECT_EQ( 30U, governor.leased(lc) );
+	governor.release(lc);
+	EXPECT_EQ( 45U, governor.leased(la) );
+	EXPECT_EQ( 45U, governor.leased(lb) );
+	EXPECT_EQ( 0U, governor.leased(lc) );
+	// minimums come first
+	const auto lm = governor.lease(c, 60);
+	EXPECT_EQ( 60U + 10U, governor.leased(lm) );
+	EXPECT_EQ( 10U, governor.leased(la) );
+}
+
+TEST(CacheGovernor, busyCacheGrowsIdleCacheShrinks ) {
+	cache_governor<> governor(100);
+	CACHE busy(1000), idle(1000);
+	const auto lb = governor.lease(busy);
+	const auto li = governor.lease(idle);
+	EXPECT_EQ( 50U, governor.leased(lb) );
+	fill(idle, Frames(0, 10));
+	EXPECT_EQ( 10U, idle.weight() );
+	for (size_t round = 0; round < 6; ++round) {
+		fill(busy, Frames(round * 100, 100));
+		int data;
+		busy.get(round * 100, data);
+		governor.rebalance();
+		EXPECT_LE( governor.leased(lb) + governor.leased(li), 100U );
+		EXPECT_LE( busy.weight() + idle.weight(), 100U );
+	}
+	EXPECT_GT( governor.leased(lb), 90U );
+	EXPECT_LT( idle.weight(), 10U );
+	EXPECT_EQ( governor.leased(li), idle.weight() );
+}
+
+TEST(CacheGovernor, reclaimFollowsEvictionOrder ) {
+	cache_governor<> governor(100);
+	CACHE cache(1000);
+	governor.lease(cache);
+	fill(cache, Frames(0, 10));
+	// a new job, half of it is cached
+	fill(cache, Frames(10, 10), 5);
+	EXPECT_EQ( 15U, cache.weight() );
+	// the previous job goes first, farthest first
+	governor.setBudget(12);
+	EXPECT_EQ( std::vector<size_t>({0, 1, 2, 3, 4, 5, 6, 10, 11, 12, 13, 14}), keys(cache) );
+	// then the cached prefix of the current job, from its far end
+	governor.setBudget(3);
+	EXPECT_EQ( std::vector<size_t>({10, 11, 12}), keys(cache) );
+}
@@ -0,0 +1,160 @@
+#include <concurrent/cache/cache_loader.hpp>
+#include <concurrent/cache/lookahead_cache.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace concurrent;
+using namespace concurrent::cache;
+
+namespace {
+
+struct Frames {
+	size_t from;
+	size_t count;
+
+	Frames() :
+			from(0), count(0) {
+	}
+	Frames(size_t from, size_t count) :
+			from(from), count(count) {
+	}
+	size_t next() {
+		--count;
+		return from++;
+	}
+	bool empty() const {
+		return count == 0;
+	}
+	void clear() {
+		count = 0;
+	}
+};
+
+typedef lookahead_cache<size_t, size_t, std::string, Frames> CACHE;
+typedef cache_loader<CACHE> LOADER;
+
+/**
+ * One file per frame in a temporary directory, frame i holds i * 1000 + 1
+ * times the letter 'a' + i % 26
+ */
+struct frame_files {
+	frame_files(size_t count) {
+		char pattern[] = "/tmp/cache_loader_XXXXXX";
+		directory = mkdtemp(pattern);
+		for (size_t i = 0; i < count; ++i) {
+			FILE *file = fopen(path(i).c_str(), "wb");
+			const std::string content = expected(i);
+			fwrite(content.data(), 1, content.size(), file);
+			fclose(file);
+		}
+		this->count = count;
+	}
+	~frame_files() {
+		for (size_t i = 0; i < count; ++i)
+			unlink(path(i).c_str());
+		rmdir(directory.c_str());
+	}
+	std::string path(size_t id) const {
+		return directory + "/" + std::to_string(id);
+	}
+	static std::string expected(size_t id) {
+		return std::string(id * 1000 + 1, char('a' + id % 26));
+	}
+
+	std::string directory;
+	size_t count;
+};
+
+/**
+ * Loads the frames with one decode worker, returns the number of frames
+ * which did not match their file
+ */
+static size_t load(const frame_files &files, const size_t frames, const loader_options &options, bool &ioUring) {
+	CACHE cache(-1);
+	LOADER::queue_type loaded(4);
+	LOADER loader(cache, loaded, [&](const size_t &id) {
+		return files.path(id);
+	}, options);
+	size_t mismatches = 0;
+	std::thread decoder([&]() {
+		try {
+			LOADER::frame_type frame;
+			for (;;) {
+				loaded.pop(frame);
+				if (frame.error || std::string(frame.data->begin(), frame.data->end()) != frame_files::expected(frame.id))
+					++mismatches;
+				cache.push(frame.id, 1, std::string(frame.data->begin(), frame.data->end()));
+			}
+		} catch (concurrent::terminated &) {
+		}
+	});
+	ioUring = loader.start();
+	cache.process(Frames(0, frames));
+	std::vector<size_t> keys;
+	while (cache.dumpKeys(keys) < frames)
+		std::this_thread::yield();
+	loader.terminate();
+	decoder.join();
+	return mismatches;
+}
+
+} // namespace
+
+TEST(CacheLoader, ioUring ) {
+	const frame_files files(64);
+	bool ioUring = false;
+	loader_options options;
+	options.depth = 8;
+	EXPECT_EQ( 0u, load(files, files.count, options, ioUring) );
+#ifdef CONCURRENT_IO_URING
+	if (!ioUring)
+		std::cerr << "io_uring not supported, tested the thread pool" << std::endl;
+#else
+	EXPECT_FALSE( ioUring );
+#endif
+}
+
+TEST(CacheLoader, threadPool ) {
+	const frame_files files(64);
+	bool ioUring = true;
+	loader_options options;
+	options.ioUring = false;
+	options.threads = 3;
+	EXPECT_EQ( 0u, load(files, files.count, options, ioUring) );
+	EXPECT_FALSE( ioUring );
+}
+
+TEST(CacheLoader, missingFile ) {
+	for (const bool ioUring : { true, false }) {
+		const frame_files files(2);
+		CACHE cache(-1);
+		LOADER::queue_type loaded(4);
+		loader_options options;
+		options.ioUring = ioUring;
+		LOADER loader(cache, loaded, [&](const size_t &id) {
+			return files.path(id);
+		}, options);
+		loader.start();
+		cache.process(Frames(1, 2)); // there is no frame 2
+		LOADER::frame_type first, second;
+		loaded.pop(first);
+		loaded.pop(second);
+		if (first.id == 2)
+			std::swap(first, second);
+		EXPECT_EQ( 1u, first.id );
+		EXPECT_EQ( 0, first.error );
+		EXPECT_EQ( 1001u, first.data->size() );
+		EXPECT_EQ( 2u, second.id );
+		EXPECT_EQ( ENOENT, second.error );
+		loader.terminate();
+	}
+}
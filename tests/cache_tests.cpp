@@ -1,8 +1,16 @@
 #include <concurrent/cache/priority_cache.hpp>
+#include <concurrent/cache/lookahead_cache.hpp>
+#include <concurrent/cache/session_trace.hpp>
+#include <concurrent/cache/cache_index.hpp>
+#include <concurrent/cache/leveled_id.hpp>
 
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace concurrent::cache;
@@ -150,3 +158,619 @@ TEST(Cache, discardPendings )
     // requested [1], discardable [0,3]
     //           [X]              [_,_]
 }
+
+TEST(Cache, discardedJobsEvictedOldestFirst )
+{
+    CACHE cache(4);
+    // three jobs of two frames each, all cached
+    for (size_t job = 0; job < 3; ++job) {
+        cache.discardPending();
+        EXPECT_EQ( NEEDED, cache.update(job * 10) );
+        EXPECT_EQ( NEEDED, cache.update(job * 10 + 1) );
+        EXPECT_TRUE( cache.put(job * 10, 1, 0) );
+        EXPECT_TRUE( cache.put(job * 10 + 1, 1, 0) );
+    }
+    // [20,21] pending, [10,11] [0,1] discardable, 0 and 1 were evicted
+    EXPECT_FALSE( cache.contains(0) );
+    EXPECT_FALSE( cache.contains(1) );
+    EXPECT_TRUE( cache.pending(20) );
+    EXPECT_FALSE( cache.pending(10) );
+
+    cache.discardPending();
+    EXPECT_EQ( NEEDED, cache.update(30) );
+    EXPECT_EQ( NOT_NEEDED, cache.update(10) ); // back to pending
+    EXPECT_TRUE( cache.pending(10) );
+    EXPECT_TRUE( cache.put(30, 2, 0) );
+    // the most recent discarded job is evicted, from its end
+    EXPECT_TRUE( cache.contains(10) );
+    EXPECT_FALSE( cache.contains(11) );
+    EXPECT_FALSE( cache.contains(21) );
+    EXPECT_TRUE( cache.contains(20) );
+    EXPECT_EQ( 4U, cache.weight() );
+}
+
+TEST(Cache, jobReplacementAtDisplayRate )
+{
+    CACHE cache(100);
+    // the same window requested over and over, stale entries get compacted
+    for (size_t job = 0; job < 1000; ++job) {
+        cache.discardPending();
+        for (size_t id = job % 7; id < 50 + job % 7; ++id) {
+            if (cache.update(id) == NEEDED) {
+                EXPECT_TRUE( cache.put(id, 1, 0) );
+            }
+        }
+        EXPECT_TRUE( cache.pending(job % 7) );
+        EXPECT_FALSE( cache.pending(50 + job % 7) );
+    }
+    EXPECT_EQ( 56U, cache.weight() );
+    EXPECT_FALSE( cache.full() );
+}
+
+namespace {
+struct Range {
+    size_t from;
+    size_t count;
+
+    Range() : from(0), count(0) {
+    }
+    Range(size_t from, size_t count) : from(from), count(count) {
+    }
+    size_t next() {
+        --count;
+        return from++;
+    }
+    bool empty() const {
+        return count == 0;
+    }
+    void clear() {
+        count = 0;
+    }
+};
+}
+
+TEST(Cache, peekUpcoming )
+{
+    priority_cache<size_t, size_t, int, Range> cache(100);
+    cache.process(Range(0, 10));
+    EXPECT_TRUE( cache.push(2, 1, 0) ); // already there, won't be served
+    std::vector<size_t> ids;
+    EXPECT_EQ( 3U, cache.peekUpcoming(ids, 3) );
+    EXPECT_EQ( std::vector<size_t>({0, 1, 3}), ids );
+    // peeking claims nothing
+    cache.peekUpcoming(ids, 3);
+    EXPECT_EQ( std::vector<size_t>({0, 1, 3}), ids );
+    size_t id;
+    EXPECT_TRUE( cache.pop(id) );
+    EXPECT_EQ( 0U, id );
+    cache.peekUpcoming(ids, 3);
+    EXPECT_EQ( std::vector<size_t>({1, 3, 4}), ids );
+    EXPECT_EQ( 8U, cache.peekUpcoming(ids, 20) ); // 1 to 9 but 2
+}
+
+TEST(Cache, lookaheadPeekUpcoming )
+{
+    lookahead_cache<size_t, size_t, int, Range> cache(100);
+    std::vector<size_t> ids;
+    EXPECT_EQ( 0U, cache.peekUpcoming(ids, 4) );
+    cache.process(Range(0, 10));
+    cache.peekUpcoming(ids, 4);
+    EXPECT_EQ( std::vector<size_t>({0, 1, 2, 3}), ids );
+    size_t id;
+    cache.pop(id);
+    EXPECT_EQ( 0U, id );
+    // a new job replaces the current one
+    cache.process(Range(20, 2));
+    cache.peekUpcoming(ids, 4);
+    EXPECT_EQ( std::vector<size_t>({20, 21}), ids );
+    cache.pop(id);
+    EXPECT_EQ( 20U, id );
+    cache.terminate();
+    EXPECT_THROW( cache.peekUpcoming(ids, 4), concurrent::terminated );
+}
+
+TEST(Cache, lookaheadPeekWhileWorkerWaits )
+{
+    lookahead_cache<size_t, size_t, int, Range> cache(100);
+    std::atomic<size_t> popped(size_t(-1));
+    std::thread worker([&]() {
+        size_t unit;
+        if (cache.pop(unit, std::nothrow) == concurrent::pop_status::OK)
+            popped = unit;
+    });
+    // the worker waits on an empty job
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::vector<size_t> ids;
+    EXPECT_EQ( 0U, cache.peekUpcoming(ids, 4) );
+    cache.process(Range(5, 1));
+    worker.join();
+    EXPECT_EQ( 5U, popped.load() );
+    // peeking a new job does not pick it
+    cache.process(Range(10, 3));
+    EXPECT_EQ( 3U, cache.peekUpcoming(ids, 4) );
+    EXPECT_EQ( 3U, cache.peekUpcoming(ids, 4) );
+    EXPECT_EQ( std::vector<size_t>({10, 11, 12}), ids );
+}
+
+TEST(Cache, lookaheadPopOrNotifyWhileWorkerWaits )
+{
+    lookahead_cache<size_t, size_t, int, Range> cache(100);
+    std::thread worker([&]() {
+        size_t unit;
+        cache.pop(unit, std::nothrow);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    size_t id;
+    std::atomic<bool> ready(false);
+    EXPECT_FALSE( cache.popOrNotify(id, [&]() { ready = true; }) );
+    EXPECT_FALSE( ready.load() );
+    cache.process(Range(0, 2));
+    EXPECT_TRUE( ready.load() );
+    EXPECT_TRUE( cache.popOrNotify(id, [&]() {}) );
+    EXPECT_GT( 2U, id );
+    worker.join();
+}
+
+TEST(Cache, lookaheadTryPopWhileWorkerWaits )
+{
+    lookahead_cache<size_t, size_t, int, Range> cache(100);
+    std::atomic<concurrent::pop_status> status(concurrent::pop_status::OK);
+    std::thread worker([&]() {
+        size_t unit;
+        status = cache.pop(unit, std::chrono::seconds(10));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    size_t id;
+    EXPECT_EQ( concurrent::pop_status::TIMEOUT, cache.tryPop(id, std::nothrow) );
+    EXPECT_FALSE( cache.tryPop(id) );
+    cache.terminate();
+    worker.join();
+    EXPECT_EQ( concurrent::pop_status::TERMINATED, status.load() );
+    EXPECT_EQ( concurrent::pop_status::TERMINATED, cache.tryPop(id, std::nothrow) );
+}
+
+TEST(Cache, lookaheadStatusPop )
+{
+    lookahead_cache<size_t, size_t, int, Range> cache(100);
+    size_t id;
+    EXPECT_EQ( concurrent::pop_status::TIMEOUT, cache.tryPop(id, std::nothrow) );
+    EXPECT_EQ( concurrent::pop_status::TIMEOUT, cache.pop(id, std::chrono::milliseconds(1)) );
+    cache.process(Range(0, 2));
+    EXPECT_EQ( concurrent::pop_status::OK, cache.pop(id, std::nothrow) );
+    EXPECT_EQ( 0U, id );
+    // workers stopped and restarted on every new job
+    for (size_t job = 1; job <= 10; ++job) {
+        std::vector<std::thread> workers;
+        std::atomic<size_t> popped(0);
+        for (int i = 0; i < 4; ++i)
+            workers.emplace_back([&]() {
+                size_t unit;
+                while (cache.pop(unit, std::nothrow) == concurrent::pop_status::OK) {
+                    cache.push(unit, 1, int(unit));
+                    ++popped;
+                }
+            });
+        cache.process(Range(job * 10, 5));
+        while (popped < 5)
+            std::this_thread::yield();
+        cache.terminate();
+        for (std::thread &worker : workers)
+            worker.join();
+        EXPECT_EQ( concurrent::pop_status::TERMINATED, cache.pop(id, std::chrono::hours(1)) );
+        cache.terminate(false);
+    }
+    int data;
+    EXPECT_TRUE( cache.get(104, data) );
+    EXPECT_EQ( 104, data );
+}
+
+typedef std::vector<uint8_t> Bytes;
+
+static Bytes flatMatte(size_t size) {
+    Bytes matte(size, 0);
+    for (size_t i = size / 2; i < size; ++i)
+        matte[i] = 255;
+    matte[size / 3] = 42;
+    return matte;
+}
+
+TEST(Cache, rleRoundTrip )
+{
+    typedef rle_compression<100> CODEC;
+    const Bytes raw = flatMatte(1000);
+    Bytes compressed;
+    size_t weight = raw.size();
+    EXPECT_TRUE( CODEC::compress(raw, compressed, weight) );
+    EXPECT_LT( compressed.size(), raw.size() );
+    EXPECT_EQ( compressed.size(), weight );// weight follows compression ratio
+    Bytes decompressed;
+    CODEC::decompress(compressed, decompressed);
+    EXPECT_EQ( raw, decompressed );
+}
+
+TEST(Cache, rleIncompressible )
+{
+    Bytes noise(256);
+    for (size_t i = 0; i < noise.size(); ++i)
+        noise[i] = uint8_t(i);
+    Bytes compressed;
+    size_t weight = 10;
+    EXPECT_FALSE( rle_compression<>::compress(noise, compressed, weight) );
+    EXPECT_EQ( 10u, weight );// untouched
+}
+
+struct RlePolicy : public default_cache_policy {
+    typedef rle_compression<> compression_type;
+};
+
+TEST(Cache, compressColdEntries )
+{
+    typedef priority_cache_details<size_t, size_t, Bytes, RlePolicy> COMPRESSED_CACHE;
+    COMPRESSED_CACHE cache(10000);
+    const Bytes matte = flatMatte(1000);
+    for (size_t i = 0; i < 4; ++i) {
+        cache.update(i);
+        EXPECT_TRUE( cache.put(i, matte.size(), matte) );
+    }
+    EXPECT_EQ( 4000u, cache.weight() );
+    // only the two last entries are far enough from the playhead
+    EXPECT_EQ( 2u, cache.compress(2) );
+    EXPECT_GT( 4000u, cache.weight() );
+    // already compressed
+    EXPECT_EQ( 0u, cache.compress(2) );
+
+    Bytes data;
+    for (size_t i = 0; i < 4; ++i) {
+        EXPECT_TRUE( cache.get(i, data) );
+        EXPECT_EQ( matte, data );
+    }
+}
+
+TEST(Cache, priorityEvictionIgnoresCost )
+{
+    CACHE cache(2);
+    EXPECT_TRUE( cache.put(0,1,0,1) );// cheap
+    EXPECT_TRUE( cache.put(1,1,0,100) );// expensive
+    cache.update(5);
+    EXPECT_TRUE( cache.put(5,1,0,1) );
+    EXPECT_TRUE( cache.contains(0) );
+    EXPECT_FALSE( cache.contains(1) );// last discardable goes first
+}
+
+TEST(Cache, greedyDualSizeKeepsExpensive )
+{
+    CACHE cache(2);
+    cache.setEvictionMode(GREEDY_DUAL_SIZE);
+    EXPECT_TRUE( cache.put(0,1,0,1) );// cheap
+    EXPECT_TRUE( cache.put(1,1,0,100) );// expensive
+    cache.update(5);
+    EXPECT_TRUE( cache.put(5,1,0,1) );
+    EXPECT_FALSE( cache.contains(0) );// cheapest goes first
+    EXPECT_TRUE( cache.contains(1) );
+    EXPECT_TRUE( cache.contains(5) );
+}
+
+TEST(Cache, greedyDualSizeSkipsPending )
+{
+    CACHE cache(3);
+    EXPECT_TRUE( cache.put(0,1,0,1) );
+    EXPECT_TRUE( cache.put(1,1,0,100) );
+    EXPECT_TRUE( cache.put(2,1,0,50) );
+    cache.setEvictionMode(GREEDY_DUAL_SIZE);// ranks the cached entries
+    cache.update(5);
+    cache.update(6);
+    EXPECT_TRUE( cache.put(5,1,0,1) );
+    EXPECT_FALSE( cache.contains(0) );
+    EXPECT_TRUE( cache.put(6,1,0,1) );
+    EXPECT_FALSE( cache.contains(2) );// 5 is cheaper but pending
+    EXPECT_TRUE( cache.contains(1) );
+    EXPECT_TRUE( cache.contains(5) );
+}
+
+struct StatsPolicy : public default_cache_policy {
+    typedef cache_stats stats_type;
+};
+
+TEST(Cache, statistics )
+{
+    priority_cache_details<size_t, size_t, int, StatsPolicy> cache(1);
+    int data;
+    cache.update(0);
+    cache.update(0);
+    EXPECT_TRUE( cache.put(0,2,0) );// now full
+    EXPECT_FALSE( cache.put(1,1,0) );
+    EXPECT_EQ( FULL, cache.update(2) );
+    EXPECT_TRUE( cache.get(0, data) );
+    EXPECT_FALSE( cache.get(1, data) );
+
+    const cache_stats_snapshot stats = cache.stats().snapshot();
+    EXPECT_EQ( 1u, stats.needed );
+    EXPECT_EQ( 1u, stats.notNeeded );
+    EXPECT_EQ( 1u, stats.full );
+    EXPECT_EQ( 1u, stats.puts );
+    EXPECT_EQ( 1u, stats.rejectedPuts );
+    EXPECT_EQ( 1u, stats.hits );
+    EXPECT_EQ( 1u, stats.misses );
+    EXPECT_DOUBLE_EQ( .5, stats.hitRate() );
+}
+
+struct TracePolicy : public default_cache_policy {
+    typedef ring_tracer<16> tracer_type;
+};
+
+TEST(Cache, tracing )
+{
+    priority_cache_details<size_t, size_t, int, TracePolicy> cache(2);
+    int data;
+    EXPECT_EQ( NEEDED, cache.update(0) );
+    EXPECT_TRUE( cache.put(0,1,0) );
+    EXPECT_TRUE( cache.get(0, data) );
+    EXPECT_TRUE( cache.get(0, data) );
+    EXPECT_TRUE( cache.put(1,1,0) );// never read
+    cache.update(2);
+    EXPECT_TRUE( cache.put(2,1,0) );// evicts 1
+
+    const std::vector<trace_event> events = cache.tracer().events();
+    ASSERT_EQ( 8u, events.size() );
+    EXPECT_EQ( TRACE_ISSUE, events[0].type );
+    EXPECT_EQ( TRACE_EVICT, events[6].type );
+    EXPECT_EQ( 1u, events[6].key );
+
+    std::stringstream binary;
+    write_binary_trace(binary, events);
+    std::vector<trace_event> reloaded;
+    EXPECT_TRUE( read_binary_trace(binary, reloaded) );
+    EXPECT_EQ( events.size(), reloaded.size() );
+
+    const trace_report report = analyze_trace(reloaded);
+    EXPECT_EQ( 2u, report.issued );
+    EXPECT_EQ( 3u, report.pushed );
+    EXPECT_EQ( 1u, report.read );
+    EXPECT_EQ( 1u, report.wasted );
+    EXPECT_EQ( 1u, report.leadTimes.size() );
+}
+
+struct IndexPolicy : public default_cache_policy {
+    typedef range_index<size_t, 4> index_type;
+};
+
+TEST(Cache, rangeIndexMergesAndSplits )
+{
+    range_index<int> index;
+    for (int id : {3, 1, 2, 7, 5, 6})
+        index.onInsert(id);
+    range_index<int>::snapshot_ptr ranges = index.ranges();
+    ASSERT_EQ( 2u, ranges->ranges.size() );
+    EXPECT_EQ( 1, ranges->ranges[0].first );
+    EXPECT_EQ( 3, ranges->ranges[0].last );
+    EXPECT_EQ( 5, ranges->ranges[1].first );
+    EXPECT_EQ( 7, ranges->ranges[1].last );
+    EXPECT_EQ( 6u, ranges->count() );
+    EXPECT_EQ( 6u, index.version() );
+    EXPECT_EQ( ranges, index.ranges() ); // copied on changes only
+
+    index.onErase(2);
+    index.onErase(7);
+    index.onErase(4); // not cached
+    const range_index<int>::snapshot_ptr previous = ranges;
+    ranges = index.ranges();
+    ASSERT_EQ( 3u, ranges->ranges.size() );
+    EXPECT_TRUE( ranges->contains(1) );
+    EXPECT_FALSE( ranges->contains(2) );
+    EXPECT_TRUE( ranges->contains(3) );
+    EXPECT_TRUE( ranges->contains(6) );
+    EXPECT_FALSE( ranges->contains(7) );
+    EXPECT_TRUE( previous->contains(2) ); // snapshots are immutable
+    EXPECT_EQ( 8u, index.version() );
+
+    std::vector<cache_change<int> > changes;
+    EXPECT_TRUE( index.drainChanges(changes) );
+    ASSERT_EQ( 8u, changes.size() );
+    EXPECT_EQ( 3, changes[0].id );
+    EXPECT_EQ( CHANGE_INSERT, changes[0].type );
+    EXPECT_EQ( 2, changes[6].id );
+    EXPECT_EQ( CHANGE_ERASE, changes[6].type );
+    changes.clear();
+    EXPECT_TRUE( index.drainChanges(changes) );
+    EXPECT_TRUE( changes.empty() );
+}
+
+TEST(Cache, rangeIndexLargestId )
+{
+    range_index<uint8_t> index;
+    for (uint8_t id : {255, 253, 254, 0})
+        index.onInsert(id);
+    range_index<uint8_t>::snapshot_ptr ranges = index.ranges();
+    ASSERT_EQ( 2u, ranges->ranges.size() );
+    EXPECT_EQ( 253, ranges->ranges[1].first );
+    EXPECT_EQ( 255, ranges->ranges[1].last );
+    EXPECT_TRUE( ranges->contains(255) );
+    EXPECT_EQ( 4u, ranges->count() );
+    index.onErase(255);
+    index.onErase(0);
+    ranges = index.ranges();
+    ASSERT_EQ( 1u, ranges->ranges.size() );
+    EXPECT_EQ( 254, ranges->ranges[0].last );
+    EXPECT_FALSE( ranges->contains(255) );
+    EXPECT_FALSE( ranges->contains(0) );
+}
+
+TEST(Cache, rangeIndexFollowsCache )
+{
+    priority_cache_details<size_t, size_t, int, IndexPolicy> cache(3);
+    for (size_t id = 0; id < 3; ++id) {
+        EXPECT_EQ( NEEDED, cache.update(id) );
+        EXPECT_TRUE( cache.put(id, 1, 0) );
+    }
+    std::vector<cache_change<size_t> > changes;
+    EXPECT_TRUE( cache.index().drainChanges(changes) );
+    EXPECT_EQ( 3u, changes.size() );
+
+    cache.discardPending();
+    for (size_t id = 10; id < 13; ++id) {
+        EXPECT_EQ( NEEDED, cache.update(id) );
+        EXPECT_TRUE( cache.put(id, 1, 0) );
+    }
+    const range_index<size_t>::snapshot_ptr ranges = cache.index().ranges();
+    ASSERT_EQ( 1u, ranges->ranges.size() );
+    EXPECT_EQ( 10u, ranges->ranges[0].first );
+    EXPECT_EQ( 12u, ranges->ranges[0].last );
+    vector<size_t> keys;
+    cache.dumpKeys(keys);
+    EXPECT_EQ( keys.size(), ranges->count() );
+
+    // 3 evictions and 3 insertions do not fit in the feed
+    changes.clear();
+    EXPECT_FALSE( cache.index().drainChanges(changes) );
+    EXPECT_EQ( 4u, changes.size() );
+}
+
+typedef leveled_id<size_t> LeveledId;
+
+static std::vector<LeveledId> drain(leveled_range<Range> range) {
+    std::vector<LeveledId> ids;
+    while (!range.empty())
+        ids.push_back(range.next());
+    return ids;
+}
+
+TEST(Cache, leveledRangeRequestsCheapLevelsFirst )
+{
+    EXPECT_EQ( std::vector<LeveledId>({LeveledId(0, 2), LeveledId(0, 0), LeveledId(1, 2), LeveledId(1, 0)}),
+               drain(leveled_range<Range>(Range(0, 2), {2, 0})) );
+    // proxies 2 frames ahead
+    EXPECT_EQ( std::vector<LeveledId>({LeveledId(0, 2), LeveledId(1, 2), LeveledId(2, 2), LeveledId(0, 0),
+                                       LeveledId(3, 2), LeveledId(1, 0), LeveledId(2, 0), LeveledId(3, 0)}),
+               drain(leveled_range<Range>(Range(0, 4), {2, 0}, 2)) );
+    EXPECT_TRUE( drain(leveled_range<Range>(Range(0, 0), {2, 0}, 2)).empty() );
+    EXPECT_TRUE( drain(leveled_range<Range>(Range(0, 4), {})).empty() );
+}
+
+TEST(Cache, getBestLevel )
+{
+    priority_cache_details<LeveledId, size_t, int> cache(100);
+    LeveledId found;
+    int data;
+    EXPECT_FALSE( cache.getBest(LeveledId(5), found, data) );
+    EXPECT_EQ( NEEDED, cache.update(LeveledId(5, 2)) );
+    EXPECT_EQ( NEEDED, cache.update(LeveledId(5, 0)) );
+    EXPECT_TRUE( cache.put(LeveledId(5, 2), 1, 52) );
+    EXPECT_FALSE( cache.get(LeveledId(5, 0), data) );
+    EXPECT_TRUE( cache.getBest(LeveledId(5), found, data) );
+    EXPECT_EQ( LeveledId(5, 2), found );
+    EXPECT_EQ( 52, data );
+    EXPECT_TRUE( cache.put(LeveledId(5, 0), 16, 50) );
+    EXPECT_TRUE( cache.getBest(LeveledId(5, 2), found, data) );
+    EXPECT_EQ( LeveledId(5, 0), found );
+    EXPECT_EQ( 50, data );
+    // other frames
+    EXPECT_FALSE( cache.getBest(LeveledId(4), found, data) );
+    EXPECT_FALSE( cache.getBest(LeveledId(6), found, data) );
+}
+
+TEST(Cache, lookaheadLeveledJob )
+{
+    lookahead_cache<LeveledId, size_t, int, leveled_range<Range> > cache(100);
+    cache.process(leveled_range<Range>(Range(0, 3), {1, 0}, 1));
+    std::vector<LeveledId> popped;
+    LeveledId id;
+    while (cache.tryPop(id))
+        popped.push_back(id);
+    EXPECT_EQ( std::vector<LeveledId>({LeveledId(0, 1), LeveledId(1, 1), LeveledId(0, 0), LeveledId(2, 1), LeveledId(1, 0), LeveledId(2, 0)}),
+               popped );
+    EXPECT_TRUE( cache.push(LeveledId(1, 1), 1, 11) );
+    LeveledId found;
+    int data;
+    EXPECT_TRUE( cache.getBest(LeveledId(1), found, data) );
+    EXPECT_EQ( 11, data );
+    EXPECT_TRUE( cache.push(LeveledId(1, 0), 4, 10) );
+    EXPECT_TRUE( cache.getBest(LeveledId(1), found, data) );
+    EXPECT_EQ( LeveledId(1, 0), found );
+    EXPECT_FALSE( cache.getBest(LeveledId(0), found, data) );
+}
+
+struct CombiningPolicy : public default_cache_policy {
+    typedef concurrent::flat_combining<4> combining_type;
+};
+
+TEST(Cache, lookaheadFlatCombining )
+{
+    const size_t count = 2000;
+    lookahead_cache<size_t, size_t, int, Range, CombiningPolicy> cache(count);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 8; ++i)
+        workers.emplace_back([&]() {
+            size_t id;
+            while (cache.pop(id, std::nothrow) == concurrent::pop_status::OK)
+                cache.push(id, 1, int(id));
+        });
+    cache.process(Range(0, count));
+    std::vector<size_t> keys;
+    while (cache.dumpKeys(keys) < count)
+        std::this_thread::yield();
+    cache.terminate();
+    for (std::thread &worker : workers)
+        worker.join();
+    int data;
+    EXPECT_TRUE( cache.get(count - 1, data) );
+    EXPECT_EQ( int(count - 1), data );
+    EXPECT_EQ( count, keys.size() );
+    // errors reach the pushing thread
+    EXPECT_THROW( cache.push(0, 1, 0), std::logic_error );
+}
+
+TEST(Cache, sessionTraceFormat )
+{
+    std::istringstream legacy("49 43\n# comment\n\n32 19\n");
+    session_trace trace = read_session_trace(legacy);
+    ASSERT_EQ( 2u, trace.timings.size() );
+    EXPECT_EQ( 49u, trace.timings[0].load );
+    EXPECT_EQ( 19u, trace.timings[1].decode );
+    EXPECT_TRUE( trace.jobs().empty() );
+
+    std::istringstream session("frame 7 10 20\nprocess 0\nrequest 0 7\nrequest 0 8\npop 5 7\npush 3005 7 1\nget 4000 7 1\nprocess 5000\nrequest 5000 9\n");
+    trace = read_session_trace(session);
+    EXPECT_EQ( 8u, trace.events.size() );
+    const std::vector<std::vector<uint64_t> > jobs = trace.jobs();
+    ASSERT_EQ( 2u, jobs.size() );
+    EXPECT_EQ( (std::vector<uint64_t>{7, 8}), jobs[0] );
+    EXPECT_EQ( (std::vector<uint64_t>{9}), jobs[1] );
+
+    std::stringstream written;
+    write_session_trace(written, trace);
+    const session_trace reloaded = read_session_trace(written);
+    EXPECT_EQ( trace.events.size(), reloaded.events.size() );
+    EXPECT_EQ( SESSION_GET, reloaded.events[5].type );
+    EXPECT_TRUE( reloaded.events[5].flag );
+
+    std::istringstream invalid("pop 10\n");
+    EXPECT_THROW( read_session_trace(invalid), std::runtime_error );
+}
+
+struct SessionPolicy : public default_cache_policy {
+    typedef session_recorder tracer_type;
+};
+
+TEST(Cache, sessionRecorder )
+{
+    priority_cache_details<size_t, size_t, int, SessionPolicy> cache(10);
+    std::stringstream recorded;
+    cache.tracer().attach(recorded);
+    int data;
+    EXPECT_EQ( NEEDED, cache.update(3) );
+    EXPECT_TRUE( cache.put(3,1,0) );
+    EXPECT_TRUE( cache.get(3, data) );
+    EXPECT_FALSE( cache.get(4, data) );
+
+    session_trace trace = read_session_trace(recorded);
+    ASSERT_EQ( 5u, trace.events.size() );
+    EXPECT_EQ( SESSION_REQUEST, trace.events[0].type );
+    EXPECT_EQ( SESSION_POP, trace.events[1].type );
+    EXPECT_EQ( SESSION_PUSH, trace.events[2].type );
+    EXPECT_EQ( SESSION_GET, trace.events[3].type );
+    EXPECT_TRUE( trace.events[3].flag );
+    EXPECT_EQ( 4u, trace.events[4].id );
+    EXPECT_FALSE( trace.events[4].flag );
+    trace.deriveTimings();
+    EXPECT_EQ( 1u, trace.timings.count(3) );
+}
@@ -1,11 +1,15 @@
 #include <concurrent/queue_adaptor.hpp>
 #include <concurrent/queue.hpp>
+#include <concurrent/bounded_queue.h>
+#include <concurrent/deadline_queue.hpp>
 
 #include <gtest/gtest.h>
 
 #include <list>
 #include <vector>
 #include <algorithm>
+#include <thread>
+#include <chrono>
 
 using namespace std;
 
@@ -72,3 +76,182 @@ TEST(ConcurrentQueue, drainToCompatible ) {
 	}
 }
 
+
+struct StatsPolicy : public concurrent::default_queue_policy {
+	typedef concurrent::queue_stats stats_type;
+};
+
+TEST(ConcurrentQueue, statistics ) {
+	concurrent::queue<int, deque<int>, StatsPolicy> q;
+	q.push(1);
+	q.push(2);
+	int unused;
+	EXPECT_TRUE( q.tryPop(unused));
+	EXPECT_TRUE( q.tryPop(unused));
+	EXPECT_FALSE( q.tryPop(unused));
+
+	const concurrent::queue_stats_snapshot stats = q.stats();
+	EXPECT_EQ( 2u, stats.pushes);
+	EXPECT_EQ( 2u, stats.pops);
+	EXPECT_EQ( 0u, stats.depth);
+	EXPECT_EQ( 2u, stats.maxDepth);
+	EXPECT_EQ( 1u, stats.emptyTryPop);
+	EXPECT_EQ( 5u, stats.lockWait.count);
+}
+
+TEST(ConcurrentQueue, statisticsDisabled ) {
+	IntQueue q;
+	q.push(1);
+	EXPECT_EQ( 0u, q.stats().pushes);
+}
+
+TEST(ConcurrentQueue, termination ) {
+	IntQueue q;
+	q.push(5);
+	q.terminate();
+	int unused;
+	EXPECT_THROW( q.tryPop(unused), concurrent::terminated );
+	EXPECT_THROW( q.push(1), concurrent::terminated );
+	// back to normal operations, content is kept
+	q.terminate(false);
+	EXPECT_TRUE( q.tryPop(unused) );
+	EXPECT_EQ( 5, unused );
+	// blocked consumers are released
+	std::thread consumer([&]() {
+		EXPECT_THROW( q.pop(unused), concurrent::terminated );
+	});
+	q.terminate();
+	consumer.join();
+}
+
+TEST(ConcurrentQueue, statusPop ) {
+	concurrent::bounded_queue<int> q(2);
+	int value = 0;
+	EXPECT_EQ( concurrent::pop_status::TIMEOUT, q.tryPop(value, std::nothrow) );
+	EXPECT_EQ( concurrent::pop_status::TIMEOUT, q.pop(value, std::chrono::milliseconds(1)) );
+	q.push(1);
+	EXPECT_EQ( concurrent::pop_status::OK, q.pop(value, std::nothrow) );
+	EXPECT_EQ( 1, value );
+	q.push(2);
+	q.terminate();
+	// termination is reported without throwing, content is kept
+	EXPECT_EQ( concurrent::pop_status::TERMINATED, q.tryPop(value, std::nothrow) );
+	EXPECT_EQ( concurrent::pop_status::TERMINATED, q.pop(value, std::chrono::hours(1)) );
+	q.terminate(false);
+	EXPECT_EQ( concurrent::pop_status::OK, q.pop(value, std::chrono::hours(1)) );
+	EXPECT_EQ( 2, value );
+	// blocked consumers are released
+	std::thread consumer([&]() {
+		EXPECT_EQ( concurrent::pop_status::TERMINATED, q.pop(value, std::nothrow) );
+	});
+	q.terminate();
+	consumer.join();
+}
+
+TEST(BoundedQueue, capacity ) {
+	concurrent::bounded_queue<int> q(2);
+	EXPECT_TRUE( q.tryPush(1) );
+	EXPECT_TRUE( q.tryPush(2) );
+	EXPECT_FALSE( q.tryPush(3) );
+	int value;
+	q.pop(value);
+	EXPECT_EQ( 1, value );
+	EXPECT_TRUE( q.tryPush(3) );
+	q.pop(value);
+	EXPECT_EQ( 2, value );
+	q.pop(value);
+	EXPECT_EQ( 3, value );
+	// only what fits is drained
+	vector<int> values = { 1, 2, 3 };
+	q.drainFrom(values);
+	EXPECT_EQ( (vector<int>{ 3 }), values );
+	vector<int> drained;
+	EXPECT_TRUE( q.drainTo(drained) );
+	EXPECT_EQ( (vector<int>{ 1, 2 }), drained );
+	// blocked producers are released
+	EXPECT_TRUE( q.tryPush(4) );
+	EXPECT_TRUE( q.tryPush(5) );
+	std::thread producer([&]() {
+		EXPECT_THROW( q.push(6), concurrent::terminated );
+	});
+	q.terminate();
+	producer.join();
+}
+
+TEST(PriorityQueue, popsGreatestFirst ) {
+	concurrent::priority_queue<int> q;
+	for (int value : { 3, 1, 4, 1, 5, 9, 2, 6 })
+		q.push(value);
+	int value;
+	q.pop(value);
+	EXPECT_EQ( 9, value );
+	// decrease-key
+	EXPECT_TRUE( q.update(1, 8) );
+	EXPECT_TRUE( q.update(6, 0) );
+	EXPECT_FALSE( q.update(42, 0) );
+	vector<int> remaining;
+	EXPECT_TRUE( q.drainTo(remaining) );
+	EXPECT_EQ( (vector<int>{ 8, 5, 4, 3, 2, 1, 0 }), remaining );
+	// drained elements are reordered
+	q.drainFrom(remaining);
+	q.pop(value);
+	EXPECT_EQ( 8, value );
+}
+
+TEST(DeadlineQueue, earliestDeadlineFirst ) {
+	typedef concurrent::deadline_queue<int> Queue;
+	const Queue::time_point now = std::chrono::steady_clock::now();
+	Queue q;
+	q.push(now + std::chrono::hours(2), 2);
+	q.push(now + std::chrono::hours(1), 1);
+	q.push(now + std::chrono::hours(3), 3);
+	Queue::entry_type entry;
+	EXPECT_FALSE( q.tryPopDue(entry) );
+	q.pop(entry);
+	EXPECT_EQ( 1, entry.value );
+	// seeking makes 3 urgent
+	EXPECT_TRUE( q.reschedule(3, now) );
+	EXPECT_TRUE( q.tryPopDue(entry) );
+	EXPECT_EQ( 3, entry.value );
+}
+
+TEST(DeadlineQueue, waitDueWakesAtDeadline ) {
+	typedef concurrent::deadline_queue<int> Queue;
+	Queue q;
+	const Queue::time_point start = std::chrono::steady_clock::now();
+	q.push(start + std::chrono::hours(1), 1);
+	std::thread consumer([&]() {
+		Queue::entry_type entry;
+		q.waitDue(entry);
+		EXPECT_EQ( 2, entry.value );
+		EXPECT_GE( std::chrono::steady_clock::now(), start + std::chrono::milliseconds(20) );
+	});
+	// an earlier deadline wakes the consumer up
+	q.push(start + std::chrono::milliseconds(20), 2);
+	consumer.join();
+	std::thread terminated([&]() {
+		Queue::entry_type entry;
+		EXPECT_THROW( q.waitDue(entry), concurrent::terminated );
+	});
+	q.terminate();
+	terminated.join();
+}
+
+struct SpinningPolicy : public concurrent::default_queue_policy {
+	typedef concurrent::adaptive_spin_wait wait_type;
+};
+
+TEST(BoundedQueue, adaptiveSpinWait ) {
+	concurrent::bounded_queue<int, vector<int>, SpinningPolicy> q(4);
+	const int count = 10000;
+	std::thread producer([&]() {
+		for (int i = 0; i < count; ++i)
+			q.push(i);
+	});
+	int value;
+	for (int i = 0; i < count; ++i) {
+		q.pop(value);
+		ASSERT_EQ( i, value );
+	}
+	producer.join();
+}
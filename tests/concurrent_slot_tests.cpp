@@ -6,9 +6,13 @@
  */
 
 #include <concurrent/slot.hpp>
+#include <concurrent/latest_slot.hpp>
 
 #include <gtest/gtest.h>
 
+#include <array>
+#include <thread>
+
 using namespace concurrent;
 
 TEST(ConcurrentSlot,uninitialized ) {
@@ -43,3 +47,118 @@ TEST(ConcurrentSlot, termination ) {
 	EXPECT_FALSE(dummy);
 }
 
+TEST(ConcurrentSlot, statusGet ) {
+	int value = 0;
+	slot<int> slot;
+	EXPECT_EQ( pop_status::TIMEOUT, slot.tryGet(value, std::nothrow) );
+	EXPECT_EQ( pop_status::TIMEOUT, slot.waitGet(value, std::chrono::milliseconds(1)) );
+	slot.set(1);
+	EXPECT_EQ( pop_status::OK, slot.waitGet(value, std::chrono::hours(1)) );
+	EXPECT_EQ( 1, value );
+	std::thread setter([&]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		slot.set(2);
+	});
+	EXPECT_EQ( pop_status::OK, slot.waitGet(value, std::nothrow) );
+	EXPECT_EQ( 2, value );
+	setter.join();
+	std::thread waiter([&]() {
+		EXPECT_EQ( pop_status::TERMINATED, slot.waitGet(value, std::chrono::hours(1)) );
+	});
+	slot.terminate();
+	waiter.join();
+	EXPECT_EQ( pop_status::TERMINATED, slot.tryGet(value, std::nothrow) );
+}
+
+template<typename WAIT>
+static void pingPong(const size_t roundTrips) {
+	slot<size_t, WAIT> ping;
+	slot<size_t, WAIT> pong;
+	std::thread echo([&]() {
+		size_t value;
+		for (size_t i = 0; i < roundTrips; ++i) {
+			ping.waitGet(value);
+			pong.set(value + 1);
+		}
+	});
+	size_t value;
+	for (size_t i = 0; i < roundTrips; ++i) {
+		ping.set(i);
+		pong.waitGet(value);
+		EXPECT_EQ( i + 1, value );
+	}
+	echo.join();
+}
+
+TEST(ConcurrentSlot, waitStrategies ) {
+	pingPong<block_wait>(1000);
+	pingPong<adaptive_spin_wait>(1000);
+	// busy spinning threads only make progress when preempted on a single core
+	pingPong<busy_spin_wait>(std::thread::hardware_concurrency() > 1 ? 1000 : 20);
+}
+
+TEST(ConcurrentSlot, spinningTermination ) {
+	slot<bool, adaptive_spin_wait> slot;
+	std::thread waiter([&]() {
+		bool dummy;
+		EXPECT_THROW(slot.waitGet(dummy), concurrent::terminated);
+	});
+	slot.terminate();
+	waiter.join();
+}
+
+TEST(LatestSlot, latestValue ) {
+	int value = 0;
+	latest_slot<int> latest;
+	EXPECT_FALSE(latest.tryGet(value));
+	latest.set(1);
+	latest.set(2);
+	latest.set(3);
+	// intermediate values are dropped
+	EXPECT_TRUE(latest.tryGet(value));
+	EXPECT_EQ(3, value);
+	EXPECT_FALSE(latest.tryGet(value));
+	latest.back() = 4;
+	latest.publish();
+	latest.waitGet(value);
+	EXPECT_EQ(4, value);
+}
+
+TEST(LatestSlot, termination ) {
+	int value = 0;
+	latest_slot<int> latest(1);
+	latest.terminate();
+	EXPECT_THROW(latest.tryGet(value), concurrent::terminated);
+	EXPECT_THROW(latest.waitGet(value), concurrent::terminated);
+	// the writer is never blocked
+	latest.set(2);
+	latest.terminate(false);
+	EXPECT_TRUE(latest.tryGet(value));
+	EXPECT_EQ(2, value);
+}
+
+TEST(LatestSlot, noTearing ) {
+	typedef std::array<size_t, 1024> frame;
+	const size_t frames = 5000;
+	latest_slot<frame, adaptive_spin_wait> latest;
+	std::thread writer([&]() {
+		for (size_t i = 1; i <= frames; ++i) {
+			latest.back().fill(i);
+			latest.publish();
+		}
+	});
+	frame read;
+	size_t last = 0;
+	size_t torn = 0;
+	size_t stale = 0;
+	while (last < frames) {
+		latest.waitGet(read);
+		for (size_t word : read)
+			torn += word != read[0];
+		stale += read[0] <= last;
+		last = read[0];
+	}
+	writer.join();
+	EXPECT_EQ(0u, torn);
+	EXPECT_EQ(0u, stale);
+}
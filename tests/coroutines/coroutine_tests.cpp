@@ -0,0 +1,213 @@
+/*
+ * coroutine_tests.cpp
+ *
+ *  Built separately in C++20, see the Makefile.
+ */
+
+#include <concurrent/coroutine.hpp>
+#include <concurrent/queue.hpp>
+#include <concurrent/bounded_queue.h>
+#include <concurrent/slot.hpp>
+#include <concurrent/cache/lookahead_cache.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace concurrent;
+
+namespace {
+
+/**
+ * Fire and forget coroutine
+ */
+struct detached {
+	struct promise_type {
+		detached get_return_object() {
+			return detached();
+		}
+		std::suspend_never initial_suspend() noexcept {
+			return std::suspend_never();
+		}
+		std::suspend_never final_suspend() noexcept {
+			return std::suspend_never();
+		}
+		void return_void() {
+		}
+		void unhandled_exception() {
+			std::terminate();
+		}
+	};
+};
+
+/**
+ * A handful of threads running the posted tasks
+ */
+struct thread_pool {
+	explicit thread_pool(size_t threads) {
+		for (size_t i = 0; i < threads; ++i)
+			m_Threads.emplace_back([this]() {
+				try {
+					std::function<void()> task;
+					for (;;) {
+						m_Tasks.pop(task);
+						task();
+					}
+				} catch (terminated&) {
+				}
+			});
+	}
+	~thread_pool() {
+		m_Tasks.terminate();
+		for (std::thread &thread : m_Threads)
+			thread.join();
+	}
+	template<typename F>
+	void post(F &&f) {
+		m_Tasks.push(std::function<void()>(std::forward<F>(f)));
+	}
+
+private:
+	queue<std::function<void()> > m_Tasks;
+	std::vector<std::thread> m_Threads;
+};
+
+struct Frames {
+	size_t from;
+	size_t count;
+
+	Frames() :
+			from(0), count(0) {
+	}
+	Frames(size_t from, size_t count) :
+			from(from), count(count) {
+	}
+	size_t next() {
+		--count;
+		return from++;
+	}
+	bool empty() const {
+		return count == 0;
+	}
+	void clear() {
+		count = 0;
+	}
+};
+
+typedef cache::lookahead_cache<size_t, size_t, int, Frames> CACHE;
+
+template<typename Queue, typename Executor>
+detached sum(Queue &queue, Executor &executor, std::atomic<int> &total, std::atomic<int> &done) {
+	try {
+		for (;;)
+			total += co_await async_pop(queue, executor);
+	} catch (terminated&) {
+	}
+	++done;
+}
+
+template<typename Slot>
+detached getTwice(Slot &slot, thread_pool &executor, std::atomic<int> &total) {
+	total += co_await async_get(slot, executor);
+	total += co_await async_get(slot, executor);
+}
+
+detached work(CACHE &cache, thread_pool &executor, std::atomic<int> &done) {
+	try {
+		for (;;) {
+			const size_t id = co_await async_pop(cache, executor);
+			cache.push(id, 1, int(id) * 10);
+		}
+	} catch (terminated&) {
+	}
+	++done;
+}
+
+detached display(CACHE &cache, size_t id, thread_pool &executor, std::atomic<int> &total) {
+	try {
+		total += co_await async_get(cache, id, executor);
+	} catch (terminated&) {
+		total += 1;
+	}
+}
+
+void waitFor(const std::atomic<int> &value, int expected) {
+	while (value.load() != expected)
+		std::this_thread::yield();
+}
+
+} // namespace
+
+TEST(Coroutine, queuePop ) {
+	queue<int> values;
+	std::atomic<int> total(0), done(0);
+	{
+		thread_pool executor(2);
+		// far more waiting coroutines than threads
+		for (int i = 0; i < 1000; ++i)
+			sum(values, executor, total, done);
+		for (int i = 1; i <= 2000; ++i)
+			values.push(i);
+		waitFor(total, 2000 * 2001 / 2);
+		values.terminate();
+		waitFor(done, 1000);
+	}
+	EXPECT_EQ( 2000 * 2001 / 2, total.load() );
+}
+
+TEST(Coroutine, boundedQueuePopInline ) {
+	bounded_queue<int> values(4);
+	values.push(1);
+	std::atomic<int> total(0), done(0);
+	inline_executor executor;
+	sum(values, executor, total, done);
+	EXPECT_EQ( 1, total.load() ); // completed right away
+	values.push(2); // resumes the coroutine on this thread
+	EXPECT_EQ( 3, total.load() );
+	values.terminate();
+	EXPECT_EQ( 1, done.load() );
+}
+
+TEST(Coroutine, slotGet ) {
+	slot<int> value;
+	std::atomic<int> total(0);
+	{
+		thread_pool executor(1);
+		getTwice(value, executor, total);
+		value.set(1);
+		waitFor(total, 1);
+		value.set(2);
+		waitFor(total, 3);
+	}
+	EXPECT_EQ( 3, total.load() );
+}
+
+TEST(Coroutine, cachePopAndGet ) {
+	CACHE cache(1000);
+	std::atomic<int> done(0), total(0);
+	{
+		thread_pool executor(2);
+		display(cache, 99, executor, total);
+		for (int i = 0; i < 100; ++i)
+			work(cache, executor, done);
+		cache.process(Frames(0, 100));
+		waitFor(total, 990);
+		std::vector<size_t> keys;
+		while (cache.dumpKeys(keys) < 100)
+			std::this_thread::yield();
+		// one more job, served by the coroutines still waiting
+		cache.process(Frames(100, 100));
+		while (cache.dumpKeys(keys) < 200)
+			std::this_thread::yield();
+		display(cache, 150, executor, total);
+		waitFor(total, 990 + 1500);
+		display(cache, 1000, executor, total); // never pushed
+		cache.terminate();
+		waitFor(done, 100);
+		waitFor(total, 990 + 1500 + 1);
+	}
+	EXPECT_EQ( 990 + 1500 + 1, total.load() );
+}
@@ -0,0 +1,163 @@
+#include <concurrent/cache/memory_pressure.hpp>
+#include <concurrent/cache/lookahead_cache.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace concurrent::cache;
+
+namespace {
+
+struct Frames {
+	size_t from;
+	size_t count;
+
+	Frames() :
+			from(0), count(0) {
+	}
+	Frames(size_t from, size_t count) :
+			from(from), count(count) {
+	}
+	size_t next() {
+		--count;
+		return from++;
+	}
+	bool empty() const {
+		return count == 0;
+	}
+	void clear() {
+		count = 0;
+	}
+};
+
+typedef lookahead_cache<size_t, size_t, int, Frames> CACHE;
+
+void fill(CACHE &cache, const Frames &frames) {
+	cache.process(frames);
+	size_t id;
+	while (cache.tryPop(id))
+		cache.push(id, 1, int(id));
+}
+
+/**
+ * Fake memory.pressure and memory.current in a temporary directory
+ */
+struct cgroup_files {
+	cgroup_files() {
+		char pattern[] = "/tmp/memory_pressure_XXXXXX";
+		directory = mkdtemp(pattern);
+	}
+	~cgroup_files() {
+		unlink(pressure().c_str());
+		unlink(current().c_str());
+		rmdir(directory.c_str());
+	}
+	std::string pressure() const {
+		return directory + "/memory.pressure";
+	}
+	std::string current() const {
+		return directory + "/memory.current";
+	}
+	void setPressure(double some10) const {
+		FILE *file = fopen(pressure().c_str(), "w");
+		fprintf(file, "some avg10=%.2f avg60=0.00 avg300=0.00 total=0\nfull avg10=0.00 avg60=0.00 avg300=0.00 total=0\n", some10);
+		fclose(file);
+	}
+	void setCurrent(unsigned long long bytes) const {
+		FILE *file = fopen(current().c_str(), "w");
+		fprintf(file, "%llu\n", bytes);
+		fclose(file);
+	}
+	pressure_options options() const {
+		pressure_options options;
+		options.pressurePath = pressure();
+		options.currentPath = current();
+		return options;
+	}
+
+	std::string directory;
+};
+
+} // namespace
+
+TEST(MemoryPressure, readFiles ) {
+	const cgroup_files files;
+	double some10 = 0;
+	uint64_t bytes = 0;
+	EXPECT_FALSE( read_memory_pressure(files.pressure(), some10) );
+	EXPECT_FALSE( read_memory_current(files.current(), bytes) );
+	files.setPressure(12.5);
+	files.setCurrent(123456789);
+	EXPECT_TRUE( read_memory_pressure(files.pressure(), some10) );
+	EXPECT_DOUBLE_EQ( 12.5, some10 );
+	EXPECT_TRUE( read_memory_current(files.current(), bytes) );
+	EXPECT_EQ( 123456789U, bytes );
+}
+
+TEST(MemoryPressure, shrinksInBatchesAndGrowsBack ) {
+	const cgroup_files files;
+	pressure_options options = files.options();
+	options.batch = 10;
+	options.shrinkStep = 0.5;
+	options.growStep = 0.25;
+	memory_pressure_watcher watcher(options);
+	CACHE cache(1000);
+	watcher.watch(cache, 100);
+	fill(cache, Frames(0, 100));
+	EXPECT_EQ( 100U, cache.weight() );
+	// no file, nothing changes
+	EXPECT_EQ( 1., watcher.poll() );
+	files.setPressure(40);
+	EXPECT_EQ( 0.5, watcher.poll() );
+	EXPECT_EQ( 90U, cache.weight() );
+	EXPECT_EQ( 0.1, watcher.poll() );
+	EXPECT_EQ( 80U, cache.weight() );
+	// the next polls carry on until the cache fits
+	for (int i = 0; i < 10; ++i)
+		watcher.poll();
+	EXPECT_EQ( 10U, cache.weight() );
+	// in between the thresholds, the scale holds
+	files.setPressure(5);
+	EXPECT_EQ( 0.1, watcher.poll() );
+	files.setPressure(0);
+	EXPECT_EQ( 0.35, watcher.poll() );
+	fill(cache, Frames(100, 100));
+	EXPECT_GE( cache.weight(), 35U );
+}
+
+TEST(MemoryPressure, currentAboveThreshold ) {
+	const cgroup_files files;
+	pressure_options options = files.options();
+	options.currentHigh = 1000;
+	memory_pressure_watcher watcher(options);
+	files.setCurrent(2000);
+	EXPECT_DOUBLE_EQ( 0.9, watcher.poll() );
+	files.setCurrent(500);
+	EXPECT_DOUBLE_EQ( 0.95, watcher.poll() );
+}
+
+TEST(MemoryPressure, governorBudget ) {
+	const cgroup_files files;
+	memory_pressure_watcher watcher(files.options());
+	cache_governor<> governor(1000);
+	watcher.watch(governor, size_t(1000));
+	files.setPressure(50);
+	watcher.poll();
+	EXPECT_EQ( 900U, governor.budget() );
+}
+
+TEST(MemoryPressure, backgroundThread ) {
+	const cgroup_files files;
+	memory_pressure_watcher watcher(files.options());
+	files.setPressure(50);
+	watcher.start(std::chrono::milliseconds(1));
+	while (watcher.scale() > 0.5)
+		std::this_thread::yield();
+	watcher.stop();
+	EXPECT_LE( watcher.scale(), 0.5 );
+}
@@ -0,0 +1,118 @@
+/*
+ * noexcept_tests.cpp
+ *
+ *  Built with -fno-exceptions, see the Makefile. Workers only go through
+ *  the status returning pops.
+ */
+
+#include <concurrent/queue.hpp>
+#include <concurrent/bounded_queue.h>
+#include <concurrent/slot.hpp>
+#include <concurrent/deadline_queue.hpp>
+#include <concurrent/cache/lookahead_cache.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace concurrent;
+
+namespace {
+
+struct Frames {
+	size_t from;
+	size_t count;
+
+	Frames() :
+			from(0), count(0) {
+	}
+	Frames(size_t from, size_t count) :
+			from(from), count(count) {
+	}
+	size_t next() {
+		--count;
+		return from++;
+	}
+	bool empty() const {
+		return count == 0;
+	}
+	void clear() {
+		count = 0;
+	}
+};
+
+} // namespace
+
+TEST(NoExceptions, queues ) {
+	queue<int> values;
+	bounded_queue<int> results(4);
+	std::thread worker([&]() {
+		int value = 0;
+		while (values.pop(value, std::nothrow) == pop_status::OK)
+			results.push(value * 2);
+	});
+	int result = 0;
+	for (int i = 0; i < 100; ++i) {
+		values.push(i);
+		ASSERT_EQ( pop_status::OK, results.pop(result, std::nothrow) );
+		EXPECT_EQ( i * 2, result );
+	}
+	values.terminate();
+	worker.join();
+	EXPECT_EQ( pop_status::TIMEOUT, results.pop(result, std::chrono::milliseconds(1)) );
+}
+
+TEST(NoExceptions, slot ) {
+	slot<int> value;
+	std::thread waiter([&]() {
+		int dummy;
+		EXPECT_EQ( pop_status::TERMINATED, value.waitGet(dummy, std::nothrow) );
+	});
+	value.terminate();
+	waiter.join();
+}
+
+TEST(NoExceptions, deadlineQueue ) {
+	deadline_queue<int> timers;
+	deadline_queue<int>::entry_type entry;
+	EXPECT_EQ( pop_status::TIMEOUT, timers.tryPopDue(entry, std::nothrow) );
+	timers.push(std::chrono::steady_clock::now() + std::chrono::hours(1), 1);
+	EXPECT_EQ( pop_status::TIMEOUT, timers.waitDue(entry, std::chrono::milliseconds(1)) );
+	timers.push(std::chrono::steady_clock::now(), 2);
+	ASSERT_EQ( pop_status::OK, timers.waitDue(entry, std::nothrow) );
+	EXPECT_EQ( 2, entry.value );
+	std::thread worker([&]() {
+		deadline_queue<int>::entry_type due;
+		EXPECT_EQ( pop_status::TERMINATED, timers.waitDue(due, std::nothrow) );
+	});
+	timers.terminate();
+	worker.join();
+	EXPECT_EQ( pop_status::TERMINATED, timers.tryPopDue(entry, std::nothrow) );
+}
+
+TEST(NoExceptions, cacheWorkers ) {
+	cache::lookahead_cache<size_t, size_t, int, Frames> cache(1000);
+	for (size_t job = 0; job < 20; ++job) {
+		std::atomic<size_t> pushed(0);
+		std::vector<std::thread> workers;
+		for (int i = 0; i < 4; ++i)
+			workers.emplace_back([&]() {
+				size_t id;
+				while (cache.pop(id, std::nothrow) == pop_status::OK) {
+					cache.push(id, 1, int(id));
+					++pushed;
+				}
+			});
+		cache.process(Frames(job * 10, 10));
+		while (pushed < 10)
+			std::this_thread::yield();
+		cache.terminate();
+		for (std::thread &worker : workers)
+			worker.join();
+		cache.terminate(false);
+	}
+	std::vector<size_t> keys;
+	EXPECT_EQ( 200U, cache.dumpKeys(keys) );
+}
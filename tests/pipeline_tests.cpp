@@ -0,0 +1,133 @@
+#include <concurrent/pipeline.hpp>
+#include <concurrent/cache/cache_pipeline.hpp>
+#include <concurrent/cache/lookahead_cache.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace concurrent;
+
+// a source producing [0, count[ then stopping
+struct counter {
+	counter(int count) :
+			m_Next(new std::atomic<int>(0)), m_Count(count) {
+	}
+	void operator()(int &value) {
+		value = m_Next->fetch_add(1);
+		if (value >= m_Count)
+			throw terminated();
+	}
+private:
+	std::shared_ptr<std::atomic<int> > m_Next;
+	int m_Count;
+};
+
+TEST(Pipeline, orderedStages ) {
+	std::vector<int> received;
+	pipeline p(4);
+	const auto numbers = p.source<int>("count", 1, counter(1000));
+	const auto doubled = p.stage<int>("double", numbers, 4, [](const int &value) {
+		return 2 * value;
+	}, true);
+	p.sink("collect", doubled, 2, [&](const int &value) {
+		received.push_back(value);
+	}, true);
+	p.start();
+	p.finish();
+
+	ASSERT_EQ( 1000u, received.size() );
+	for (size_t i = 0; i < received.size(); ++i)
+		ASSERT_EQ( int(2 * i), received[i] );
+	const std::vector<stage_stats_snapshot> stats = p.stats();
+	ASSERT_EQ( 3u, stats.size() );
+	EXPECT_EQ( "double", stats[1].name );
+	EXPECT_EQ( 4u, stats[1].threads );
+	for (const stage_stats_snapshot &stage : stats)
+		EXPECT_EQ( 1000u, stage.processed );
+	EXPECT_EQ( 4u, stats[1].inputCapacity );
+}
+
+TEST(Pipeline, backpressure ) {
+	std::atomic<int> consumed(0);
+	pipeline p(2);
+	const auto numbers = p.source<int>("count", 2, counter(50));
+	p.sink("slow", numbers, 1, [&](const int &) {
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+		++consumed;
+	});
+	p.start();
+	p.finish();
+	EXPECT_EQ( 50, consumed.load() );
+	const std::vector<stage_stats_snapshot> stats = p.stats();
+	EXPECT_LE( stats[1].maxOccupancy, 2u );
+	EXPECT_GT( stats[1].busy, 0. );
+}
+
+TEST(Pipeline, terminateUnblocksEverything ) {
+	pipeline p(1);
+	const auto numbers = p.source<int>("endless", 1, [](int &value) {
+		value = 0;
+	});
+	p.sink("blocked", p.stage<int>("identity", numbers, 2, [](const int &value) {
+		return value;
+	}), 1, [](const int &) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	});
+	p.start();
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	p.terminate();
+	EXPECT_GT( p.stats()[0].processed, 0u );
+}
+
+struct Job {
+	size_t from;
+	size_t count;
+
+	Job() :
+			from(0), count(0) {
+	}
+	Job(size_t from, size_t count) :
+			from(from), count(count) {
+	}
+	size_t next() {
+		--count;
+		return from++;
+	}
+	bool empty() const {
+		return count == 0;
+	}
+	void clear() {
+		count = 0;
+	}
+};
+
+TEST(Pipeline, lookaheadCache ) {
+	typedef cache::lookahead_cache<size_t, size_t, int, Job> CACHE;
+	CACHE lookahead(100);
+	lookahead.process(Job(0, 50));
+
+	pipeline p;
+	const auto ids = cache::pop_from(p, lookahead, 2);
+	const auto results = p.stage<cache::cache_result<CACHE> >("work", ids, 3, [](const size_t &id) {
+		cache::cache_result<CACHE> result;
+		result.id = id;
+		result.weight = 1;
+		result.data = int(id) * 10;
+		return result;
+	});
+	cache::push_to(p, results, lookahead);
+	p.start();
+	std::vector<size_t> keys;
+	while (lookahead.dumpKeys(keys) < 50)
+		std::this_thread::yield();
+	p.terminate();
+
+	int data;
+	EXPECT_TRUE( lookahead.get(49, data) );
+	EXPECT_EQ( 490, data );
+	EXPECT_EQ( 50u, p.stats()[2].processed );
+}
@@ -0,0 +1,63 @@
+#include <concurrent/profiled_mutex.hpp>
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <sstream>
+#include <thread>
+
+using namespace concurrent;
+
+TEST(ProfiledMutex, counts ) {
+	profiled_mutex mutex("tests::counts");
+	lock_profile &profile = lock_registry::instance().site("tests::counts");
+	{
+		std::lock_guard<profiled_mutex> lock(mutex);
+	}
+	EXPECT_EQ( 1u, profile.acquisitions.load());
+	EXPECT_EQ( 0u, profile.contentions.load());
+
+	mutex.lock();
+	std::thread other([&]() {
+		EXPECT_FALSE( mutex.try_lock());
+	});
+	other.join();
+	mutex.unlock();
+	EXPECT_EQ( 2u, profile.acquisitions.load());
+	EXPECT_EQ( 1u, profile.contentions.load());
+}
+
+TEST(ProfiledMutex, conditionVariable ) {
+	profiled_mutex mutex("tests::condition");
+	std::condition_variable_any condition;
+	bool ready = false;
+	std::thread producer([&]() {
+		std::lock_guard<profiled_mutex> lock(mutex);
+		ready = true;
+		condition.notify_one();
+	});
+	{
+		std::unique_lock<profiled_mutex> lock(mutex);
+		condition.wait(lock, [&]() {return ready;});
+	}
+	producer.join();
+	EXPECT_LE( 2u, lock_registry::instance().site("tests::condition").acquisitions.load());
+}
+
+TEST(ProfiledMutex, reports ) {
+	lock_registry &registry = lock_registry::instance();
+	profiled_mutex mutex("tests::reports");
+	registry.setTracing(true);
+	mutex.lock();
+	mutex.unlock();
+	registry.setTracing(false);
+
+	std::ostringstream summary;
+	registry.writeSummary(summary);
+	EXPECT_NE( std::string::npos, summary.str().find("tests::reports\t1\t0"));
+
+	std::ostringstream trace;
+	registry.writeChromeTrace(trace);
+	EXPECT_EQ( 0u, trace.str().find("{\"traceEvents\":["));
+	EXPECT_NE( std::string::npos, trace.str().find("\"name\":\"hold tests::reports\""));
+}
@@ -0,0 +1,168 @@
+/*
+ * synchronization_tests.cpp
+ */
+
+#include <concurrent/event.hpp>
+#include <concurrent/latch.hpp>
+#include <concurrent/barrier.hpp>
+#include <concurrent/flat_combining.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace concurrent;
+
+TEST(Event, broadcast ) {
+	event ready;
+	EXPECT_FALSE(ready.tryWait());
+	std::atomic<int> released(0);
+	std::vector<std::thread> waiters;
+	for (int i = 0; i < 4; ++i)
+		waiters.emplace_back([&]() {
+			ready.wait();
+			++released;
+		});
+	ready.set();
+	for (std::thread &thread : waiters)
+		thread.join();
+	EXPECT_EQ(4, released.load());
+	// stays set until reset
+	EXPECT_TRUE(ready.tryWait());
+	ready.wait();
+	ready.reset();
+	EXPECT_FALSE(ready.tryWait());
+}
+
+TEST(Event, termination ) {
+	basic_event<adaptive_spin_wait> ready;
+	std::thread waiter([&]() {
+		EXPECT_THROW(ready.wait(), terminated);
+	});
+	ready.terminate();
+	waiter.join();
+	EXPECT_THROW(ready.tryWait(), terminated);
+	ready.terminate(false);
+	EXPECT_FALSE(ready.tryWait());
+}
+
+TEST(Latch, countDown ) {
+	const int tiles = 8;
+	latch done(tiles);
+	std::atomic<int> rendered(0);
+	std::vector<std::thread> workers;
+	for (int i = 0; i < tiles; ++i)
+		workers.emplace_back([&]() {
+			++rendered;
+			done.countDown();
+		});
+	done.wait();
+	EXPECT_EQ(tiles, rendered.load());
+	EXPECT_TRUE(done.tryWait());
+	for (std::thread &thread : workers)
+		thread.join();
+}
+
+TEST(Latch, termination ) {
+	latch done(2);
+	done.countDown();
+	EXPECT_FALSE(done.tryWait());
+	std::thread waiter([&]() {
+		EXPECT_THROW(done.wait(), terminated);
+	});
+	done.terminate();
+	waiter.join();
+}
+
+TEST(Barrier, lockstep ) {
+	const int threads = 4;
+	const int phases = 100;
+	int completions = 0;
+	basic_barrier<adaptive_spin_wait> frame(threads, [&]() { ++completions; });
+	std::atomic<int> counter(0);
+	std::atomic<bool> outOfStep(false);
+	std::vector<std::thread> stages;
+	for (int i = 0; i < threads; ++i)
+		stages.emplace_back([&]() {
+			for (int phase = 0; phase < phases; ++phase) {
+				++counter;
+				frame.arriveAndWait();
+				// everybody arrived, nobody started the next phase yet
+				if (counter.load() < (phase + 1) * threads)
+					outOfStep = true;
+				frame.arriveAndWait();
+			}
+		});
+	for (std::thread &thread : stages)
+		thread.join();
+	EXPECT_FALSE(outOfStep.load());
+	EXPECT_EQ(2 * phases, completions);
+}
+
+TEST(Barrier, termination ) {
+	barrier frame(2);
+	std::thread waiter([&]() {
+		EXPECT_THROW(frame.arriveAndWait(), terminated);
+	});
+	frame.terminate();
+	waiter.join();
+	EXPECT_THROW(frame.arriveAndWait(), terminated);
+}
+
+TEST(Barrier, resumeAfterTermination ) {
+	barrier frame(2);
+	std::thread waiter([&]() {
+		EXPECT_THROW(frame.arriveAndWait(), terminated);
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(10)); // arrived
+	frame.terminate();
+	waiter.join();
+	frame.terminate(false);
+	// a full phase needs both threads again
+	std::atomic<uint32_t> phase(42);
+	std::thread other([&]() {
+		phase = frame.arriveAndWait();
+	});
+	EXPECT_EQ(0u, frame.arriveAndWait());
+	other.join();
+	EXPECT_EQ(0u, phase.load());
+}
+
+TEST(FlatCombining, appliesEveryOperation ) {
+	flat_combining<4, 16> combining; // threads share slots
+	std::mutex mutex;
+	size_t counter = 0; // only touched with the mutex held
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 16; ++i)
+		threads.emplace_back([&]() {
+			auto increment = [&]() {
+				++counter;
+			};
+			for (int j = 0; j < 1000; ++j)
+				combining.execute(mutex, increment);
+		});
+	for (std::thread &thread : threads)
+		thread.join();
+	EXPECT_EQ(16000u, counter);
+}
+
+TEST(FlatCombining, rethrowsInPublisher ) {
+	flat_combining<> combining;
+	std::mutex mutex;
+	auto fail = []() {
+		throw std::logic_error("fail");
+	};
+	EXPECT_THROW(combining.execute(mutex, fail), std::logic_error);
+	// still usable
+	int value = 0;
+	auto set = [&]() {
+		value = 1;
+	};
+	combining.execute(mutex, set);
+	EXPECT_EQ(1, value);
+}
@@ -0,0 +1,51 @@
+/*
+ * TraceAnalyzer.cpp
+ *
+ *  Reports lead time and wasted work from a binary trace written by
+ *  concurrent::cache::ring_tracer::writeBinary. Optionally converts it to the
+ *  Chrome trace format.
+ *
+ *  usage : TraceAnalyzer trace.bin [chrome_trace.json]
+ */
+
+#include <concurrent/cache/tracer.hpp>
+
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace concurrent::cache;
+
+static void printDistribution(const char *name, const std::vector<uint64_t> &sorted) {
+	printf("%-14s count %-8zu p50 %10.3f ms  p90 %10.3f ms  p99 %10.3f ms  max %10.3f ms\n", name, sorted.size(), //
+			trace_report::percentile(sorted, .5) / 1e6, trace_report::percentile(sorted, .9) / 1e6, //
+			trace_report::percentile(sorted, .99) / 1e6, sorted.empty() ? 0 : sorted.back() / 1e6);
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage : %s trace.bin [chrome_trace.json]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	std::ifstream in(argv[1], std::ios::binary);
+	std::vector<trace_event> events;
+	if (!read_binary_trace(in, events)) {
+		fprintf(stderr, "unable to read trace '%s'\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	if (argc > 2) {
+		std::ofstream out(argv[2]);
+		write_chrome_trace(out, events);
+	}
+
+	const trace_report report = analyze_trace(events);
+	printf("events         %zu\n", events.size());
+	printf("issued         %llu\n", (unsigned long long) report.issued);
+	printf("pushed         %llu\n", (unsigned long long) report.pushed);
+	printf("rejected       %llu\n", (unsigned long long) report.rejected);
+	printf("read           %llu\n", (unsigned long long) report.read);
+	printf("wasted         %llu (%.1f%% of pushed)\n", (unsigned long long) report.wasted, report.pushed ? 100. * report.wasted / report.pushed : 0.);
+	printDistribution("issue -> push", report.processTimes);
+	printDistribution("push -> get", report.leadTimes);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+/*
+ * TraceGenerator.cpp
+ *
+ *  Writes synthetic session traces (see concurrent/cache/session_trace.hpp)
+ *  to stress the cache with access patterns the production traces lack.
+ *
+ *  usage : TraceGenerator <scenario> [options] > trace.txt
+ *  scenarios :
+ *  - linear       plays all the frames once
+ *  - seek-storm   the user scrubs, a new job every few hundred ms
+ *  - ping-pong    loops back and forth between two marks
+ *  - multi-clip   interleaves the frames of several clips (compare mode)
+ *  options :
+ *  --frames N      frames per clip (default 1000)
+ *  --clips N       clips for multi-clip (default 2)
+ *  --lookahead N   frames requested by a job (default 100)
+ *  --jobs N        jobs for seek-storm and ping-pong (default 50)
+ *  --fps N         playback rate of the gets (default 24)
+ *  --heavy-tail    Pareto distributed decode times instead of normal
+ *  --seed N        random seed (default 1)
+ */
+
+#include <concurrent/cache/session_trace.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace concurrent::cache;
+
+// multi-clip ids : clip * CLIP_STRIDE + frame
+static const uint64_t CLIP_STRIDE = 1000000;
+
+struct settings {
+	std::string scenario;
+	uint64_t frames = 1000;
+	uint64_t clips = 2;
+	uint64_t lookahead = 100;
+	uint64_t jobs = 50;
+	uint64_t fps = 24;
+	bool heavyTail = false;
+	unsigned seed = 1;
+};
+
+struct generator {
+	generator(const settings &s) :
+			s(s), random(s.seed) {
+	}
+
+	frame_timing timing() {
+		std::normal_distribution<double> load(20, 8);
+		frame_timing result;
+		result.load = uint64_t(std::max(1., load(random)));
+		if (s.heavyTail) {
+			// Pareto with alpha 1.5 and 10ms minimum, mean 30ms
+			std::uniform_real_distribution<double> uniform(0, 1);
+			result.decode = uint64_t(std::min(10. / std::pow(1. - uniform(random), 1. / 1.5), 5000.));
+		} else {
+			std::normal_distribution<double> decode(19, 2);
+			result.decode = uint64_t(std::max(1., decode(random)));
+		}
+		return result;
+	}
+
+	/**
+	 * Posts a job and reads its first 'reads' ids at playback rate,
+	 * returns the time of the last read.
+	 */
+	uint64_t job(uint64_t time, const std::vector<uint64_t> &ids, size_t reads) {
+		event(SESSION_PROCESS, time, 0, false);
+		for (uint64_t id : ids)
+			event(SESSION_REQUEST, time, id, false);
+		const uint64_t period = 1000000 / s.fps;
+		reads = std::min(reads, ids.size());
+		for (size_t i = 0; i < reads; ++i)
+			event(SESSION_GET, time + (i + 1) * period, ids[i], false);
+		return time + reads * period;
+	}
+
+	void event(session_event_type type, uint64_t time, uint64_t id, bool flag) {
+		const session_event e = { type, time, id, flag };
+		trace.events.push_back(e);
+	}
+
+	std::vector<uint64_t> range(uint64_t from, uint64_t count, bool forward = true) {
+		std::vector<uint64_t> ids;
+		for (uint64_t i = 0; i < count; ++i)
+			ids.push_back(forward ? from + i : from - i);
+		return ids;
+	}
+
+	void linear() {
+		for (uint64_t frame = 0; frame < s.frames; ++frame)
+			trace.timings[frame] = timing();
+		job(0, range(0, s.frames), s.frames);
+	}
+
+	void seekStorm() {
+		for (uint64_t frame = 0; frame < s.frames; ++frame)
+			trace.timings[frame] = timing();
+		std::uniform_int_distribution<uint64_t> position(0, s.frames - 1);
+		std::uniform_int_distribution<uint64_t> pause(50000, 400000);
+		uint64_t time = 0;
+		for (uint64_t i = 0; i < s.jobs; ++i) {
+			const uint64_t from = position(random);
+			// only the frame under the cursor is displayed before the next seek
+			job(time, range(from, std::min(s.lookahead, s.frames - from)), 1);
+			time += pause(random);
+		}
+	}
+
+	void pingPong() {
+		for (uint64_t frame = 0; frame < s.frames; ++frame)
+			trace.timings[frame] = timing();
+		const uint64_t length = std::min(s.lookahead, s.frames);
+		const uint64_t in = (s.frames - length) / 2;
+		const uint64_t out = in + length - 1;
+		uint64_t time = 0;
+		for (uint64_t i = 0; i < s.jobs; ++i) {
+			const bool forward = i % 2 == 0;
+			time = job(time, range(forward ? in : out, length, forward), length);
+		}
+	}
+
+	void multiClip() {
+		for (uint64_t clip = 0; clip < s.clips; ++clip)
+			for (uint64_t frame = 0; frame < s.frames; ++frame)
+				trace.timings[clip * CLIP_STRIDE + frame] = timing();
+		std::vector<uint64_t> ids;
+		for (uint64_t frame = 0; frame < s.frames; ++frame)
+			for (uint64_t clip = 0; clip < s.clips; ++clip)
+				ids.push_back(clip * CLIP_STRIDE + frame);
+		// all the clips are displayed at once, reading a frame of each per period
+		event(SESSION_PROCESS, 0, 0, false);
+		for (uint64_t id : ids)
+			event(SESSION_REQUEST, 0, id, false);
+		const uint64_t period = 1000000 / s.fps;
+		for (size_t i = 0; i < ids.size(); ++i)
+			event(SESSION_GET, (i / s.clips + 1) * period, ids[i], false);
+	}
+
+	bool run() {
+		if (s.scenario == "linear")
+			linear();
+		else if (s.scenario == "seek-storm")
+			seekStorm();
+		else if (s.scenario == "ping-pong")
+			pingPong();
+		else if (s.scenario == "multi-clip")
+			multiClip();
+		else
+			return false;
+		std::stable_sort(trace.events.begin(), trace.events.end(), [](const session_event &a, const session_event &b) {
+			return a.time < b.time;
+		});
+		return true;
+	}
+
+	const settings s;
+	std::mt19937 random;
+	session_trace trace;
+};
+
+static bool parse(int argc, char **argv, settings &s) {
+	if (argc < 2)
+		return false;
+	s.scenario = argv[1];
+	for (int i = 2; i < argc; ++i) {
+		const char *option = argv[i];
+		if (strcmp(option, "--heavy-tail") == 0) {
+			s.heavyTail = true;
+			continue;
+		}
+		if (i + 1 == argc)
+			return false;
+		const uint64_t value = strtoull(argv[++i], nullptr, 10);
+		if (strcmp(option, "--frames") == 0)
+			s.frames = value;
+		else if (strcmp(option, "--clips") == 0)
+			s.clips = value;
+		else if (strcmp(option, "--lookahead") == 0)
+			s.lookahead = value;
+		else if (strcmp(option, "--jobs") == 0)
+			s.jobs = value;
+		else if (strcmp(option, "--fps") == 0)
+			s.fps = value;
+		else if (strcmp(option, "--seed") == 0)
+			s.seed = unsigned(value);
+		else
+			return false;
+	}
+	return s.frames > 0 && s.clips > 0 && s.fps > 0;
+}
+
+int main(int argc, char **argv) {
+	settings s;
+	const bool valid = parse(argc, argv, s);
+	generator g(s);
+	if (!valid || !g.run()) {
+		fprintf(stderr, "usage : %s linear|seek-storm|ping-pong|multi-clip [--frames N] [--clips N] [--lookahead N] [--jobs N] [--fps N] [--heavy-tail] [--seed N]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	std::cout << "# " << s.scenario << " scenario, seed " << s.seed << '\n';
+	write_session_trace(std::cout, g.trace);
+	return EXIT_SUCCESS;
+}